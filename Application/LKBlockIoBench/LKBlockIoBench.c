@@ -0,0 +1,444 @@
+/** @file
+  Benchmarks the block devices published by MMCHSDxe
+
+  Runs sequential and random reads (and writes, if asked for) with transfer
+  sizes from 512 bytes to 4MB and prints the throughput and IOPS as seen by
+  BlockIo callers. If MMCHSDxe was built with PcdMMCHSTrace the recorded
+  boot workload of every device gets replayed as well.
+
+  Writes never change the contents of a device: every block gets read first
+  and the same data is written back.
+
+  Usage: LKBlockIoBench [-w] [-t]
+
+    -w  also benchmark writes and replay the writes of the trace
+    -t  only replay the trace
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <Uefi.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/LKBlockIoTrace.h>
+
+#define BENCH_MIN_TRANSFER_SIZE   SIZE_512
+#define BENCH_MAX_TRANSFER_SIZE   SIZE_4MB
+// amount of data every single test moves
+#define BENCH_TEST_SIZE           SIZE_16MB
+#define BENCH_MIN_OPERATIONS      8
+
+STATIC UINT32  mRandomState = 0x2545F491;
+
+STATIC
+UINT32
+BenchRandom (
+  VOID
+  )
+{
+  // xorshift32
+  mRandomState ^= mRandomState << 13;
+  mRandomState ^= mRandomState >> 17;
+  mRandomState ^= mRandomState << 5;
+  return mRandomState;
+}
+
+/**
+  Prints the result of one test.
+
+  @param  Name         Name of the test.
+  @param  TransferSize Bytes per operation, 0 for a trace replay.
+  @param  Operations   Number of operations.
+  @param  Bytes        Number of bytes transferred.
+  @param  TimeNs       Time the operations took.
+
+**/
+STATIC
+VOID
+BenchReport (
+  IN CONST CHAR16                   *Name,
+  IN UINTN                          TransferSize,
+  IN UINT64                         Operations,
+  IN UINT64                         Bytes,
+  IN UINT64                         TimeNs
+  )
+{
+  UINT64                     KBps;
+  UINT64                     Iops;
+
+  if (TimeNs == 0) {
+    TimeNs = 1;
+  }
+
+  // bytes/ns * 10^9 / 1000
+  KBps = DivU64x64Remainder (MultU64x32 (Bytes, 1000000), TimeNs, NULL);
+  Iops = DivU64x64Remainder (MultU64x32 (Operations, 1000000000), TimeNs, NULL);
+
+  if (TransferSize == 0) {
+    Print (L"  %-12s          ", Name);
+  } else if (TransferSize < SIZE_1KB) {
+    Print (L"  %-12s %5uB   ", Name, TransferSize);
+  } else if (TransferSize < SIZE_1MB) {
+    Print (L"  %-12s %5uK   ", Name, TransferSize / SIZE_1KB);
+  } else {
+    Print (L"  %-12s %5uM   ", Name, TransferSize / SIZE_1MB);
+  }
+
+  Print (
+    L"%5Lu.%02Lu MB/s %8Lu IOPS\n",
+    DivU64x32 (KBps, 1000),
+    DivU64x32 (ModU64x32 (KBps, 1000), 10),
+    Iops
+    );
+}
+
+/**
+  Reads a range and writes the same data back. Only the write and the final
+  flush are timed.
+
+  @return EFI_SUCCESS or the error of the BlockIo call which failed.
+
+**/
+STATIC
+EFI_STATUS
+BenchRewrite (
+  IN     EFI_BLOCK_IO_PROTOCOL      *BlockIo,
+  IN     EFI_LBA                    Lba,
+  IN     UINTN                      Size,
+  IN     VOID                       *Buffer,
+  IN OUT UINT64                     *TimeNs
+  )
+{
+  EFI_STATUS                 Status;
+  UINT64                     Start;
+
+  Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, Lba, Size, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Start = GetPerformanceCounter ();
+  Status = BlockIo->WriteBlocks (BlockIo, BlockIo->Media->MediaId, Lba, Size, Buffer);
+  *TimeNs += GetTimeInNanoSecond (GetPerformanceCounter () - Start);
+
+  return Status;
+}
+
+/**
+  Runs one synthetic test.
+
+  @param  BlockIo      The device.
+  @param  Write        TRUE to benchmark writes.
+  @param  Random       TRUE for random, FALSE for sequential access.
+  @param  TransferSize Bytes per operation.
+  @param  Buffer       A buffer of at least TransferSize bytes.
+
+**/
+STATIC
+VOID
+BenchRunTest (
+  IN EFI_BLOCK_IO_PROTOCOL          *BlockIo,
+  IN BOOLEAN                        Write,
+  IN BOOLEAN                        Random,
+  IN UINTN                          TransferSize,
+  IN VOID                           *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_BLOCK_IO_MEDIA         *Media;
+  UINT64                     DeviceBlocks;
+  UINTN                      NumBlocks;
+  UINT64                     Slots;
+  UINTN                      Operations;
+  UINTN                      Index;
+  EFI_LBA                    Lba;
+  UINT64                     Start;
+  UINT64                     TimeNs;
+
+  Media        = BlockIo->Media;
+  DeviceBlocks = Media->LastBlock + 1;
+  NumBlocks    = TransferSize / Media->BlockSize;
+  Slots        = DivU64x32 (DeviceBlocks, (UINT32)NumBlocks);
+  Operations   = MAX (BENCH_TEST_SIZE / TransferSize, BENCH_MIN_OPERATIONS);
+
+  if (Slots == 0) {
+    return;
+  }
+
+  TimeNs = 0;
+  Status = EFI_SUCCESS;
+  Start  = GetPerformanceCounter ();
+
+  for (Index = 0; Index < Operations; Index++) {
+    if (Random) {
+      Lba = MultU64x32 (ModU64x32 (LShiftU64 (BenchRandom (), 32) | BenchRandom (), (UINT32)MIN (Slots, MAX_UINT32)), (UINT32)NumBlocks);
+    } else {
+      Lba = MultU64x32 (ModU64x32 (Index, (UINT32)MIN (Slots, MAX_UINT32)), (UINT32)NumBlocks);
+    }
+
+    if (Write) {
+      Status = BenchRewrite (BlockIo, Lba, TransferSize, Buffer, &TimeNs);
+    } else {
+      Status = BlockIo->ReadBlocks (BlockIo, Media->MediaId, Lba, TransferSize, Buffer);
+    }
+    if (EFI_ERROR (Status)) {
+      Print (L"  I/O error at LBA %Lu: %r\n", Lba, Status);
+      return;
+    }
+  }
+
+  if (Write) {
+    Start = GetPerformanceCounter ();
+    Status = BlockIo->FlushBlocks (BlockIo);
+    TimeNs += GetTimeInNanoSecond (GetPerformanceCounter () - Start);
+    if (EFI_ERROR (Status)) {
+      Print (L"  flush failed: %r\n", Status);
+      return;
+    }
+  } else {
+    TimeNs = GetTimeInNanoSecond (GetPerformanceCounter () - Start);
+  }
+
+  BenchReport (
+    Write ? (Random ? L"rand write" : L"seq write") : (Random ? L"rand read" : L"seq read"),
+    TransferSize,
+    Operations,
+    MultU64x32 (Operations, (UINT32)TransferSize),
+    TimeNs
+    );
+}
+
+/**
+  Replays the trace MMCHSDxe recorded for a device.
+
+  @param  BlockIo      The device.
+  @param  Trace        The device's trace protocol.
+  @param  Write        TRUE to replay writes too.
+  @param  Buffer       A buffer of BENCH_MAX_TRANSFER_SIZE bytes.
+
+**/
+STATIC
+VOID
+BenchReplayTrace (
+  IN EFI_BLOCK_IO_PROTOCOL          *BlockIo,
+  IN EFI_LK_BLOCK_IO_TRACE_PROTOCOL *Trace,
+  IN BOOLEAN                        Write,
+  IN VOID                           *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  LK_BLOCK_IO_TRACE_ENTRY    *Entries;
+  UINTN                      Count;
+  UINTN                      Index;
+  EFI_LBA                    Lba;
+  UINT64                     Remaining;
+  UINTN                      Size;
+  UINT64                     Operations;
+  UINT64                     Bytes;
+  UINT64                     Start;
+  UINT64                     TimeNs;
+
+  Count = Trace->GetTrace (Trace, &Entries);
+  if (Count == 0) {
+    Print (L"  no trace recorded\n");
+    return;
+  }
+
+  Operations = 0;
+  Bytes      = 0;
+  TimeNs     = 0;
+
+  for (Index = 0; Index < Count; Index++) {
+    if (Entries[Index].Type == LK_BLOCK_IO_TRACE_WRITE && !Write) {
+      continue;
+    }
+
+    // requests bigger than our buffer get split, which is close enough
+    Lba       = Entries[Index].Lba;
+    Remaining = MultU64x32 (Entries[Index].NumBlocks, BlockIo->Media->BlockSize);
+    while (Remaining > 0) {
+      Size = (UINTN)MIN (Remaining, BENCH_MAX_TRANSFER_SIZE);
+
+      if (Entries[Index].Type == LK_BLOCK_IO_TRACE_WRITE) {
+        Status = BenchRewrite (BlockIo, Lba, Size, Buffer, &TimeNs);
+      } else {
+        Start = GetPerformanceCounter ();
+        Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, Lba, Size, Buffer);
+        TimeNs += GetTimeInNanoSecond (GetPerformanceCounter () - Start);
+      }
+      if (EFI_ERROR (Status)) {
+        Print (L"  I/O error at LBA %Lu: %r\n", Lba, Status);
+        return;
+      }
+
+      Lba       += Size / BlockIo->Media->BlockSize;
+      Remaining -= Size;
+    }
+
+    Operations++;
+    Bytes += MultU64x32 (Entries[Index].NumBlocks, BlockIo->Media->BlockSize);
+  }
+
+  if (Write) {
+    Start = GetPerformanceCounter ();
+    BlockIo->FlushBlocks (BlockIo);
+    TimeNs += GetTimeInNanoSecond (GetPerformanceCounter () - Start);
+  }
+
+  Print (L"  trace: %u requests\n", Count);
+  BenchReport (L"replay", 0, Operations, Bytes, TimeNs);
+}
+
+/**
+  Checks whether a BlockIo handle is a whole device published by MMCHSDxe.
+
+**/
+STATIC
+BOOLEAN
+BenchIsLKDevice (
+  IN EFI_HANDLE                     Handle,
+  IN EFI_BLOCK_IO_PROTOCOL          *BlockIo
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL   *DevicePath;
+
+  if (BlockIo->Media->LogicalPartition || !BlockIo->Media->MediaPresent) {
+    return FALSE;
+  }
+
+  // MMCHSDxe devices are a single vendor hardware node
+  DevicePath = DevicePathFromHandle (Handle);
+  if (DevicePath == NULL ||
+      DevicePathType (DevicePath) != HARDWARE_DEVICE_PATH ||
+      DevicePathSubType (DevicePath) != HW_VENDOR_DP) {
+    return FALSE;
+  }
+
+  return IsDevicePathEnd (NextDevicePathNode (DevicePath));
+}
+
+/**
+  Checks whether the command line contains an option.
+
+**/
+STATIC
+BOOLEAN
+BenchHasOption (
+  IN EFI_HANDLE                     ImageHandle,
+  IN CONST CHAR16                   *Option
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_LOADED_IMAGE_PROTOCOL  *LoadedImage;
+
+  Status = gBS->HandleProtocol (ImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+  if (EFI_ERROR (Status) || LoadedImage->LoadOptions == NULL || LoadedImage->LoadOptionsSize < sizeof (CHAR16)) {
+    return FALSE;
+  }
+
+  // the shell passes the command line as a NUL terminated string
+  return StrStr ((CHAR16 *)LoadedImage->LoadOptions, Option) != NULL;
+}
+
+EFI_STATUS
+EFIAPI
+LKBlockIoBenchMain (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_HANDLE                      *Handles;
+  UINTN                           HandleCount;
+  UINTN                           Index;
+  EFI_BLOCK_IO_PROTOCOL           *BlockIo;
+  EFI_LK_BLOCK_IO_TRACE_PROTOCOL  *Trace;
+  CHAR16                          *DevicePathText;
+  VOID                            *Buffer;
+  BOOLEAN                         Write;
+  BOOLEAN                         TraceOnly;
+  BOOLEAN                         WasTracing;
+  UINTN                           TransferSize;
+
+  Write     = BenchHasOption (ImageHandle, L" -w");
+  TraceOnly = BenchHasOption (ImageHandle, L" -t");
+
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gEfiBlockIoProtocolGuid, NULL, &HandleCount, &Handles);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Buffer = AllocatePages (EFI_SIZE_TO_PAGES (BENCH_MAX_TRANSFER_SIZE));
+  if (Buffer == NULL) {
+    FreePool (Handles);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; Index < HandleCount; Index++) {
+    Status = gBS->HandleProtocol (Handles[Index], &gEfiBlockIoProtocolGuid, (VOID **)&BlockIo);
+    if (EFI_ERROR (Status) || !BenchIsLKDevice (Handles[Index], BlockIo)) {
+      continue;
+    }
+
+    DevicePathText = ConvertDevicePathToText (DevicePathFromHandle (Handles[Index]), FALSE, FALSE);
+    Print (L"%s: %u byte blocks, %Lu blocks\n",
+      DevicePathText != NULL ? DevicePathText : L"<unknown device>",
+      BlockIo->Media->BlockSize, BlockIo->Media->LastBlock + 1);
+    if (DevicePathText != NULL) {
+      FreePool (DevicePathText);
+    }
+
+    // our own requests must not end up in the trace
+    Status = gBS->HandleProtocol (Handles[Index], &gEfiLKBlockIoTraceProtocolGuid, (VOID **)&Trace);
+    if (EFI_ERROR (Status)) {
+      Trace = NULL;
+    }
+    WasTracing = FALSE;
+    if (Trace != NULL) {
+      WasTracing = Trace->SetTracing (Trace, FALSE);
+    }
+
+    if (!TraceOnly) {
+      for (TransferSize = BENCH_MIN_TRANSFER_SIZE; TransferSize <= BENCH_MAX_TRANSFER_SIZE; TransferSize *= 2) {
+        if (TransferSize < BlockIo->Media->BlockSize) {
+          continue;
+        }
+
+        BenchRunTest (BlockIo, FALSE, FALSE, TransferSize, Buffer);
+        BenchRunTest (BlockIo, FALSE, TRUE, TransferSize, Buffer);
+        if (Write) {
+          BenchRunTest (BlockIo, TRUE, FALSE, TransferSize, Buffer);
+          BenchRunTest (BlockIo, TRUE, TRUE, TransferSize, Buffer);
+        }
+      }
+    }
+
+    if (Trace != NULL) {
+      BenchReplayTrace (BlockIo, Trace, Write, Buffer);
+      Trace->SetTracing (Trace, WasTracing);
+    } else if (TraceOnly) {
+      Print (L"  no trace available, build MMCHSDxe with PcdMMCHSTrace\n");
+    }
+  }
+
+  FreePages (Buffer, EFI_SIZE_TO_PAGES (BENCH_MAX_TRANSFER_SIZE));
+  FreePool (Handles);
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/** @file
+  Dumps the block I/O statistics MMCHSDxe collects when it's built with
+  PcdMMCHSStatistics.
+
+  Usage: LKBlockIoStats [-r]
+
+    -r  clear the counters after printing them
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <Uefi.h>
+
+#include <Library/BaseLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/LoadedImage.h>
+#include <Protocol/LKBlockIoStats.h>
+
+/**
+  Prints the counters of one operation type.
+
+  @param  Name         Name of the operation type.
+  @param  Stats        The counters.
+
+**/
+STATIC
+VOID
+PrintOpStats (
+  IN CONST CHAR16                   *Name,
+  IN LK_BLOCK_IO_OP_STATS           *Stats
+  )
+{
+  UINTN                      Bucket;
+
+  Print (L"  %-12s ops=%Lu bytes=%Lu errors=%Lu", Name, Stats->Operations, Stats->Bytes, Stats->Errors);
+  if (Stats->Operations != 0) {
+    Print (L" avg=%Luus", DivU64x64Remainder (Stats->TotalTimeNs, MultU64x32 (Stats->Operations, 1000), NULL));
+  }
+  Print (L"\n");
+
+  for (Bucket = 0; Bucket < LK_BLOCK_IO_STATS_HISTOGRAM_BUCKETS; Bucket++) {
+    if (Stats->Histogram[Bucket] == 0) {
+      continue;
+    }
+
+    if (Bucket == 0) {
+      Print (L"    <1us: %Lu\n", Stats->Histogram[Bucket]);
+    } else if (Bucket == LK_BLOCK_IO_STATS_HISTOGRAM_BUCKETS - 1) {
+      Print (L"    >=%Luus: %Lu\n", LShiftU64 (1, Bucket - 1), Stats->Histogram[Bucket]);
+    } else {
+      Print (L"    <%Luus: %Lu\n", LShiftU64 (1, Bucket), Stats->Histogram[Bucket]);
+    }
+  }
+}
+
+/**
+  Returns TRUE if the command line contains -r.
+
+**/
+STATIC
+BOOLEAN
+WantsReset (
+  IN EFI_HANDLE                     ImageHandle
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_LOADED_IMAGE_PROTOCOL  *LoadedImage;
+
+  Status = gBS->HandleProtocol (ImageHandle, &gEfiLoadedImageProtocolGuid, (VOID **)&LoadedImage);
+  if (EFI_ERROR (Status) || LoadedImage->LoadOptions == NULL || LoadedImage->LoadOptionsSize < sizeof (CHAR16)) {
+    return FALSE;
+  }
+
+  // the shell passes the command line as a NUL terminated string
+  return StrStr ((CHAR16 *)LoadedImage->LoadOptions, L" -r") != NULL;
+}
+
+EFI_STATUS
+EFIAPI
+LKBlockIoStatsMain (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_HANDLE                      *Handles;
+  UINTN                           HandleCount;
+  UINTN                           Index;
+  EFI_LK_BLOCK_IO_STATS_PROTOCOL  *StatsProtocol;
+  EFI_DEVICE_PATH_PROTOCOL        *DevicePath;
+  CHAR16                          *DevicePathText;
+  LK_BLOCK_IO_STATS               Stats;
+  BOOLEAN                         Reset;
+
+  Status = gBS->LocateHandleBuffer (ByProtocol, &gEfiLKBlockIoStatsProtocolGuid, NULL, &HandleCount, &Handles);
+  if (EFI_ERROR (Status)) {
+    Print (L"No block I/O statistics available, build MMCHSDxe with PcdMMCHSStatistics.\n");
+    return EFI_NOT_FOUND;
+  }
+
+  Reset = WantsReset (ImageHandle);
+
+  for (Index = 0; Index < HandleCount; Index++) {
+    Status = gBS->HandleProtocol (Handles[Index], &gEfiLKBlockIoStatsProtocolGuid, (VOID **)&StatsProtocol);
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    DevicePathText = NULL;
+    DevicePath = DevicePathFromHandle (Handles[Index]);
+    if (DevicePath != NULL) {
+      DevicePathText = ConvertDevicePathToText (DevicePath, FALSE, FALSE);
+    }
+
+    StatsProtocol->GetStats (StatsProtocol, &Stats);
+
+    Print (L"%s\n", DevicePathText != NULL ? DevicePathText : L"<unknown device>");
+    Print (L"  queue depth=%u max=%u\n", Stats.QueueDepth, Stats.MaxQueueDepth);
+    PrintOpStats (L"read", &Stats.Read);
+    PrintOpStats (L"write", &Stats.Write);
+    PrintOpStats (L"device read", &Stats.DeviceRead);
+    PrintOpStats (L"device write", &Stats.DeviceWrite);
+
+    if (Reset) {
+      StatsProtocol->ResetStats (StatsProtocol);
+    }
+
+    if (DevicePathText != NULL) {
+      FreePool (DevicePathText);
+    }
+  }
+
+  FreePool (Handles);
+
+  return EFI_SUCCESS;
+}
@@ -24,6 +24,11 @@
 #include <LittleKernel.h>
 #include <Library/UefiBootServicesTableLib.h>
 
+VOID
+NvVarsPreload (
+  VOID
+  );
+
 STATIC VOID
 lkapi_event_init(VOID** event)
 {
@@ -71,5 +76,10 @@ DxeInitInitialize (
   LKApi->event_wait = lkapi_event_wait;
   LKApi->event_signal = lkapi_event_signal;
 
+  // restore the variable store before EmuVariableFvbRuntimeDxe starts
+  if (FeaturePcdGet (PcdNvVarsPreload)) {
+    NvVarsPreload ();
+  }
+
   return EFI_SUCCESS;
 }
@@ -0,0 +1,190 @@
+/** @file
+  Early restore of the NV variables
+
+  Replays the NvVars log from the LK VNOR device into the memory
+  EmuVariableFvbRuntimeDxe takes over through PcdEmuVariableNvStoreReserved.
+  The variable driver then starts with all variables in place, and
+  NvVarsBlockIoLib skips its per-variable restore since the NvVars variable
+  is part of the store.
+
+  This runs before MMCHSDxe, so the device is accessed through LK directly.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <PiDxe.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/NvVarsLogLib.h>
+#include <Library/PcdLib.h>
+#include <LittleKernel.h>
+
+//
+// Size of the buffer EmuVariableFvbRuntimeDxe expects: two blocks of
+// PcdFlashNvStorageFtwSpareSize, the variable store at the start.
+//
+#define NVVARS_PRELOAD_STORE_SIZE (2 * FixedPcdGet32 (PcdFlashNvStorageFtwSpareSize))
+
+STATIC lkapi_biodev_t         mVnorDev;
+STATIC EFI_BLOCK_IO_MEDIA     mVnorMedia;
+
+/**
+  Reads blocks from the VNOR device through LK.
+
+  Implements EFI_BLOCK_IO_PROTOCOL.ReadBlocks, which is all NvVarsLogReplay
+  needs.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+NvVarsPreloadReadBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL          *This,
+  IN UINT32                         MediaId,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  )
+{
+  if (BufferSize % mVnorMedia.BlockSize != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  if (mVnorDev.read (&mVnorDev, Lba, BufferSize, Buffer)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BLOCK_IO_PROTOCOL  mVnorBlockIo = {
+  EFI_BLOCK_IO_PROTOCOL_REVISION,
+  &mVnorMedia,
+  NULL,                         // Reset
+  NvVarsPreloadReadBlocks,
+  NULL,                         // WriteBlocks
+  NULL                          // FlushBlocks
+};
+
+/**
+  Looks up the VNOR device and gets it ready for reading.
+
+  @retval EFI_SUCCESS      mVnorDev and mVnorMedia describe the device.
+  @retval EFI_NOT_FOUND    LK has no VNOR device.
+  @retval EFI_DEVICE_ERROR The device failed to initialize.
+
+**/
+STATIC
+EFI_STATUS
+NvVarsPreloadFindDevice (
+  VOID
+  )
+{
+  lkapi_biodev_t  *Devices;
+  UINTN           Count;
+  UINTN           Index;
+  EFI_STATUS      Status;
+
+  Devices = GetLKBioDevices (&Count);
+  if (Devices == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  Status = EFI_NOT_FOUND;
+  for (Index = 0; Index < Count; Index++) {
+    if (Devices[Index].type != LKAPI_BIODEV_TYPE_VNOR) {
+      continue;
+    }
+
+    mVnorDev = Devices[Index];
+    if (mVnorDev.init (&mVnorDev) || mVnorDev.block_size == 0 || mVnorDev.num_blocks == 0) {
+      Status = EFI_DEVICE_ERROR;
+      break;
+    }
+
+    mVnorMedia.MediaPresent = TRUE;
+    mVnorMedia.BlockSize    = mVnorDev.block_size;
+    mVnorMedia.LastBlock    = mVnorDev.num_blocks - 1;
+    Status = EFI_SUCCESS;
+    break;
+  }
+
+  FreePool (Devices);
+
+  return Status;
+}
+
+/**
+  Restores the variable store from the VNOR device and hands it to
+  EmuVariableFvbRuntimeDxe.
+
+  Failing isn't fatal, NvVarsBlockIoLib restores the variables later on
+  then.
+
+**/
+VOID
+NvVarsPreload (
+  VOID
+  )
+{
+  EFI_STATUS          Status;
+  NVVARS_LOG_HEADER   *Header;
+  VOID                *Store;
+
+  Status = NvVarsPreloadFindDevice ();
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_INFO, "NvVars: no device to preload from: %r\n", Status));
+    return;
+  }
+
+  Header = AllocatePool (mVnorMedia.BlockSize);
+  if (Header == NULL) {
+    return;
+  }
+
+  Store = NULL;
+  Status = NvVarsPreloadReadBlocks (&mVnorBlockIo, 0, 0, mVnorMedia.BlockSize, Header);
+  if (EFI_ERROR (Status)) {
+    goto Exit;
+  }
+
+  //
+  // Only the log holds an image of the store; a store of a different size
+  // has been written by a differently configured build.
+  //
+  if (Header->Signature != NVVARS_LOG_SIGNATURE ||
+      Header->ImageSize != FixedPcdGet32 (PcdVariableStoreSize)) {
+    DEBUG ((EFI_D_INFO, "NvVars: no variable store log to preload\n"));
+    goto Exit;
+  }
+
+  Store = AllocateAlignedRuntimePages (EFI_SIZE_TO_PAGES (NVVARS_PRELOAD_STORE_SIZE), SIZE_64KB);
+  if (Store == NULL) {
+    goto Exit;
+  }
+  SetMem (Store, NVVARS_PRELOAD_STORE_SIZE, 0xff);
+
+  Status = NvVarsLogReplay (&mVnorBlockIo, Header, Store, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_WARN, "NvVars: preloading the variable store failed: %r\n", Status));
+    FreeAlignedPages (Store, EFI_SIZE_TO_PAGES (NVVARS_PRELOAD_STORE_SIZE));
+    goto Exit;
+  }
+
+  PcdSet64S (PcdEmuVariableNvStoreReserved, (UINT64)(UINTN) Store);
+
+  DEBUG ((EFI_D_INFO, "NvVars: preloaded the variable store to %p\n", Store));
+
+Exit:
+  FreePool (Header);
+}
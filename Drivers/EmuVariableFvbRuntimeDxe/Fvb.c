@@ -20,6 +20,7 @@
 
 #include <Protocol/FirmwareVolumeBlock.h>
 #include <Protocol/DevicePath.h>
+#include <Protocol/LKVariableStore.h>
 
 #include <Library/UefiLib.h>
 #include <Library/UefiDriverEntryPoint.h>
@@ -30,6 +31,7 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/DevicePathLib.h>
+#include <Library/NvVarsLogLib.h>
 #include <Library/PcdLib.h>
 #include <Library/PlatformFvbLib.h>
 #include "Fvb.h"
@@ -86,6 +88,16 @@ EFI_FW_VOL_BLOCK_DEVICE mEmuVarsFvb = {
     FvbProtocolEraseBlocks,
     NULL
   },
+  {     // VariableStoreInstance
+    VariableStoreGetStore,
+    VariableStoreTakeDirtyRanges,
+    VariableStoreArmRuntimeLog,
+    VariableStoreHasRuntimeLog
+  },
+  { { 0, 0 } }, // DirtyRanges
+  0,            // DirtyRangeCount
+  NULL,         // RuntimeLog
+  FALSE         // RuntimeLogArmed
 };
 
 
@@ -107,6 +119,234 @@ FvbVirtualAddressChangeEvent (
   )
 {
   EfiConvertPointer (0x0, &mEmuVarsFvb.BufferPtr);
+  if (mEmuVarsFvb.RuntimeLog != NULL) {
+    EfiConvertPointer (0x0, (VOID **) &mEmuVarsFvb.RuntimeLog);
+  }
+}
+
+
+/**
+  Records that a range of the variable store image has been modified.
+
+  Overlapping and adjacent ranges get merged. If there's no room for another
+  range the new one gets merged with its neighbour, which may mark some
+  unmodified bytes as dirty but never loses a modification.
+
+  @param[in] FvbDevice  The FVB device.
+  @param[in] Offset     Offset of the range from the start of the FV.
+  @param[in] Length     Length of the range in bytes.
+
+**/
+STATIC
+VOID
+FvbMarkDirty (
+  IN EFI_FW_VOL_BLOCK_DEVICE  *FvbDevice,
+  IN UINTN                    Offset,
+  IN UINTN                    Length
+  )
+{
+  LK_VARIABLE_STORE_RANGE *Ranges;
+  UINTN                   Start;
+  UINTN                   End;
+  UINTN                   Index;
+  UINTN                   Last;
+
+  Ranges = FvbDevice->DirtyRanges;
+
+  //
+  // Only the variable store gets persisted, the FTW areas behind it don't
+  //
+  Start = Offset;
+  End = MIN (Offset + Length, (UINTN) PcdGet32 (PcdVariableStoreSize));
+  if (Start >= End) {
+    return;
+  }
+
+  //
+  // Find the ranges the new one touches
+  //
+  for (Index = 0;
+       Index < FvbDevice->DirtyRangeCount && Ranges[Index].Offset + Ranges[Index].Length < Start;
+       Index++) {
+  }
+  for (Last = Index;
+       Last < FvbDevice->DirtyRangeCount && Ranges[Last].Offset <= End;
+       Last++) {
+    Start = MIN (Start, Ranges[Last].Offset);
+    End = MAX (End, Ranges[Last].Offset + Ranges[Last].Length);
+  }
+
+  if (Last == Index) {
+    if (FvbDevice->DirtyRangeCount == LK_VARIABLE_STORE_MAX_DIRTY_RANGES) {
+      //
+      // No room, grow a neighbour instead. It can't overlap the next range.
+      //
+      if (Index > 0) {
+        Index--;
+        End = MAX (End, Ranges[Index].Offset + Ranges[Index].Length);
+        Start = Ranges[Index].Offset;
+      } else {
+        End = Ranges[Index].Offset + Ranges[Index].Length;
+      }
+      Last = Index + 1;
+    } else {
+      CopyMem (
+        &Ranges[Index + 1],
+        &Ranges[Index],
+        (FvbDevice->DirtyRangeCount - Index) * sizeof (LK_VARIABLE_STORE_RANGE)
+        );
+      FvbDevice->DirtyRangeCount++;
+      Last = Index + 1;
+    }
+  }
+
+  //
+  // Ranges [Index, Last) collapse into one
+  //
+  Ranges[Index].Offset = Start;
+  Ranges[Index].Length = End - Start;
+  if (Last > Index + 1) {
+    CopyMem (
+      &Ranges[Index + 1],
+      &Ranges[Last],
+      (FvbDevice->DirtyRangeCount - Last) * sizeof (LK_VARIABLE_STORE_RANGE)
+      );
+    FvbDevice->DirtyRangeCount -= Last - Index - 1;
+  }
+}
+
+
+//
+// Variable store protocol APIs
+//
+
+/**
+  Returns the raw image of the variable store.
+
+  @param This     Indicates the EFI_LK_VARIABLE_STORE_PROTOCOL instance.
+  @param Buffer   Returns the address of the image.
+  @param Size     Returns the size of the image in bytes.
+
+**/
+VOID
+VariableStoreGetStore (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This,
+  OUT VOID                            **Buffer,
+  OUT UINTN                           *Size
+  )
+{
+  EFI_FW_VOL_BLOCK_DEVICE *FvbDevice;
+
+  FvbDevice = FVB_DEVICE_FROM_VARIABLE_STORE_THIS (This);
+
+  *Buffer = FvbDevice->BufferPtr;
+  *Size = PcdGet32 (PcdVariableStoreSize);
+}
+
+
+/**
+  Returns the ranges of the variable store image which have been written
+  since the last call and forgets them.
+
+  @param This     Indicates the EFI_LK_VARIABLE_STORE_PROTOCOL instance.
+  @param Ranges   Room for LK_VARIABLE_STORE_MAX_DIRTY_RANGES ranges.
+
+  @return The number of ranges copied to Ranges.
+
+**/
+UINTN
+VariableStoreTakeDirtyRanges (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This,
+  OUT LK_VARIABLE_STORE_RANGE         *Ranges
+  )
+{
+  EFI_FW_VOL_BLOCK_DEVICE *FvbDevice;
+  EFI_TPL                 OldTpl;
+  UINTN                   Count;
+
+  FvbDevice = FVB_DEVICE_FROM_VARIABLE_STORE_THIS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Count = FvbDevice->DirtyRangeCount;
+  CopyMem (Ranges, FvbDevice->DirtyRanges, Count * sizeof (LK_VARIABLE_STORE_RANGE));
+  FvbDevice->DirtyRangeCount = 0;
+  gBS->RestoreTPL (OldTpl);
+
+  return Count;
+}
+
+
+/**
+  Makes the writes after ExitBootServices go to the runtime log.
+
+  @param This         Indicates the EFI_LK_VARIABLE_STORE_PROTOCOL instance.
+  @param Generation   The generation of the NvVars log on the device.
+  @param NextLba      The block following the last record of that generation.
+
+  @retval EFI_SUCCESS       The runtime log continues the given log.
+  @retval EFI_UNSUPPORTED   There's no runtime log.
+
+**/
+EFI_STATUS
+VariableStoreArmRuntimeLog (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This,
+  IN  UINT32                          Generation,
+  IN  UINT64                          NextLba
+  )
+{
+  EFI_FW_VOL_BLOCK_DEVICE *FvbDevice;
+  UINTN                   Index;
+
+  FvbDevice = FVB_DEVICE_FROM_VARIABLE_STORE_THIS (This);
+  if (FvbDevice->RuntimeLog == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  NvVarsRuntimeLogArm (
+    FvbDevice->RuntimeLog,
+    FixedPcdGet32 (PcdNvVarsRuntimeLogSize),
+    Generation,
+    NextLba
+    );
+  FvbDevice->RuntimeLogArmed = TRUE;
+
+  //
+  // Writes which haven't been saved yet are still dirty, the log has to
+  // start with them. This runs at ExitBootServices, so nothing may be
+  // allocated to write them to the device instead.
+  //
+  for (Index = 0; Index < FvbDevice->DirtyRangeCount; Index++) {
+    NvVarsRuntimeLogAppend (
+      FvbDevice->RuntimeLog,
+      FvbDevice->DirtyRanges[Index].Offset,
+      (UINT8*) FvbDevice->BufferPtr + FvbDevice->DirtyRanges[Index].Offset,
+      FvbDevice->DirtyRanges[Index].Length
+      );
+  }
+  FvbDevice->DirtyRangeCount = 0;
+
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Tells whether the runtime log could be reserved.
+
+  @param This         Indicates the EFI_LK_VARIABLE_STORE_PROTOCOL instance.
+
+  @retval TRUE        ArmRuntimeLog hands the writes to the runtime log.
+  @retval FALSE       There's no runtime log.
+
+**/
+BOOLEAN
+VariableStoreHasRuntimeLog (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This
+  )
+{
+  EFI_FW_VOL_BLOCK_DEVICE *FvbDevice;
+
+  FvbDevice = FVB_DEVICE_FROM_VARIABLE_STORE_THIS (This);
+  return (BOOLEAN) (FvbDevice->RuntimeLog != NULL);
 }
 
 
@@ -380,6 +620,11 @@ FvbProtocolEraseBlocks (
       EraseSize,
       ERASED_UINT8
       );
+    FvbMarkDirty (
+      FvbDevice,
+      (UINTN) ErasePtr - (UINTN) FvbDevice->BufferPtr,
+      EraseSize
+      );
     VA_START (args, This);
     PlatformFvbBlocksErased (This, args);
     VA_END (args);
@@ -479,6 +724,24 @@ FvbProtocolWrite (
 
   if (*NumBytes > 0) {
     CopyMem (FvbDataPtr, Buffer, *NumBytes);
+    FvbMarkDirty (
+      FvbDevice,
+      (UINTN) MultU64x32 (Lba, (UINT32) FvbDevice->BlockSize) + Offset,
+      *NumBytes
+      );
+
+    //
+    // Nothing persists the store anymore once the OS owns the hardware.
+    // Until the log got armed in this boot it still belongs to the last one.
+    //
+    if (FvbDevice->RuntimeLogArmed && EfiAtRuntime ()) {
+      NvVarsRuntimeLogAppend (
+        FvbDevice->RuntimeLog,
+        (UINTN) MultU64x32 (Lba, (UINT32) FvbDevice->BlockSize) + Offset,
+        Buffer,
+        *NumBytes
+        );
+    }
     PlatformFvbDataWritten (This, Lba, Offset, *NumBytes, Buffer);
   }
 
@@ -730,6 +993,7 @@ FvbInitialize (
   BOOLEAN                             Initialize;
   EFI_HANDLE                          Handle;
   EFI_PHYSICAL_ADDRESS                Address;
+  EFI_PHYSICAL_ADDRESS                RuntimeLogAddress;
 
   DEBUG ((EFI_D_INFO, "EMU Variable FVB Started\n"));
 
@@ -810,6 +1074,25 @@ FvbInitialize (
   mEmuVarsFvb.DevicePath.MemMapDevPath.StartingAddress = Address;
   mEmuVarsFvb.DevicePath.MemMapDevPath.EndingAddress = Address + EMU_FVB_SIZE - 1;
 
+  //
+  // Reserve the runtime log. What it holds is left alone, it may not have
+  // been replayed yet.
+  //
+  if (FixedPcdGet64 (PcdNvVarsRuntimeLogBase) != 0) {
+    RuntimeLogAddress = FixedPcdGet64 (PcdNvVarsRuntimeLogBase);
+    Status = gBS->AllocatePages (
+                    AllocateAddress,
+                    EfiRuntimeServicesData,
+                    EFI_SIZE_TO_PAGES (FixedPcdGet32 (PcdNvVarsRuntimeLogSize)),
+                    &RuntimeLogAddress
+                    );
+    if (!EFI_ERROR (Status)) {
+      mEmuVarsFvb.RuntimeLog = (NVVARS_RUNTIME_LOG_HEADER*)(UINTN) RuntimeLogAddress;
+    } else {
+      DEBUG ((EFI_D_WARN, "EMU Variable FVB: Can't reserve the runtime log: %r\n", Status));
+    }
+  }
+
   //
   // Install the protocols
   //
@@ -821,6 +1104,8 @@ FvbInitialize (
                   &mEmuVarsFvb.FwVolBlockInstance,
                   &gEfiDevicePathProtocolGuid,
                   &mEmuVarsFvb.DevicePath,
+                  &gEfiLKVariableStoreProtocolGuid,
+                  &mEmuVarsFvb.VariableStoreInstance,
                   NULL
                   );
   ASSERT_EFI_ERROR (Status);
@@ -26,6 +26,7 @@ Abstract:
 // Fvb Protocol instance data
 //
 #define FVB_DEVICE_FROM_THIS(a)         CR (a, EFI_FW_VOL_BLOCK_DEVICE, FwVolBlockInstance, FVB_DEVICE_SIGNATURE)
+#define FVB_DEVICE_FROM_VARIABLE_STORE_THIS(a)  CR (a, EFI_FW_VOL_BLOCK_DEVICE, VariableStoreInstance, FVB_DEVICE_SIGNATURE)
 #define FVB_DEVICE_SIGNATURE            SIGNATURE_32 ('F', 'V', 'B', 'N')
 
 #pragma pack (1)
@@ -52,6 +53,11 @@ typedef struct {
   UINTN                               BlockSize;
   UINTN                               Size;
   EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  FwVolBlockInstance;
+  EFI_LK_VARIABLE_STORE_PROTOCOL      VariableStoreInstance;
+  LK_VARIABLE_STORE_RANGE             DirtyRanges[LK_VARIABLE_STORE_MAX_DIRTY_RANGES];
+  UINTN                               DirtyRangeCount;
+  NVVARS_RUNTIME_LOG_HEADER           *RuntimeLog;
+  BOOLEAN                             RuntimeLogArmed;
 } EFI_FW_VOL_BLOCK_DEVICE;
 
 
@@ -137,4 +143,33 @@ FvbProtocolEraseBlocks (
   )
 ;
 
+VOID
+VariableStoreGetStore (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This,
+  OUT VOID                            **Buffer,
+  OUT UINTN                           *Size
+  )
+;
+
+UINTN
+VariableStoreTakeDirtyRanges (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This,
+  OUT LK_VARIABLE_STORE_RANGE         *Ranges
+  )
+;
+
+EFI_STATUS
+VariableStoreArmRuntimeLog (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This,
+  IN  UINT32                          Generation,
+  IN  UINT64                          NextLba
+  )
+;
+
+BOOLEAN
+VariableStoreHasRuntimeLog (
+  IN  EFI_LK_VARIABLE_STORE_PROTOCOL  *This
+  )
+;
+
 #endif
@@ -0,0 +1,252 @@
+/** @file
+
+  Copies the shadow framebuffer to VRAM in the panel's pixel format.
+
+  The shadow framebuffer is PixelBlueGreenRedReserved8BitPerColor. The row
+  copy for the panel's format gets picked once when the mode is set, using
+  NEON for the conversions if the CPU has it.
+
+  The rotated mode turns source columns into panel lines. It goes through
+  small tiles which stay in the cache, so the shadow framebuffer still gets
+  read by line and VRAM gets written in runs of a tile's width instead of
+  single pixels.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <PiDxe.h>
+#include <Library/BaseMemoryLib.h>
+
+#include "LcdGraphicsOutputDxe.h"
+
+#define LCD_ROTATE_TILE_SIZE  16
+
+BOOLEAN
+EFIAPI
+InternalLcdNeonSupported (
+  VOID
+  );
+
+//
+// These only do multiples of 8 pixels, the rest is left to the caller
+//
+VOID
+EFIAPI
+InternalLcdCopyRowRgb888Neon (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  );
+
+VOID
+EFIAPI
+InternalLcdCopyRowRgb565Neon (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  );
+
+STATIC
+VOID
+EFIAPI
+LcdCopyRowXrgb8888 (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  CopyMem (Destination, Source, Pixels * sizeof (UINT32));
+}
+
+STATIC
+VOID
+EFIAPI
+LcdCopyRowRgb888 (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  UINT8   *Out;
+  UINT32  Pixel;
+
+  Out = Destination;
+  while (Pixels-- != 0) {
+    Pixel = *Source++;
+    Out[0] = (UINT8)Pixel;
+    Out[1] = (UINT8)(Pixel >> 8);
+    Out[2] = (UINT8)(Pixel >> 16);
+    Out += 3;
+  }
+}
+
+STATIC
+VOID
+EFIAPI
+LcdCopyRowRgb565 (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  UINT16  *Out;
+  UINT32  Pixel;
+
+  Out = Destination;
+  while (Pixels-- != 0) {
+    Pixel = *Source++;
+    *Out++ = (UINT16)(((Pixel >> 8) & 0xf800) | ((Pixel >> 5) & 0x07e0) | ((Pixel >> 3) & 0x001f));
+  }
+}
+
+STATIC
+VOID
+EFIAPI
+LcdCopyRowRgb888Neon (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  UINTN   Bulk;
+
+  Bulk = Pixels & ~(UINTN)7;
+  InternalLcdCopyRowRgb888Neon (Destination, Source, Bulk);
+  LcdCopyRowRgb888 ((UINT8*)Destination + Bulk * 3, Source + Bulk, Pixels - Bulk);
+}
+
+STATIC
+VOID
+EFIAPI
+LcdCopyRowRgb565Neon (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  UINTN   Bulk;
+
+  Bulk = Pixels & ~(UINTN)7;
+  InternalLcdCopyRowRgb565Neon (Destination, Source, Bulk);
+  LcdCopyRowRgb565 ((UINT16*)Destination + Bulk, Source + Bulk, Pixels - Bulk);
+}
+
+VOID
+LcdSelectCopyRow (
+  IN LCD_INSTANCE *Instance
+  )
+{
+  BOOLEAN   Neon;
+
+  // reading the NEON feature register traps on ARM if VFP is off
+  Neon = FixedPcdGet32 (PcdVFPEnabled) != 0 && InternalLcdNeonSupported ();
+
+  switch (LcdGetPixelFormat ()) {
+    case LKAPI_LCD_PIXELFORMAT_RGB888:
+      Instance->CopyRow = Neon ? LcdCopyRowRgb888Neon : LcdCopyRowRgb888;
+      break;
+    case LKAPI_LCD_PIXELFORMAT_RGB565:
+      Instance->CopyRow = Neon ? LcdCopyRowRgb565Neon : LcdCopyRowRgb565;
+      break;
+    case LKAPI_LCD_PIXELFORMAT_XRGB8888:
+      Instance->CopyRow = LcdCopyRowXrgb8888;
+      break;
+    default:
+      DEBUG((DEBUG_ERROR, "LcdSelectCopyRow: Unsupported pixel format %d\n", LcdGetPixelFormat ()));
+      Instance->CopyRow = NULL;
+      break;
+  }
+}
+
+STATIC
+VOID
+LcdCopyRotated (
+  IN LCD_INSTANCE   *Instance,
+  IN CONST LCD_RECT *Rect
+)
+{
+  UINT32          Tile[LCD_ROTATE_TILE_SIZE][LCD_ROTATE_TILE_SIZE];
+  UINT32          TileX;
+  UINT32          TileY;
+  UINT32          TileWidth;
+  UINT32          TileHeight;
+  UINT32          Column;
+  UINT32          Line;
+  CONST UINT32    *Source;
+  UINTN           BytesPerPixel;
+  UINT32          HorizontalResolution;
+  UINT32          VerticalResolution;
+
+  UINT8*  HWBuffer = (VOID*)(UINTN)Instance->FrameBufferBase;
+  UINT32* SWBuffer = (VOID*)(UINTN)Instance->Gop.Mode->FrameBufferBase;
+
+  BytesPerPixel = GetBytesPerPixel();
+  HorizontalResolution = Instance->ModeInfo.HorizontalResolution;
+  VerticalResolution = Instance->ModeInfo.VerticalResolution;
+
+  for (TileY = Rect->Top; TileY < Rect->Bottom; TileY += LCD_ROTATE_TILE_SIZE) {
+    TileHeight = MIN (LCD_ROTATE_TILE_SIZE, Rect->Bottom - TileY);
+
+    for (TileX = Rect->Left; TileX < Rect->Right; TileX += LCD_ROTATE_TILE_SIZE) {
+      TileWidth = MIN (LCD_ROTATE_TILE_SIZE, Rect->Right - TileX);
+
+      // LEFT, source line y ends up in panel column VerticalResolution-1-y,
+      // so the lines go into the tile in reverse order
+      for (Line = 0; Line < TileHeight; Line++) {
+        Source = SWBuffer + (UINTN)(TileY + Line) * HorizontalResolution + TileX;
+        for (Column = 0; Column < TileWidth; Column++) {
+          Tile[Column][TileHeight - 1 - Line] = Source[Column];
+        }
+      }
+
+      // and source column x is panel line x
+      for (Column = 0; Column < TileWidth; Column++) {
+        Instance->CopyRow (
+          HWBuffer + ((UINTN)(TileX + Column) * VerticalResolution + (VerticalResolution - TileY - TileHeight)) * BytesPerPixel,
+          Tile[Column],
+          TileHeight
+          );
+      }
+    }
+  }
+}
+
+VOID
+LcdCopy (
+  IN LCD_INSTANCE   *Instance,
+  IN CONST LCD_RECT *Rect
+)
+{
+  UINT32          SourceLine;
+  UINTN           BytesPerPixel;
+  UINT32          HorizontalResolution;
+
+  UINT8*  HWBuffer = (VOID*)(UINTN)Instance->FrameBufferBase;
+  UINT32* SWBuffer = (VOID*)(UINTN)Instance->Gop.Mode->FrameBufferBase;
+
+  if (Instance->CopyRow == NULL)
+    return;
+
+  if (Instance->Gop.Mode->Mode != 0) {
+    LcdCopyRotated (Instance, Rect);
+    return;
+  }
+
+  BytesPerPixel = GetBytesPerPixel();
+  HorizontalResolution = Instance->ModeInfo.HorizontalResolution;
+
+  for (SourceLine = Rect->Top; SourceLine < Rect->Bottom; SourceLine++) {
+    Instance->CopyRow (
+      HWBuffer + ((UINTN)SourceLine * HorizontalResolution + Rect->Left) * BytesPerPixel,
+      SWBuffer + (UINTN)SourceLine * HorizontalResolution + Rect->Left,
+      Rect->Right - Rect->Left
+      );
+  }
+}
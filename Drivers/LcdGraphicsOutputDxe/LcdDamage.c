@@ -0,0 +1,129 @@
+/** @file
+
+  Damage tracking of the shadow framebuffer.
+
+  Blt records the rectangles it changed, so a flush only has to copy those
+  to VRAM. Rectangles get merged when their bounding box doesn't waste more
+  than a quarter of its area, e.g. the cells of a line of console output.
+  If there's no room for another rectangle it's merged into the one which
+  grows the least.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <PiDxe.h>
+
+#include "LcdGraphicsOutputDxe.h"
+
+STATIC
+UINT64
+LcdRectArea (
+  IN CONST LCD_RECT *Rect
+  )
+{
+  return (UINT64)(Rect->Right - Rect->Left) * (Rect->Bottom - Rect->Top);
+}
+
+STATIC
+VOID
+LcdRectUnion (
+  IN CONST LCD_RECT *A,
+  IN CONST LCD_RECT *B,
+  OUT LCD_RECT      *Union
+  )
+{
+  Union->Left   = MIN (A->Left, B->Left);
+  Union->Top    = MIN (A->Top, B->Top);
+  Union->Right  = MAX (A->Right, B->Right);
+  Union->Bottom = MAX (A->Bottom, B->Bottom);
+}
+
+VOID
+LcdAddDamage (
+  IN LCD_INSTANCE *Instance,
+  IN UINTN        X,
+  IN UINTN        Y,
+  IN UINTN        Width,
+  IN UINTN        Height
+  )
+{
+  LCD_RECT  Rect;
+  LCD_RECT  Union;
+  UINTN     Index;
+  UINTN     Best;
+  UINT64    Growth;
+  UINT64    BestGrowth;
+  UINT32    HorizontalResolution;
+  UINT32    VerticalResolution;
+
+  HorizontalResolution = Instance->ModeInfo.HorizontalResolution;
+  VerticalResolution = Instance->ModeInfo.VerticalResolution;
+
+  if (X >= HorizontalResolution || Y >= VerticalResolution || Width == 0 || Height == 0) {
+    return;
+  }
+
+  Rect.Left   = (UINT32)X;
+  Rect.Top    = (UINT32)Y;
+  Rect.Right  = (UINT32)(X + MIN (Width, HorizontalResolution - X));
+  Rect.Bottom = (UINT32)(Y + MIN (Height, VerticalResolution - Y));
+
+  // merge with everything it overlaps or lines up with. The union may now
+  // merge with rectangles checked before, so start over after each merge.
+  Index = 0;
+  while (Index < Instance->DamageCount) {
+    LcdRectUnion (&Instance->Damage[Index], &Rect, &Union);
+    if (3 * LcdRectArea (&Union) <= 4 * (LcdRectArea (&Instance->Damage[Index]) + LcdRectArea (&Rect))) {
+      Rect = Union;
+      Instance->Damage[Index] = Instance->Damage[--Instance->DamageCount];
+      Index = 0;
+    } else {
+      Index++;
+    }
+  }
+
+  if (Instance->DamageCount < LCD_DAMAGE_MAX_RECTS) {
+    Instance->Damage[Instance->DamageCount++] = Rect;
+    return;
+  }
+
+  // no room, grow the rectangle which grows the least
+  Best = 0;
+  BestGrowth = MAX_UINT64;
+  for (Index = 0; Index < Instance->DamageCount; Index++) {
+    LcdRectUnion (&Instance->Damage[Index], &Rect, &Union);
+    Growth = LcdRectArea (&Union) - LcdRectArea (&Instance->Damage[Index]);
+    if (Growth < BestGrowth) {
+      Best = Index;
+      BestGrowth = Growth;
+    }
+  }
+  LcdRectUnion (&Instance->Damage[Best], &Rect, &Instance->Damage[Best]);
+}
+
+BOOLEAN
+LcdGetDamageBounds (
+  IN  LCD_INSTANCE *Instance,
+  OUT LCD_RECT     *Bounds
+  )
+{
+  UINTN     Index;
+
+  if (Instance->DamageCount == 0) {
+    return FALSE;
+  }
+
+  *Bounds = Instance->Damage[0];
+  for (Index = 1; Index < Instance->DamageCount; Index++) {
+    LcdRectUnion (Bounds, &Instance->Damage[Index], Bounds);
+  }
+
+  return TRUE;
+}
@@ -83,10 +83,15 @@ LcdGraphicsBlt (
     ASSERT (FALSE);
   }
 
+  if (!EFI_ERROR(Status) && BltOperation!=EfiBltVideoToBltBuffer) {
+    LcdAddDamage (Instance, DestinationX, DestinationY, Width, Height);
+  }
+
   if(gDisplayNeedsFlush) {
     if (!EFI_ERROR(Status) && BltOperation!=EfiBltVideoToBltBuffer) {
       if (gLCDFlushMode==LK_DISPLAY_FLUSH_MODE_AUTO) {
-        Instance->LKDisplay.FlushScreen(&Instance->LKDisplay);
+        // only the damage, unlike the protocol's FlushScreen
+        LcdRequestFlush (Instance);
       }
     }
   }
@@ -22,8 +22,7 @@
 
 #include "LcdGraphicsOutputDxe.h"
 
-#define MS2100N(x) ((x)*(1000000/100))
-#define FPS2MS(x) (1000/(x))
+#define US2100N(x) ((x)*10)
 
 /**********************************************************************
  *
@@ -41,8 +40,24 @@ BOOLEAN gLcdNeedsSync = FALSE;
 BOOLEAN gDisplayNeedsFlush = FALSE;
 LK_DISPLAY_FLUSH_MODE gLCDFlushMode = LK_DISPLAY_FLUSH_MODE_AUTO;
 lkapi_t* LKApi = NULL;
+STATIC UINT32 mFlushRectAlign = 0;
+
+//
+// Frame pacing of the auto flush mode. Blt only marks the screen dirty, the
+// flush happens from mTimerEvent, a one-shot timer which only runs while
+// something is dirty. If LK signals when the panel is ready, that event
+// flushes once the interval is over and the timer only fires if LK doesn't
+// signal within another interval. All times are in microseconds.
+//
 EFI_EVENT mTimerEvent;
+STATIC EFI_EVENT mVsyncEvent = NULL;
+STATIC BOOLEAN mTimerArmed = FALSE;
+STATIC UINT64 mFrameInterval = 0;
 STATIC UINT64 mLastFlush = 0;
+STATIC UINT64 mFlushTime = 0;
+STATIC UINT64 mFlushCount = 0;
+STATIC UINT64 mSkippedFrames = 0;
+STATIC UINT64 mTotalFlushTime = 0;
 
 LCD_INSTANCE mLcdTemplate = {
   LCD_INSTANCE_SIGNATURE,
@@ -91,7 +106,9 @@ LCD_INSTANCE mLcdTemplate = {
     LKDisplayGetFlushMode,
     LKDisplayFlushScreen,
     LKDisplayGetPortraitMode,
-    LKDisplayGetLandscapeMode
+    LKDisplayGetLandscapeMode,
+    LKDisplayFlushScreenRect,
+    LKDisplayGetStats
   },
   (EFI_EVENT) NULL // ExitBootServicesEvent
 };
@@ -181,6 +198,36 @@ EXIT:
   return Status;
 }
 
+STATIC
+UINT64
+LcdFlushInterval (
+  VOID
+  )
+{
+  // leave at least half of the time to whoever draws
+  return MAX (mFrameInterval, 2 * mFlushTime);
+}
+
+STATIC
+VOID
+LcdArmFlushTimer (
+  VOID
+  )
+{
+  UINT64 Now;
+  UINT64 Due;
+
+  if (mTimerArmed)
+    return;
+
+  Now = GetTimeUs();
+  Due = mLastFlush + LcdFlushInterval();
+  if (mVsyncEvent != NULL)
+    Due += LcdFlushInterval();
+  gBS->SetTimer (mTimerEvent, TimerRelative, Due > Now ? US2100N(Due - Now) : 0);
+  mTimerArmed = TRUE;
+}
+
 VOID
 EFIAPI
 TimerCallback (
@@ -190,9 +237,23 @@ TimerCallback (
 {
   LCD_INSTANCE* Instance = Context;
 
-  if(gLcdNeedsSync && gLCDFlushMode==LK_DISPLAY_FLUSH_MODE_AUTO) {
-    Instance->LKDisplay.FlushScreen(&Instance->LKDisplay);
+  if (Event == mTimerEvent)
+    mTimerArmed = FALSE;
+
+  if(!gLcdNeedsSync || gLCDFlushMode!=LK_DISPLAY_FLUSH_MODE_AUTO) {
+    return;
+  }
+
+  // LK signals every frame, wait for the one the next flush is due in.
+  // Frames don't line up exactly with the interval, so allow some slack.
+  // LK may stop signaling, e.g. if it only does so after a flush, so the
+  // timer has to stay armed.
+  if (Event == mVsyncEvent && GetTimeUs() - mLastFlush < LcdFlushInterval() * 7 / 8) {
+    LcdArmFlushTimer();
+    return;
   }
+
+  LcdFlush (Instance);
 }
 
 EFI_STATUS
@@ -243,12 +304,31 @@ LcdGraphicsOutputDxeInitialize (
 
   gDisplayNeedsFlush = LKApi->lcd_needs_flush();
 
+  if (gDisplayNeedsFlush && LKAPI_HAS_MEMBER (lcd_flush_rect_align) &&
+      LKApi->lcd_flush_rect != NULL && LKApi->lcd_flush_rect_align != NULL) {
+    mFlushRectAlign = LKApi->lcd_flush_rect_align();
+    if ((mFlushRectAlign & (mFlushRectAlign - 1)) != 0) {
+      DEBUG((DEBUG_ERROR, "GraphicsOutputDxeInitialize: Invalid flush alignment %u, only doing full flushes\n", mFlushRectAlign));
+      mFlushRectAlign = 0;
+    }
+  }
+
   if (gDisplayNeedsFlush) {
+    mFrameInterval = MAX (1000000 / MAX (PcdGet32 (PcdLcdTargetFps), 1), 1000ULL * PcdGet32 (PcdLcdMinFlushInterval));
+
     Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK, TimerCallback, Instance, &mTimerEvent);
     ASSERT_EFI_ERROR (Status);
 
-    Status = gBS->SetTimer (mTimerEvent, TimerPeriodic, MS2100N(FPS2MS(30)));
-    ASSERT_EFI_ERROR (Status);
+    // let LK tell us when the panel can take the next flush
+    if (LKAPI_HAS_MEMBER (lcd_set_vsync_event) && LKApi->lcd_set_vsync_event != NULL) {
+      Status = gBS->CreateEvent (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, TimerCallback, Instance, &mVsyncEvent);
+      ASSERT_EFI_ERROR (Status);
+
+      if (LKApi->lcd_set_vsync_event(mVsyncEvent) != 0) {
+        gBS->CloseEvent (mVsyncEvent);
+        mVsyncEvent = NULL;
+      }
+    }
   }
 
   // To get here, everything must be fine, so just exit
@@ -285,6 +365,11 @@ LcdGraphicsExitBootServicesEvent (
   IN VOID       *Context
   )
 {
+  // the event goes away with the boot services
+  if (mVsyncEvent != NULL) {
+    LKApi->lcd_set_vsync_event(NULL);
+  }
+
   // By default, this PCD is FALSE. But if a platform starts a predefined OS that
   // does not use a framebuffer then we might want to disable the display controller
   // to avoid to display corrupted information on the screen.
@@ -386,6 +471,7 @@ LcdGraphicsSetMode (
   // Update the UEFI mode information
   This->Mode->Mode = ModeNumber;
   LcdPlatformQueryMode (ModeNumber,&Instance->ModeInfo);
+  LcdSelectCopyRow (Instance);
   This->Mode->FrameBufferSize =  Instance->ModeInfo.VerticalResolution
                                * Instance->ModeInfo.PixelsPerScanLine
                                * 4;
@@ -434,6 +520,8 @@ GetBytesPerPixel (
       return 3;
     case LKAPI_LCD_PIXELFORMAT_RGB565:
       return 2;
+    case LKAPI_LCD_PIXELFORMAT_XRGB8888:
+      return 4;
     default:
       return 0;
   }
@@ -461,7 +549,17 @@ LKDisplaySetFlushMode (
   IN LK_DISPLAY_FLUSH_MODE Mode
 )
 {
+  EFI_TPL      OldTpl;
+
   gLCDFlushMode = Mode;
+
+  // updates left over from before switching to manual
+  if (gDisplayNeedsFlush && Mode==LK_DISPLAY_FLUSH_MODE_AUTO) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    if (gLcdNeedsSync)
+      LcdArmFlushTimer();
+    gBS->RestoreTPL (OldTpl);
+  }
 }
 
 LK_DISPLAY_FLUSH_MODE
@@ -472,109 +570,190 @@ LKDisplayGetFlushMode (
   return gLCDFlushMode;
 }
 
+/**
+  Pushes the damaged part of the framebuffer to the panel.
+
+  Panels flush one window at a time, so this sends the bounding box of the
+  damage rounded out to what the panel supports, or the whole framebuffer
+  if the panel can't do partial flushes.
+**/
+STATIC
 VOID
-LcdCopy (
+LcdFlushDamage (
   IN LCD_INSTANCE *Instance
 )
 {
-  UINT32          SourcePixelX;
-  UINT32          DestinationPixelX;
-  UINT32          SourceLine;
-  UINT32          DestinationLine;
-  UINT8           *SourcePixel;
-  UINT8           *DestinationPixel;
-  UINTN           BytesPerPixel;
-  UINT32          HorizontalResolution;
-  UINT32          VerticalResolution;
-  UINT32          DestinationStride;
-  UINT32          Index;
-
-  UINT8* HWBuffer = (VOID*)(UINT32)Instance->FrameBufferBase;
-  UINT8* SWBuffer = (VOID*)(UINT32)Instance->Gop.Mode->FrameBufferBase;
-
-  BytesPerPixel = GetBytesPerPixel();
-  HorizontalResolution = Instance->ModeInfo.HorizontalResolution;
-  VerticalResolution = Instance->ModeInfo.VerticalResolution;
-
-  if (Instance->Gop.Mode->Mode == 0)
-    DestinationStride = HorizontalResolution;
-  else
-    DestinationStride = VerticalResolution;
-
-  // Access each pixel inside the BltBuffer Memory
-  for (SourceLine = 0; SourceLine < VerticalResolution; SourceLine++)
-  {
-    for (SourcePixelX = 0; SourcePixelX < HorizontalResolution; SourcePixelX++)
-    {
-      // RIGHT
-      //DestinationLine = HorizontalResolution-SourcePixelX;
-      //DestinationPixelX = SourceLine;
+  LCD_RECT        Bounds;
+  LCD_RECT        Panel;
+  UINT32          PanelWidth;
+  UINT32          PanelHeight;
 
-      if (Instance->Gop.Mode->Mode == 0) {
-        DestinationLine = SourceLine;
-        DestinationPixelX = SourcePixelX;
-      }
-      else {
-        // LEFT
-        DestinationLine = SourcePixelX;
-        DestinationPixelX = VerticalResolution-SourceLine;
-      }
+  if (mFlushRectAlign == 0 || !LcdGetDamageBounds (Instance, &Bounds)) {
+    LKApi->lcd_flush();
+    return;
+  }
+
+  // the panel is in its native orientation, map like LcdCopy does
+  if (Instance->Gop.Mode->Mode == 0) {
+    Panel = Bounds;
+    PanelWidth = Instance->ModeInfo.HorizontalResolution;
+    PanelHeight = Instance->ModeInfo.VerticalResolution;
+  }
+  else {
+    Panel.Left = Instance->ModeInfo.VerticalResolution - Bounds.Bottom;
+    Panel.Right = Instance->ModeInfo.VerticalResolution - Bounds.Top;
+    Panel.Top = Bounds.Left;
+    Panel.Bottom = Bounds.Right;
+    PanelWidth = Instance->ModeInfo.VerticalResolution;
+    PanelHeight = Instance->ModeInfo.HorizontalResolution;
+  }
 
-      // Calculate the source and target addresses:
-      SourcePixel      = SWBuffer + SourceLine      * HorizontalResolution * 4             + SourcePixelX      * 4;
-      DestinationPixel = HWBuffer + DestinationLine * DestinationStride    * BytesPerPixel + DestinationPixelX * BytesPerPixel;
+  Panel.Left &= ~(mFlushRectAlign - 1);
+  Panel.Top &= ~(mFlushRectAlign - 1);
+  Panel.Right = MIN (ALIGN_VALUE (Panel.Right, mFlushRectAlign), PanelWidth);
+  Panel.Bottom = MIN (ALIGN_VALUE (Panel.Bottom, mFlushRectAlign), PanelHeight);
 
-      // copy pixel
-      // TODO: check pixel format
-      for(Index = 0; Index<BytesPerPixel; Index++)
-        DestinationPixel[Index] = SourcePixel[Index];
-    }
+  if (Panel.Left == 0 && Panel.Top == 0 && Panel.Right == PanelWidth && Panel.Bottom == PanelHeight) {
+    LKApi->lcd_flush();
+    return;
   }
+
+  LKApi->lcd_flush_rect(Panel.Left, Panel.Top, Panel.Right - Panel.Left, Panel.Bottom - Panel.Top);
 }
 
 VOID
-LKDisplayFlushScreen (
-  IN EFI_LK_DISPLAY_PROTOCOL* This
+LcdFlush (
+  IN LCD_INSTANCE *Instance
 )
 {
 #ifdef DOUBLE_BUFFER
-  LCD_INSTANCE *Instance;
+  UINTN        Index;
 #endif
   EFI_TPL      OldTpl;
-  UINT64       Now = 0;
-  STATIC UINT64 RenderTime = 0;
+  UINT64       Start;
+  UINT64       Time;
 
-  if (!gDisplayNeedsFlush)
-    return;
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
 
-#ifdef DOUBLE_BUFFER
-  Instance = LCD_INSTANCE_FROM_LKDISPLAY_THIS(This);
-#endif
+  Start = GetTimeUs();
 
-  // limit flushes per second
-  if(gLCDFlushMode==LK_DISPLAY_FLUSH_MODE_AUTO) {
-    Now = GetTimeMs();
-    if (Now-mLastFlush<RenderTime) {
-      gLcdNeedsSync = TRUE;
-      return;
-    }
+  // Blt and FlushScreen record what changed, so there's damage unless
+  // something else cleared it. Flush everything then, to be safe.
+  if (Instance->DamageCount == 0) {
+    LcdAddDamage (Instance, 0, 0, Instance->ModeInfo.HorizontalResolution, Instance->ModeInfo.VerticalResolution);
   }
 
-  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
-
 #ifdef DOUBLE_BUFFER
-  // copy temporary to real framebuffer
-  LcdCopy(Instance);
+  // copy the damaged parts of the temporary to the real framebuffer
+  for (Index = 0; Index < Instance->DamageCount; Index++) {
+    LcdCopy (Instance, &Instance->Damage[Index]);
+  }
 #endif
 
   // trigger hw flush
-  LKApi->lcd_flush();
+  LcdFlushDamage (Instance);
+  Instance->DamageCount = 0;
+  gLcdNeedsSync = FALSE;
+
+  // nothing left for the fallback timer
+  if (mTimerArmed) {
+    gBS->SetTimer (mTimerEvent, TimerCancel, 0);
+    mTimerArmed = FALSE;
+  }
+
+  Time = GetTimeUs() - Start;
+  mLastFlush = Start;
+  mFlushTime = (3 * mFlushTime + Time) / 4;
+  mFlushCount++;
+  mTotalFlushTime += Time;
+
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Flushes the damage, right away in the manual flush mode or from the
+  flush timer in the auto mode.
+**/
+VOID
+LcdRequestFlush (
+  IN LCD_INSTANCE *Instance
+)
+{
+  EFI_TPL      OldTpl;
 
-  if(gLCDFlushMode==LK_DISPLAY_FLUSH_MODE_AUTO) {
-    mLastFlush = GetTimeMs();
-    RenderTime = mLastFlush - Now;
-    gLcdNeedsSync = FALSE;
+  if(gLCDFlushMode!=LK_DISPLAY_FLUSH_MODE_AUTO) {
+    LcdFlush (Instance);
+    return;
   }
 
+  // updates coming in before the pending flush happened share it
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (gLcdNeedsSync)
+    mSkippedFrames++;
+  gLcdNeedsSync = TRUE;
+  LcdArmFlushTimer();
+  gBS->RestoreTPL (OldTpl);
+}
+
+VOID
+LKDisplayFlushScreen (
+  IN EFI_LK_DISPLAY_PROTOCOL* This
+)
+{
+  LCD_INSTANCE *Instance;
+  EFI_TPL      OldTpl;
+
+  if (!gDisplayNeedsFlush)
+    return;
+
+  Instance = LCD_INSTANCE_FROM_LKDISPLAY_THIS(This);
+
+  // callers may have drawn straight into the framebuffer, which Blt
+  // doesn't know about, so this always pushes everything
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  LcdAddDamage (Instance, 0, 0, Instance->ModeInfo.HorizontalResolution, Instance->ModeInfo.VerticalResolution);
+  gBS->RestoreTPL (OldTpl);
+
+  LcdRequestFlush (Instance);
+}
+
+VOID
+LKDisplayFlushScreenRect (
+  IN EFI_LK_DISPLAY_PROTOCOL* This,
+  IN UINTN X,
+  IN UINTN Y,
+  IN UINTN Width,
+  IN UINTN Height
+)
+{
+  LCD_INSTANCE *Instance;
+  EFI_TPL      OldTpl;
+
+  if (!gDisplayNeedsFlush || Width == 0 || Height == 0)
+    return;
+
+  Instance = LCD_INSTANCE_FROM_LKDISPLAY_THIS(This);
+
+  // for callers drawing straight into the framebuffer, add the part they
+  // changed to what Blt recorded
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  LcdAddDamage (Instance, X, Y, Width, Height);
+  gBS->RestoreTPL (OldTpl);
+
+  LcdRequestFlush (Instance);
+}
+
+VOID
+LKDisplayGetStats (
+  IN  EFI_LK_DISPLAY_PROTOCOL* This,
+  OUT LK_DISPLAY_STATS* Stats
+)
+{
+  EFI_TPL      OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Stats->FlushCount = mFlushCount;
+  Stats->SkippedFrames = mSkippedFrames;
+  Stats->AverageCopyTime = mFlushCount == 0 ? 0 : mTotalFlushTime / mFlushCount;
   gBS->RestoreTPL (OldTpl);
 }
@@ -45,6 +45,32 @@ typedef struct {
   EFI_DEVICE_PATH_PROTOCOL      End;
 } LCD_GRAPHICS_DEVICE_PATH;
 
+//
+// Part of the screen, Right and Bottom are exclusive
+//
+typedef struct {
+  UINT32                                Left;
+  UINT32                                Top;
+  UINT32                                Right;
+  UINT32                                Bottom;
+} LCD_RECT;
+
+//
+// The damage since the last flush is kept as up to this many rectangles
+//
+#define LCD_DAMAGE_MAX_RECTS  8
+
+//
+// Converts a row of the shadow framebuffer to the panel's pixel format
+//
+typedef
+VOID
+(EFIAPI *LCD_COPY_ROW) (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  );
+
 typedef struct {
   UINT32                                Signature;
   EFI_HANDLE                            Handle;
@@ -55,6 +81,9 @@ typedef struct {
   EFI_LK_DISPLAY_PROTOCOL               LKDisplay;
   EFI_EVENT                             ExitBootServicesEvent;
   EFI_PHYSICAL_ADDRESS                  FrameBufferBase;
+  LCD_RECT                              Damage[LCD_DAMAGE_MAX_RECTS];
+  UINTN                                 DamageCount;
+  LCD_COPY_ROW                          CopyRow;
 } LCD_INSTANCE;
 
 #define LCD_INSTANCE_SIGNATURE  SIGNATURE_32('l', 'c', 'd', '0')
@@ -161,6 +190,31 @@ LKDisplayFlushScreen (
   IN EFI_LK_DISPLAY_PROTOCOL* This
 );
 
+VOID
+LKDisplayGetStats (
+  IN  EFI_LK_DISPLAY_PROTOCOL* This,
+  OUT LK_DISPLAY_STATS* Stats
+);
+
+VOID
+LcdFlush (
+  IN LCD_INSTANCE *Instance
+);
+
+VOID
+LcdRequestFlush (
+  IN LCD_INSTANCE *Instance
+);
+
+VOID
+LKDisplayFlushScreenRect (
+  IN EFI_LK_DISPLAY_PROTOCOL* This,
+  IN UINTN X,
+  IN UINTN Y,
+  IN UINTN Width,
+  IN UINTN Height
+);
+
 UINT32
 LKDisplayGetPortraitMode (
   VOID
@@ -176,6 +230,32 @@ LcdGetPixelFormat (
   VOID
   );
 
+VOID
+LcdAddDamage (
+  IN LCD_INSTANCE *Instance,
+  IN UINTN        X,
+  IN UINTN        Y,
+  IN UINTN        Width,
+  IN UINTN        Height
+);
+
+BOOLEAN
+LcdGetDamageBounds (
+  IN  LCD_INSTANCE *Instance,
+  OUT LCD_RECT     *Bounds
+);
+
+VOID
+LcdSelectCopyRow (
+  IN LCD_INSTANCE *Instance
+);
+
+VOID
+LcdCopy (
+  IN LCD_INSTANCE   *Instance,
+  IN CONST LCD_RECT *Rect
+);
+
 STATIC inline
 UINT64
 GetTimeMs (
@@ -185,4 +265,13 @@ GetTimeMs (
   return GetTimeInNanoSecond(GetPerformanceCounter()) / 1000000ULL;
 }
 
+STATIC inline
+UINT64
+GetTimeUs (
+  VOID
+)
+{
+  return GetTimeInNanoSecond(GetPerformanceCounter()) / 1000ULL;
+}
+
 #endif /* __ARM_VE_GRAPHICS_DXE_H__ */
@@ -187,6 +187,10 @@ LcdPlatformQueryMode (
       Info->PixelInformation.ReservedMask = 0;
       break;
 
+    case LKAPI_LCD_PIXELFORMAT_XRGB8888:
+      Info->PixelFormat = PixelBlueGreenRedReserved8BitPerColor;
+      break;
+
     default:
       ASSERT(FALSE);
   }
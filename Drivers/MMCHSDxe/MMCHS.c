@@ -29,13 +29,25 @@ BIO_INSTANCE mBioTemplate = {
   BIO_INSTANCE_SIGNATURE,
   NULL, // Handle
   { // BlockIo
-    EFI_BLOCK_IO_INTERFACE_REVISION,   // Revision
+    EFI_BLOCK_IO_PROTOCOL_REVISION3,   // Revision
     NULL,                              // *Media
     MMCHSReset,                        // Reset
     MMCHSReadBlocks,                   // ReadBlocks
     MMCHSWriteBlocks,                  // WriteBlocks
     MMCHSFlushBlocks                   // FlushBlocks
   },
+  { // BlockIo2
+    NULL,                              // *Media
+    MMCHSResetEx,                      // Reset
+    MMCHSReadBlocksEx,                 // ReadBlocksEx
+    MMCHSWriteBlocksEx,                // WriteBlocksEx
+    MMCHSFlushBlocksEx                 // FlushBlocksEx
+  },
+  { // EraseBlock
+    EFI_ERASE_BLOCK_PROTOCOL_REVISION, // Revision
+    1,                                 // EraseLengthGranularity
+    MMCHSEraseBlocks                   // EraseBlocks
+  },
   { // BlockMedia
     BIO_INSTANCE_SIGNATURE,                   // MediaId
     FALSE,                                    // RemovableMedia
@@ -46,7 +58,10 @@ BIO_INSTANCE mBioTemplate = {
     0,                                        // BlockSize
     4,                                        // IoAlign
     0,                                        // Pad
-    0                                         // LastBlock
+    0,                                        // LastBlock
+    0,                                        // LowestAlignedLba
+    1,                                        // LogicalBlocksPerPhysicalBlock
+    1                                         // OptimalTransferLengthGranularity
   },
   { // DevicePath
    {
@@ -69,12 +84,339 @@ BIO_INSTANCE mBioTemplate = {
     0,                           // type
     0,                           // block_size
     0,                           // num_blocks
+    NULL,                        // api_pdata
     NULL,                        // init
     NULL,                        // read
     NULL,                        // write
-  }
+    NULL,                        // submit
+    NULL,                        // complete
+    NULL,                        // readv
+    NULL,                        // writev
+    NULL,                        // erase
+    0,                           // erase_granularity
+    0,                           // dma_alignment
+    0,                           // dma_addr_limit
+    NULL,                        // partition_list
+  },
+  EFI_NOT_STARTED, // InitStatus
+  { NULL, NULL }, // PendingRequests
+  { 0 },          // ReadAhead
+  { 0 },          // Cache
+  { { NULL, FALSE } }, // BounceBuffers
+  0,              // BounceBufferSize
+  NULL,           // ExitBootServicesEvent
+  NULL,           // ResetNotifyEvent
+  NULL,           // ResetNotifyRegistration
+  { { 0 } },      // Stats
+  { NULL, NULL }, // StatsProtocol
+  { 0 },          // Trace
+  { NULL, NULL, NULL } // TraceProtocol
 };
 
+/**
+  Initializes the LK device if that didn't happen yet.
+
+  Devices get initialized on their first access, so the ones the boot path
+  never touches don't cost any boot time.
+
+  @param  Instance     The device instance.
+
+  @retval EFI_SUCCESS           The device is ready.
+  @retval EFI_DEVICE_ERROR      The device could not be initialized.
+
+**/
+EFI_STATUS
+MMCHSDeviceInit (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  UINT64                     StartTime;
+  UINT64                     EndTime;
+  INTN                       Result;
+
+  if (Instance->InitStatus != EFI_NOT_STARTED) {
+    return Instance->InitStatus;
+  }
+
+  StartTime = GetPerformanceCounter ();
+  Result = Instance->LKDev.init(&Instance->LKDev);
+  EndTime = GetPerformanceCounter ();
+
+  DEBUG ((DEBUG_INFO, "MMCHS: device %d: init took %Lu us\n",
+    Instance->LKDev.id, DivU64x32 (GetTimeInNanoSecond (EndTime - StartTime), 1000)));
+
+  if (Result) {
+    Instance->InitStatus = EFI_DEVICE_ERROR;
+    return Instance->InitStatus;
+  }
+
+  // the media got published with the geometry LK reported before init
+  if (Instance->BlockMedia.BlockSize != 0 &&
+      (Instance->BlockMedia.BlockSize != Instance->LKDev.block_size ||
+       Instance->BlockMedia.LastBlock != Instance->LKDev.num_blocks - 1)) {
+    DEBUG ((DEBUG_ERROR, "MMCHS: device %d: geometry changed during init\n", Instance->LKDev.id));
+    Instance->InitStatus = EFI_DEVICE_ERROR;
+    return Instance->InitStatus;
+  }
+
+  Instance->InitStatus = EFI_SUCCESS;
+  return Instance->InitStatus;
+}
+
+/**
+  Reads blocks from the LK device, bypassing all caching.
+
+  @param  Instance     The device instance.
+  @param  Lba          The starting Logical Block Address to read from.
+  @param  BufferSize   Size of Buffer, a multiple of the device block size.
+  @param  Buffer       A pointer to the destination buffer for the data.
+
+  @retval EFI_SUCCESS           The data was read correctly from the device.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing the read.
+
+**/
+EFI_STATUS
+MMCHSDeviceRead (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  UINT8                      *Bounce;
+  UINTN                      Chunk;
+  UINTN                      TransferSize;
+  UINT64                     StartTicks;
+
+  Status = MMCHSDeviceInit (Instance);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  StartTicks = 0;
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    StartTicks = GetPerformanceCounter ();
+  }
+  TransferSize = BufferSize;
+
+  Bounce = NULL;
+  if (!MMCHSDmaBufferOk (Instance, Buffer, BufferSize)) {
+    Bounce = MMCHSBounceBufferGet (Instance);
+  }
+
+  if (Bounce == NULL) {
+    Status = Instance->LKDev.read(&Instance->LKDev, Lba, BufferSize, Buffer)==0?EFI_SUCCESS:EFI_DEVICE_ERROR;
+  } else {
+    while (BufferSize > 0) {
+      Chunk = MIN (BufferSize, Instance->BounceBufferSize);
+      if (Instance->LKDev.read(&Instance->LKDev, Lba, Chunk, Bounce)) {
+        Status = EFI_DEVICE_ERROR;
+        break;
+      }
+      CopyMem (Buffer, Bounce, Chunk);
+
+      Lba        += Chunk / Instance->BlockMedia.BlockSize;
+      Buffer      = (UINT8*)Buffer + Chunk;
+      BufferSize -= Chunk;
+    }
+
+    MMCHSBounceBufferPut (Instance, Bounce);
+  }
+
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    MMCHSStatsRecord (&Instance->Stats.DeviceRead, StartTicks, TransferSize, Status);
+  }
+
+  return Status;
+}
+
+/**
+  Writes blocks to the LK device, bypassing all caching.
+
+  @param  Instance     The device instance.
+  @param  Lba          The starting logical block address to be written.
+  @param  BufferSize   Size of Buffer, a multiple of the device block size.
+  @param  Buffer       A pointer to the source buffer for the data.
+
+  @retval EFI_SUCCESS           The data was written correctly to the device.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing the write.
+
+**/
+EFI_STATUS
+MMCHSDeviceWrite (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  UINT8                      *Bounce;
+  UINTN                      Chunk;
+  UINTN                      TransferSize;
+  UINT64                     StartTicks;
+
+  Status = MMCHSDeviceInit (Instance);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  StartTicks = 0;
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    StartTicks = GetPerformanceCounter ();
+  }
+  TransferSize = BufferSize;
+
+  Bounce = NULL;
+  if (!MMCHSDmaBufferOk (Instance, Buffer, BufferSize)) {
+    Bounce = MMCHSBounceBufferGet (Instance);
+  }
+
+  if (Bounce == NULL) {
+    Status = Instance->LKDev.write(&Instance->LKDev, Lba, BufferSize, Buffer)==0?EFI_SUCCESS:EFI_DEVICE_ERROR;
+  } else {
+    while (BufferSize > 0) {
+      Chunk = MIN (BufferSize, Instance->BounceBufferSize);
+      CopyMem (Bounce, Buffer, Chunk);
+      if (Instance->LKDev.write(&Instance->LKDev, Lba, Chunk, Bounce)) {
+        Status = EFI_DEVICE_ERROR;
+        break;
+      }
+
+      Lba        += Chunk / Instance->BlockMedia.BlockSize;
+      Buffer      = (UINT8*)Buffer + Chunk;
+      BufferSize -= Chunk;
+    }
+
+    MMCHSBounceBufferPut (Instance, Bounce);
+  }
+
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    MMCHSStatsRecord (&Instance->Stats.DeviceWrite, StartTicks, TransferSize, Status);
+  }
+
+  return Status;
+}
+
+/**
+  Writes several runs of blocks to the LK device, bypassing all caching.
+
+  The segments are handed to LK in one call if it supports vectored writes,
+  otherwise they get written one by one.
+
+  @param  Instance     The device instance.
+  @param  Segments     The runs of blocks to write.
+  @param  Count        The number of entries in Segments.
+
+  @retval EFI_SUCCESS           The data was written correctly to the device.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing the write.
+
+**/
+EFI_STATUS
+MMCHSDeviceWriteV (
+  IN BIO_INSTANCE                   *Instance,
+  IN lkapi_biodev_segment_t         *Segments,
+  IN UINTN                          Count
+  )
+{
+  EFI_STATUS                 Status;
+  UINTN                      Index;
+  UINTN                      TransferSize;
+  UINT64                     StartTicks;
+
+  if (Count == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Status = MMCHSDeviceInit (Instance);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Count > 1 && Instance->LKDev.writev != NULL) {
+    StartTicks = 0;
+    if (FeaturePcdGet (PcdMMCHSStatistics)) {
+      StartTicks = GetPerformanceCounter ();
+    }
+
+    Status = Instance->LKDev.writev(&Instance->LKDev, Segments, Count)==0?EFI_SUCCESS:EFI_DEVICE_ERROR;
+
+    if (FeaturePcdGet (PcdMMCHSStatistics)) {
+      TransferSize = 0;
+      for (Index = 0; Index < Count; Index++) {
+        TransferSize += Segments[Index].num_blocks * Instance->BlockMedia.BlockSize;
+      }
+      MMCHSStatsRecord (&Instance->Stats.DeviceWrite, StartTicks, TransferSize, Status);
+    }
+
+    return Status;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    Status = MMCHSDeviceWrite (
+               Instance,
+               Segments[Index].lba,
+               Segments[Index].num_blocks * Instance->BlockMedia.BlockSize,
+               Segments[Index].buffer
+               );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Checks a ReadBlocks/WriteBlocks request against the media.
+
+  @retval EFI_SUCCESS           The request is valid and BufferSize is not 0.
+  @retval EFI_MEDIA_CHANGED     The MediaId does not matched the current device.
+  @retval EFI_BAD_BUFFER_SIZE   The Buffer was not a multiple of the block size of the device.
+  @retval EFI_INVALID_PARAMETER The request contains LBAs that are not valid,
+                                or the buffer is NULL.
+
+**/
+STATIC
+EFI_STATUS
+MMCHSValidateRequest (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINT32                         MediaId,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  )
+{
+  EFI_BLOCK_IO_MEDIA        *Media;
+  UINTN                      BlockSize;
+
+  Media     = &Instance->BlockMedia;
+  BlockSize = Media->BlockSize;
+
+  if (MediaId != Media->MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if (Lba > Media->LastBlock) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if ((Lba + (BufferSize / BlockSize) - 1) > Media->LastBlock) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (BufferSize % BlockSize != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  if (Buffer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
 
   Reset the Block Device.
@@ -103,7 +445,11 @@ MMCHSReset (
   IN BOOLEAN                        ExtendedVerification
   )
 {
-  return EFI_SUCCESS;
+  BIO_INSTANCE              *Instance;
+
+  Instance = BIO_INSTANCE_FROM_GOP_THIS(This);
+
+  return MMCHSBlockCacheFlush (Instance, 0, MAX_UINTN);
 }
 
 
@@ -155,38 +501,39 @@ MMCHSReadBlocks (
   )
 {
   BIO_INSTANCE              *Instance;
-  EFI_BLOCK_IO_MEDIA        *Media;
-  UINTN                      BlockSize;
+  EFI_STATUS                 Status;
+  UINT64                     StartTicks;
 
   Instance = BIO_INSTANCE_FROM_GOP_THIS(This);
-  Media     = &Instance->BlockMedia;
-  BlockSize = Media->BlockSize;
 
-  if (MediaId != Media->MediaId) {
-    return EFI_MEDIA_CHANGED;
+  Status = MMCHSValidateRequest (Instance, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
-  if (Lba > Media->LastBlock) {
-    return EFI_INVALID_PARAMETER;
+  if (BufferSize == 0) {
+    return EFI_SUCCESS;
   }
 
-  if ((Lba + (BufferSize / BlockSize) - 1) > Media->LastBlock) {
-    return EFI_INVALID_PARAMETER;
+  if (FeaturePcdGet (PcdMMCHSTrace)) {
+    MMCHSTraceRecord (Instance, LK_BLOCK_IO_TRACE_READ, Lba, BufferSize);
   }
 
-  if (BufferSize % BlockSize != 0) {
-    return EFI_BAD_BUFFER_SIZE;
+  StartTicks = 0;
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    StartTicks = GetPerformanceCounter ();
   }
 
-  if (Buffer == NULL) {
-    return EFI_INVALID_PARAMETER;
+  Status = MMCHSReadAheadRead (Instance, Lba, BufferSize, Buffer);
+  if (!EFI_ERROR (Status)) {
+    MMCHSBlockCachePatchRead (Instance, Lba, BufferSize, Buffer);
   }
 
-  if (BufferSize == 0) {
-    return EFI_SUCCESS;
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    MMCHSStatsRecord (&Instance->Stats.Read, StartTicks, BufferSize, Status);
   }
 
-  return Instance->LKDev.read(&Instance->LKDev, Lba, BufferSize, Buffer)==0?EFI_SUCCESS:EFI_DEVICE_ERROR;
+  return Status;
 }
 
 
@@ -240,38 +587,38 @@ MMCHSWriteBlocks (
   )
 {
   BIO_INSTANCE              *Instance;
-  EFI_BLOCK_IO_MEDIA        *Media;
-  UINTN                      BlockSize;
+  EFI_STATUS                 Status;
+  UINT64                     StartTicks;
 
   Instance = BIO_INSTANCE_FROM_GOP_THIS(This);
-  Media     = &Instance->BlockMedia;
-  BlockSize = Media->BlockSize;
 
-  if (MediaId != Media->MediaId) {
-    return EFI_MEDIA_CHANGED;
+  Status = MMCHSValidateRequest (Instance, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
-  if (Lba > Media->LastBlock) {
-    return EFI_INVALID_PARAMETER;
+  if (BufferSize == 0) {
+    return EFI_SUCCESS;
   }
 
-  if ((Lba + (BufferSize / BlockSize) - 1) > Media->LastBlock) {
-    return EFI_INVALID_PARAMETER;
+  if (FeaturePcdGet (PcdMMCHSTrace)) {
+    MMCHSTraceRecord (Instance, LK_BLOCK_IO_TRACE_WRITE, Lba, BufferSize);
   }
 
-  if (BufferSize % BlockSize != 0) {
-    return EFI_BAD_BUFFER_SIZE;
+  StartTicks = 0;
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    StartTicks = GetPerformanceCounter ();
   }
 
-  if (Buffer == NULL) {
-    return EFI_INVALID_PARAMETER;
-  }
+  MMCHSReadAheadInvalidate (Instance, Lba, BufferSize / Instance->BlockMedia.BlockSize);
 
-  if (BufferSize == 0) {
-    return EFI_SUCCESS;
+  Status = MMCHSBlockCacheWrite (Instance, Lba, BufferSize, Buffer);
+
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    MMCHSStatsRecord (&Instance->Stats.Write, StartTicks, BufferSize, Status);
   }
 
-  return Instance->LKDev.write(&Instance->LKDev, Lba, BufferSize, Buffer)==0?EFI_SUCCESS:EFI_DEVICE_ERROR;
+  return Status;
 }
 
 
@@ -300,7 +647,492 @@ MMCHSFlushBlocks (
   IN EFI_BLOCK_IO_PROTOCOL  *This
   )
 {
-  return EFI_SUCCESS;
+  BIO_INSTANCE              *Instance;
+
+  Instance = BIO_INSTANCE_FROM_GOP_THIS(This);
+
+  return MMCHSBlockCacheFlush (Instance, 0, MAX_UINTN);
+}
+
+
+/**
+  Finishes an asynchronous request: collects the result from LK, reports it
+  through the caller's token and releases the request.
+
+  Must be called at TPL_CALLBACK or higher.
+
+  @param  Request   The request to finish.
+
+**/
+STATIC
+VOID
+MMCHSFinishAsyncRequest (
+  IN BIO_ASYNC_REQUEST              *Request
+  )
+{
+  BIO_INSTANCE              *Instance;
+  INTN                       Result;
+
+  Instance = Request->Instance;
+
+  Result = Instance->LKDev.complete(&Instance->LKDev, &Request->LKRequest);
+  Request->Token->TransactionStatus = Result==0?EFI_SUCCESS:EFI_DEVICE_ERROR;
+
+  // a sequential read while the write was in flight may have prefetched
+  // the old data
+  if (Request->LKRequest.type == LKAPI_BIODEV_REQUEST_WRITE) {
+    MMCHSReadAheadInvalidate (Instance, Request->LKRequest.lba, Request->LKRequest.buffersize / Instance->BlockMedia.BlockSize);
+  }
+
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    // the request went straight to LK, so it counts on both levels
+    if (Request->LKRequest.type == LKAPI_BIODEV_REQUEST_READ) {
+      MMCHSStatsRecord (&Instance->Stats.Read, Request->StartTicks, Request->LKRequest.buffersize, Request->Token->TransactionStatus);
+      MMCHSStatsRecord (&Instance->Stats.DeviceRead, Request->StartTicks, Request->LKRequest.buffersize, Request->Token->TransactionStatus);
+    } else {
+      MMCHSStatsRecord (&Instance->Stats.Write, Request->StartTicks, Request->LKRequest.buffersize, Request->Token->TransactionStatus);
+      MMCHSStatsRecord (&Instance->Stats.DeviceWrite, Request->StartTicks, Request->LKRequest.buffersize, Request->Token->TransactionStatus);
+    }
+    Instance->Stats.QueueDepth--;
+  }
+
+  if (Request->BounceBuffer != NULL) {
+    if (Result == 0 && Request->LKRequest.type == LKAPI_BIODEV_REQUEST_READ) {
+      CopyMem (Request->CallerBuffer, Request->BounceBuffer, Request->LKRequest.buffersize);
+    }
+    MMCHSBounceBufferPut (Instance, Request->BounceBuffer);
+  }
+
+  RemoveEntryList (&Request->Link);
+  gBS->CloseEvent (Request->Event);
+  gBS->SignalEvent (Request->Token->Event);
+
+  Request->Signature = 0;
+  FreePool (Request);
+}
+
+/**
+  Notification function of the event LK signals when a request is done.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      The BIO_ASYNC_REQUEST which finished.
+
+**/
+STATIC
+VOID
+EFIAPI
+MMCHSAsyncRequestDone (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  MMCHSFinishAsyncRequest ((BIO_ASYNC_REQUEST*)Context);
+}
+
+/**
+  Waits for all requests of an instance which were submitted to LK.
+
+  @param  Instance     The device instance.
+
+**/
+STATIC
+VOID
+MMCHSDrainAsyncRequests (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  EFI_TPL                    OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  while (!IsListEmpty (&Instance->PendingRequests)) {
+    MMCHSFinishAsyncRequest (BIO_ASYNC_REQUEST_FROM_LINK (GetFirstNode (&Instance->PendingRequests)));
+  }
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Hands a request to LK without waiting for it to finish. Falls back to a
+  blocking transfer if LK does not support asynchronous requests.
+
+  @param  Instance   The device instance.
+  @param  Type       LKAPI_BIODEV_REQUEST_READ or LKAPI_BIODEV_REQUEST_WRITE.
+  @param  Lba        The starting logical block address.
+  @param  Token      The caller's token. Token->Event must not be NULL.
+  @param  BufferSize Size of Buffer.
+  @param  Buffer     The data buffer.
+
+  @retval EFI_SUCCESS           The request was queued (or executed).
+  @retval EFI_OUT_OF_RESOURCES  The request could not be queued.
+  @retval EFI_DEVICE_ERROR      LK rejected the request.
+
+**/
+STATIC
+EFI_STATUS
+MMCHSSubmitAsyncRequest (
+  IN     BIO_INSTANCE               *Instance,
+  IN     UINT32                     Type,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  IN     VOID                       *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  BIO_ASYNC_REQUEST          *Request;
+  EFI_TPL                    OldTpl;
+
+  if (Instance->LKDev.submit == NULL || Instance->LKDev.complete == NULL) {
+    if (Type == LKAPI_BIODEV_REQUEST_READ) {
+      Status = MMCHSReadBlocks (&Instance->BlockIo, Instance->BlockMedia.MediaId, Lba, BufferSize, Buffer);
+    } else {
+      Status = MMCHSWriteBlocks (&Instance->BlockIo, Instance->BlockMedia.MediaId, Lba, BufferSize, Buffer);
+    }
+    Token->TransactionStatus = Status;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  Status = MMCHSDeviceInit (Instance);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (FeaturePcdGet (PcdMMCHSTrace)) {
+    MMCHSTraceRecord (
+      Instance,
+      Type == LKAPI_BIODEV_REQUEST_READ ? LK_BLOCK_IO_TRACE_READ : LK_BLOCK_IO_TRACE_WRITE,
+      Lba,
+      BufferSize
+      );
+  }
+
+  Request = AllocateZeroPool (sizeof (BIO_ASYNC_REQUEST));
+  if (Request == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = gBS->CreateEvent (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, MMCHSAsyncRequestDone, Request, &Request->Event);
+  if (EFI_ERROR (Status)) {
+    FreePool (Request);
+    return Status;
+  }
+
+  // LK can't DMA into this buffer, give it one it can use without copying
+  Request->CallerBuffer = Buffer;
+  if (!MMCHSDmaBufferOk (Instance, Buffer, BufferSize) && BufferSize <= Instance->BounceBufferSize) {
+    Request->BounceBuffer = MMCHSBounceBufferGet (Instance);
+    if (Request->BounceBuffer != NULL) {
+      if (Type == LKAPI_BIODEV_REQUEST_WRITE) {
+        CopyMem (Request->BounceBuffer, Buffer, BufferSize);
+      }
+      Buffer = Request->BounceBuffer;
+    }
+  }
+
+  Request->Signature            = BIO_ASYNC_REQUEST_SIGNATURE;
+  Request->Instance             = Instance;
+  Request->Token                = Token;
+  Request->LKRequest.type       = Type;
+  Request->LKRequest.lba        = Lba;
+  Request->LKRequest.buffersize = BufferSize;
+  Request->LKRequest.buffer     = Buffer;
+  Request->LKRequest.event      = Request->Event;
+
+  if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    Request->StartTicks = GetPerformanceCounter ();
+  }
+
+  // don't let the completion run before the request is on the list
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  InsertTailList (&Instance->PendingRequests, &Request->Link);
+  if (Instance->LKDev.submit(&Instance->LKDev, &Request->LKRequest)) {
+    RemoveEntryList (&Request->Link);
+    gBS->CloseEvent (Request->Event);
+    if (Request->BounceBuffer != NULL) {
+      MMCHSBounceBufferPut (Instance, Request->BounceBuffer);
+    }
+    FreePool (Request);
+    Status = EFI_DEVICE_ERROR;
+  } else if (FeaturePcdGet (PcdMMCHSStatistics)) {
+    Instance->Stats.QueueDepth++;
+    Instance->Stats.MaxQueueDepth = MAX (Instance->Stats.MaxQueueDepth, Instance->Stats.QueueDepth);
+  }
+
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+/**
+  Reset the block device hardware.
+
+  @param[in]  This                 Indicates a pointer to the calling context.
+  @param[in]  ExtendedVerification Indicates that the driver may perform a more
+                                   exhausive verfication operation of the device
+                                   during reset.
+
+  @retval EFI_SUCCESS          The device was reset.
+  @retval EFI_DEVICE_ERROR     The device is not functioning properly and could
+                               not be reset.
+
+**/
+EFI_STATUS
+EFIAPI
+MMCHSResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL         *This,
+  IN BOOLEAN                        ExtendedVerification
+  )
+{
+  BIO_INSTANCE              *Instance;
+
+  Instance = BIO_INSTANCE_FROM_BLOCKIO2_THIS(This);
+
+  MMCHSDrainAsyncRequests (Instance);
+
+  return MMCHSReset (&Instance->BlockIo, ExtendedVerification);
+}
+
+/**
+  Read BufferSize bytes from Lba into Buffer.
+
+  If Token is NULL or Token->Event is NULL the read is blocking. Otherwise the
+  request is handed to LK and Token->Event gets signaled once it finished.
+
+  @param[in]       This       Indicates a pointer to the calling context.
+  @param[in]       MediaId    Id of the media, changes every time the media is
+                              replaced.
+  @param[in]       Lba        The starting Logical Block Address to read from.
+  @param[in, out]  Token      A pointer to the token associated with the transaction.
+  @param[in]       BufferSize Size of Buffer, must be a multiple of device block size.
+  @param[out]      Buffer     A pointer to the destination buffer for the data.
+
+  @retval EFI_SUCCESS           The read request was queued if Token->Event is
+                                not NULL.The data was read correctly from the
+                                device if the Token->Event is NULL.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing
+                                the read.
+  @retval EFI_MEDIA_CHANGED     The MediaId is not for the current media.
+  @retval EFI_BAD_BUFFER_SIZE   The BufferSize parameter is not a multiple of the
+                                intrinsic block size of the device.
+  @retval EFI_INVALID_PARAMETER The read request contains LBAs that are not valid,
+                                or the buffer is not on proper alignment.
+  @retval EFI_OUT_OF_RESOURCES  The request could not be completed due to a lack
+                                of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MMCHSReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  OUT    VOID                       *Buffer
+  )
+{
+  BIO_INSTANCE              *Instance;
+  EFI_STATUS                 Status;
+
+  Instance = BIO_INSTANCE_FROM_BLOCKIO2_THIS(This);
+
+  if (Token == NULL || Token->Event == NULL) {
+    return MMCHSReadBlocks (&Instance->BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  Status = MMCHSValidateRequest (Instance, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (BufferSize == 0) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  // LK reads from the device, so it has to see the cached data
+  Status = MMCHSBlockCacheFlush (Instance, Lba, BufferSize / Instance->BlockMedia.BlockSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return MMCHSSubmitAsyncRequest (Instance, LKAPI_BIODEV_REQUEST_READ, Lba, Token, BufferSize, Buffer);
+}
+
+/**
+  Write BufferSize bytes from Buffer to Lba.
+
+  If Token is NULL or Token->Event is NULL the write is blocking. Otherwise the
+  request is handed to LK and Token->Event gets signaled once it finished.
+
+  @param[in]       This       Indicates a pointer to the calling context.
+  @param[in]       MediaId    The media ID that the write request is for.
+  @param[in]       Lba        The starting logical block address to be written.
+  @param[in, out]  Token      A pointer to the token associated with the transaction.
+  @param[in]       BufferSize Size of Buffer, must be a multiple of device block size.
+  @param[in]       Buffer     A pointer to the source buffer for the data.
+
+  @retval EFI_SUCCESS           The write request was queued if Event is not NULL.
+                                The data was written correctly to the device if
+                                the Event is NULL.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing
+                                the write.
+  @retval EFI_MEDIA_CHANGED     The MediaId is not for the current media.
+  @retval EFI_BAD_BUFFER_SIZE   The BufferSize parameter is not a multiple of the
+                                intrinsic block size of the device.
+  @retval EFI_INVALID_PARAMETER The write request contains LBAs that are not valid,
+                                or the buffer is not on proper alignment.
+  @retval EFI_OUT_OF_RESOURCES  The request could not be completed due to a lack
+                                of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MMCHSWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  IN     VOID                       *Buffer
+  )
+{
+  BIO_INSTANCE              *Instance;
+  EFI_STATUS                 Status;
+
+  Instance = BIO_INSTANCE_FROM_BLOCKIO2_THIS(This);
+
+  if (Token == NULL || Token->Event == NULL) {
+    return MMCHSWriteBlocks (&Instance->BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  Status = MMCHSValidateRequest (Instance, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (BufferSize == 0) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  MMCHSReadAheadInvalidate (Instance, Lba, BufferSize / Instance->BlockMedia.BlockSize);
+  MMCHSBlockCacheDiscard (Instance, Lba, BufferSize / Instance->BlockMedia.BlockSize);
+
+  return MMCHSSubmitAsyncRequest (Instance, LKAPI_BIODEV_REQUEST_WRITE, Lba, Token, BufferSize, Buffer);
+}
+
+/**
+  Flush the Block Device.
+
+  Waits for all requests which were queued before.
+
+  @param[in]      This     Indicates a pointer to the calling context.
+  @param[in, out] Token    A pointer to the token associated with the transaction.
+
+  @retval EFI_SUCCESS          All outstanding data was written correctly to the
+                               device.
+  @retval EFI_DEVICE_ERROR     The device reported an error while writing back
+                               the data.
+
+**/
+EFI_STATUS
+EFIAPI
+MMCHSFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token
+  )
+{
+  BIO_INSTANCE              *Instance;
+  EFI_STATUS                 Status;
+
+  Instance = BIO_INSTANCE_FROM_BLOCKIO2_THIS(This);
+
+  MMCHSDrainAsyncRequests (Instance);
+
+  Status = MMCHSFlushBlocks (&Instance->BlockIo);
+
+  if (Token != NULL && Token->Event != NULL) {
+    Token->TransactionStatus = Status;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  return Status;
+}
+
+/**
+  Erase a specified number of device blocks.
+
+  The blocks are discarded by LK, which is much faster than overwriting them.
+  Ranges aligned to EraseLengthGranularity get erased fastest.
+
+  @param[in]       This           Indicates a pointer to the calling context.
+  @param[in]       MediaId        The media ID that the erase request is for.
+  @param[in]       Lba            The starting logical block address to be
+                                  erased.
+  @param[in, out]  Token          A pointer to the token associated with the
+                                  transaction.
+  @param[in]       Size           The size in bytes to be erased. This must be
+                                  a multiple of the physical block size of the
+                                  device.
+
+  @retval EFI_SUCCESS             The erase request was queued if Event is not
+                                  NULL. The data was erased correctly to the
+                                  device if the Event is NULL.
+  @retval EFI_DEVICE_ERROR        The device reported an error while attempting
+                                  to perform the erase operation.
+  @retval EFI_MEDIA_CHANGED       The MediaId is not for the current media.
+  @retval EFI_INVALID_PARAMETER   The erase request contains LBAs that are not
+                                  valid.
+
+**/
+EFI_STATUS
+EFIAPI
+MMCHSEraseBlocks (
+  IN     EFI_ERASE_BLOCK_PROTOCOL   *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_ERASE_BLOCK_TOKEN      *Token,
+  IN     UINTN                      Size
+  )
+{
+  BIO_INSTANCE              *Instance;
+  EFI_STATUS                 Status;
+  UINTN                      NumBlocks;
+
+  Instance = BIO_INSTANCE_FROM_ERASEBLOCK_THIS(This);
+
+  // there's no buffer, but the range has to be checked all the same
+  Status = MMCHSValidateRequest (Instance, MediaId, Lba, Size, This);
+  if (EFI_ERROR (Status)) {
+    return Status == EFI_BAD_BUFFER_SIZE ? EFI_INVALID_PARAMETER : Status;
+  }
+
+  NumBlocks = Size / Instance->BlockMedia.BlockSize;
+
+  if (NumBlocks != 0) {
+    // nothing queued or cached may end up on the erased blocks
+    MMCHSDrainAsyncRequests (Instance);
+    MMCHSReadAheadInvalidate (Instance, Lba, NumBlocks);
+    MMCHSBlockCacheDiscard (Instance, Lba, NumBlocks);
+
+    Status = MMCHSDeviceInit (Instance);
+    if (!EFI_ERROR (Status) && Instance->LKDev.erase(&Instance->LKDev, Lba, NumBlocks)) {
+      Status = EFI_DEVICE_ERROR;
+    }
+  }
+
+  if (Token != NULL && Token->Event != NULL) {
+    Token->TransactionStatus = Status;
+    gBS->SignalEvent (Token->Event);
+    return EFI_SUCCESS;
+  }
+
+  return Status;
 }
 
 
@@ -313,6 +1145,104 @@ EFI_BLOCK_IO_PROTOCOL gBlockIoTemplate = {
   MMCHSFlushBlocks                   // FlushBlocks
 };
 
+/**
+  Notification function of EVT_SIGNAL_EXIT_BOOT_SERVICES.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      The BIO_INSTANCE of the device.
+
+**/
+STATIC
+VOID
+EFIAPI
+MMCHSExitBootServicesEvent (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  BIO_INSTANCE              *Instance;
+  LIST_ENTRY                *Link;
+  BIO_ASYNC_REQUEST         *Request;
+
+  Instance = Context;
+
+  // outstanding transfers have to finish before the OS takes over the
+  // controller. Memory services can't be used anymore, so only wait for them.
+  for (Link = GetFirstNode (&Instance->PendingRequests);
+       !IsNull (&Instance->PendingRequests, Link);
+       Link = GetNextNode (&Instance->PendingRequests, Link)) {
+    Request = BIO_ASYNC_REQUEST_FROM_LINK (Link);
+    Instance->LKDev.complete(&Instance->LKDev, &Request->LKRequest);
+  }
+
+  if (EFI_ERROR (MMCHSBlockCacheFlush (Instance, 0, MAX_UINTN))) {
+    DEBUG ((DEBUG_ERROR, "MMCHS: device %d: can't write back the block cache\n", Instance->LKDev.id));
+  }
+
+  DEBUG ((DEBUG_INFO, "MMCHS: device %d: read-ahead hits=%Lu misses=%Lu\n",
+    Instance->LKDev.id, Instance->ReadAhead.Hits, Instance->ReadAhead.Misses));
+}
+
+/**
+  Reset notify function, called by ResetSystem right before the reset.
+
+  @param  Context      The BIO_INSTANCE of the device.
+
+**/
+STATIC
+VOID
+EFIAPI
+MMCHSResetNotify (
+  IN VOID                           *Context
+  )
+{
+  BIO_INSTANCE              *Instance;
+
+  Instance = Context;
+
+  MMCHSDrainAsyncRequests (Instance);
+
+  if (EFI_ERROR (MMCHSBlockCacheFlush (Instance, 0, MAX_UINTN))) {
+    DEBUG ((DEBUG_ERROR, "MMCHS: device %d: can't write back the block cache\n", Instance->LKDev.id));
+  }
+}
+
+/**
+  Registers MMCHSResetNotify once the reset notify protocol is there, the
+  reset driver may get loaded after this one.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      The BIO_INSTANCE of the device.
+
+**/
+STATIC
+VOID
+EFIAPI
+MMCHSResetNotifyInstalled (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  EFI_STATUS                    Status;
+  EFI_LK_RESET_NOTIFY_PROTOCOL  *ResetNotify;
+  BIO_INSTANCE                  *Instance;
+
+  Instance = Context;
+
+  Status = gBS->LocateProtocol (&gEfiLKResetNotifyProtocolGuid, NULL, (VOID **)&ResetNotify);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  gBS->CloseEvent (Event);
+  Instance->ResetNotifyEvent = NULL;
+
+  Status = ResetNotify->RegisterResetNotify (ResetNotify, MMCHSResetNotify, Instance);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "MMCHS: device %d: can't register reset notify: %r\n", Instance->LKDev.id, Status));
+  }
+}
+
 EFI_STATUS
 BioInstanceContructor (
   OUT BIO_INSTANCE** NewInstance
@@ -326,6 +1256,8 @@ BioInstanceContructor (
   }
 
   Instance->BlockIo.Media     = &Instance->BlockMedia;
+  Instance->BlockIo2.Media    = &Instance->BlockMedia;
+  InitializeListHead (&Instance->PendingRequests);
 
   *NewInstance = Instance;
   return EFI_SUCCESS;
@@ -339,47 +1271,121 @@ MMCHSInitialize (
   )
 {
   EFI_STATUS  Status = EFI_SUCCESS;
-  INT32       Count;
+  UINTN       Count;
   UINTN       Index;
+  UINTN       DeviceId;
   BIO_INSTANCE    *Instance;
   lkapi_biodev_t  *Devices = NULL;
   EFI_GUID        VNOR_GUID = gLKVNORGuid;
 
   LKApi = GetLKApi();
 
-  Count = LKApi->bio_list(NULL);
-  Devices = (lkapi_biodev_t*)AllocateZeroPool (sizeof(lkapi_biodev_t) * Count);
-  LKApi->bio_list(Devices);
+  Devices = GetLKBioDevices (&Count);
 
   for (Index = 0 ; Index < Count ; Index++) {
-    // Initialize device
-    if (Devices[Index].init(&Devices[Index])) {
-     Status = EFI_DEVICE_ERROR;
-     goto EXIT;
-    }
-
     // allocate instance
     Status = BioInstanceContructor (&Instance);
     if (EFI_ERROR(Status)) {
       goto EXIT;
     }
 
-    // set data
     Instance->LKDev = Devices[Index];
+    DeviceId = Instance->LKDev.id<0?Index:Instance->LKDev.id;
+
+    // Initialize device now if it was asked for or if we need it to know the geometry
+    if (Instance->LKDev.block_size == 0 || Instance->LKDev.num_blocks == 0 ||
+        (DeviceId < 64 && (PcdGet64 (PcdMMCHSEagerInitDevices) & LShiftU64 (1, DeviceId)) != 0)) {
+      Status = MMCHSDeviceInit (Instance);
+      if (EFI_ERROR(Status)) {
+        FreePool (Instance);
+        goto EXIT;
+      }
+    }
+
+    // set data
     Instance->BlockMedia.BlockSize = Instance->LKDev.block_size;
     Instance->BlockMedia.LastBlock = Instance->LKDev.num_blocks - 1;
     // give every device a slighty different GUID, this limits us to 256 devices
-    Instance->DevicePath.Mmc.Guid.Data4[7] = Instance->LKDev.id<0?Index:Instance->LKDev.id;
+    Instance->DevicePath.Mmc.Guid.Data4[7] = (UINT8)DeviceId;
     if (Instance->LKDev.type == LKAPI_BIODEV_TYPE_VNOR)
       Instance->DevicePath.Mmc.Guid = VNOR_GUID;
+    // LK doesn't report an optimal transfer length, so the media keeps the
+    // template's
+    Instance->EraseGranularity = 1;
+    if (Instance->LKDev.erase_granularity != 0) {
+      Instance->EraseGranularity = Instance->LKDev.erase_granularity;
+    }
+    Instance->EraseBlock.EraseLengthGranularity = Instance->EraseGranularity;
+
+    MMCHSDmaInit (Instance);
+    MMCHSReadAheadInit (Instance);
+    MMCHSBlockCacheInit (Instance);
+    if (FeaturePcdGet (PcdMMCHSTrace)) {
+      MMCHSTraceInit (Instance);
+    }
+
+    Status = gBS->CreateEvent (
+                EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                TPL_NOTIFY,
+                MMCHSExitBootServicesEvent, Instance,
+                &Instance->ExitBootServicesEvent
+                );
+    if (EFI_ERROR(Status)) {
+      goto EXIT;
+    }
+
+    Instance->ResetNotifyEvent = EfiCreateProtocolNotifyEvent (
+                &gEfiLKResetNotifyProtocolGuid,
+                TPL_CALLBACK,
+                MMCHSResetNotifyInstalled, Instance,
+                &Instance->ResetNotifyRegistration
+                );
+    if (Instance->ResetNotifyEvent == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      goto EXIT;
+    }
 
     // Publish BlockIO
     Status = gBS->InstallMultipleProtocolInterfaces (
                 &Instance->Handle,
                 &gEfiBlockIoProtocolGuid,    &Instance->BlockIo,
+                &gEfiBlockIo2ProtocolGuid,   &Instance->BlockIo2,
                 &gEfiDevicePathProtocolGuid, &Instance->DevicePath,
                 NULL
                 );
+    if (EFI_ERROR(Status)) {
+      goto EXIT;
+    }
+
+    // only offer erasing if LK can do it faster than writing zeros
+    if (Instance->LKDev.erase != NULL) {
+      Status = gBS->InstallProtocolInterface (
+                  &Instance->Handle,
+                  &gEfiEraseBlockProtocolGuid,
+                  EFI_NATIVE_INTERFACE,
+                  &Instance->EraseBlock
+                  );
+      if (EFI_ERROR(Status)) {
+        goto EXIT;
+      }
+    }
+
+    if (FeaturePcdGet (PcdMMCHSStatistics)) {
+      Status = MMCHSStatsInstall (Instance);
+      if (EFI_ERROR(Status)) {
+        goto EXIT;
+      }
+    }
+
+    if (FeaturePcdGet (PcdMMCHSTrace)) {
+      Status = MMCHSTraceInstall (Instance);
+      if (EFI_ERROR(Status)) {
+        goto EXIT;
+      }
+    }
+
+    // if this fails PartitionDxe scans the device as usual
+    MMCHSPartitionInstall (Instance);
   }
 
   EXIT:
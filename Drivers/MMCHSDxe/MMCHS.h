@@ -23,11 +23,22 @@
 #include <Library/IoLib.h>
 #include <Library/PcdLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/TimerLib.h>
+
+#include <Guid/Gpt.h>
 
 #include <Protocol/EmbeddedExternalDevice.h>
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+#include <Protocol/EraseBlock.h>
+#include <Protocol/LKBlockIoStats.h>
+#include <Protocol/LKBlockIoTrace.h>
+#include <Protocol/LKResetNotify.h>
 #include <Protocol/DevicePath.h>
+#include <Protocol/PartitionInfo.h>
 
 #include <LittleKernel.h>
 
@@ -39,23 +50,296 @@ typedef struct {
   EFI_DEVICE_PATH     End;
 } MMCHS_DEVICE_PATH;
 
+//
+// Sequential read-ahead window
+//
+typedef struct {
+  UINT8                                 *Buffer;
+  UINTN                                 MaxBlocks;
+  EFI_LBA                               StartLba;
+  UINTN                                 NumBlocks;
+  EFI_LBA                               NextLba;
+  UINTN                                 WindowBlocks;
+  UINTN                                 Generation;
+  UINT64                                Hits;
+  UINT64                                Misses;
+} BIO_READ_AHEAD;
+
+//
+// Write-back block cache
+//
+typedef struct {
+  LIST_ENTRY                            LruLink;
+  LIST_ENTRY                            HashLink;
+  EFI_LBA                               Lba;
+  BOOLEAN                               Valid;
+  BOOLEAN                               Dirty;
+  BOOLEAN                               Queued;
+  UINT8                                 *Data;
+} BIO_CACHE_BLOCK;
+
+typedef struct {
+  UINTN                                 NumBlocks;
+  BIO_CACHE_BLOCK                       *Blocks;
+  LIST_ENTRY                            *HashTable;
+  LIST_ENTRY                            LruList;
+  UINTN                                 DirtyBlocks;
+  UINT8                                 *Data;
+  UINT8                                 *WriteBuffer;
+  lkapi_biodev_segment_t                *Segments;
+} BIO_BLOCK_CACHE;
+
+//
+// Preallocated buffer for transfers LK can't DMA into directly
+//
+typedef struct {
+  UINT8                                 *Buffer;
+  BOOLEAN                               InUse;
+} BIO_BOUNCE_BUFFER;
+
+#define BIO_BOUNCE_BUFFER_COUNT  4
+
+//
+// Recorded block access trace
+//
+typedef struct {
+  LK_BLOCK_IO_TRACE_ENTRY               *Entries;
+  UINTN                                 MaxEntries;
+  UINTN                                 Count;
+  BOOLEAN                               Enabled;
+} BIO_TRACE;
+
 typedef struct {
   UINT32                                Signature;
   EFI_HANDLE                            Handle;
   EFI_BLOCK_IO_PROTOCOL                 BlockIo;
+  EFI_BLOCK_IO2_PROTOCOL                BlockIo2;
+  EFI_ERASE_BLOCK_PROTOCOL              EraseBlock;
   EFI_BLOCK_IO_MEDIA                    BlockMedia;
   MMCHS_DEVICE_PATH                     DevicePath;
   lkapi_biodev_t                        LKDev;
+  UINT32                                EraseGranularity;
+  EFI_STATUS                            InitStatus;
+  LIST_ENTRY                            PendingRequests;
+  BIO_READ_AHEAD                        ReadAhead;
+  BIO_BLOCK_CACHE                       Cache;
+  BIO_BOUNCE_BUFFER                     BounceBuffers[BIO_BOUNCE_BUFFER_COUNT];
+  UINTN                                 BounceBufferSize;
+  EFI_EVENT                             ExitBootServicesEvent;
+  EFI_EVENT                             ResetNotifyEvent;
+  VOID                                  *ResetNotifyRegistration;
+  LK_BLOCK_IO_STATS                     Stats;
+  EFI_LK_BLOCK_IO_STATS_PROTOCOL        StatsProtocol;
+  BIO_TRACE                             Trace;
+  EFI_LK_BLOCK_IO_TRACE_PROTOCOL        TraceProtocol;
 } BIO_INSTANCE;
 
 #define BIO_INSTANCE_SIGNATURE  SIGNATURE_32('e', 'm', 'm', 'c')
 
 #define BIO_INSTANCE_FROM_GOP_THIS(a)     CR (a, BIO_INSTANCE, BlockIo, BIO_INSTANCE_SIGNATURE)
+#define BIO_INSTANCE_FROM_BLOCKIO2_THIS(a)     CR (a, BIO_INSTANCE, BlockIo2, BIO_INSTANCE_SIGNATURE)
+#define BIO_INSTANCE_FROM_ERASEBLOCK_THIS(a)     CR (a, BIO_INSTANCE, EraseBlock, BIO_INSTANCE_SIGNATURE)
+#define BIO_INSTANCE_FROM_STATS_THIS(a)     CR (a, BIO_INSTANCE, StatsProtocol, BIO_INSTANCE_SIGNATURE)
+#define BIO_INSTANCE_FROM_TRACE_THIS(a)     CR (a, BIO_INSTANCE, TraceProtocol, BIO_INSTANCE_SIGNATURE)
+
+//
+// BlockIo2 request which has been handed to LK and did not finish yet
+//
+typedef struct {
+  UINT32                                Signature;
+  LIST_ENTRY                            Link;
+  BIO_INSTANCE                          *Instance;
+  EFI_BLOCK_IO2_TOKEN                   *Token;
+  EFI_EVENT                             Event;
+  VOID                                  *CallerBuffer;
+  UINT8                                 *BounceBuffer;
+  UINT64                                StartTicks;
+  lkapi_biodev_request_t                LKRequest;
+} BIO_ASYNC_REQUEST;
+
+#define BIO_ASYNC_REQUEST_SIGNATURE  SIGNATURE_32('e', 'm', 'r', 'q')
+
+#define BIO_ASYNC_REQUEST_FROM_LINK(a)     CR (a, BIO_ASYNC_REQUEST, Link, BIO_ASYNC_REQUEST_SIGNATURE)
+
+//
+// Child handle of a partition LK reported
+//
+typedef struct {
+  UINT32                                Signature;
+  EFI_HANDLE                            Handle;
+  EFI_BLOCK_IO_PROTOCOL                 BlockIo;
+  EFI_BLOCK_IO2_PROTOCOL                BlockIo2;
+  EFI_BLOCK_IO_MEDIA                    BlockMedia;
+  EFI_PARTITION_INFO_PROTOCOL           PartitionInfo;
+  EFI_DEVICE_PATH_PROTOCOL              *DevicePath;
+  EFI_GUID                              *TypeGuid;
+  BIO_INSTANCE                          *Parent;
+  EFI_LBA                               Start;
+} BIO_PARTITION;
+
+#define BIO_PARTITION_SIGNATURE  SIGNATURE_32('e', 'm', 'p', 't')
+
+#define BIO_PARTITION_FROM_BLOCKIO_THIS(a)     CR (a, BIO_PARTITION, BlockIo, BIO_PARTITION_SIGNATURE)
+#define BIO_PARTITION_FROM_BLOCKIO2_THIS(a)     CR (a, BIO_PARTITION, BlockIo2, BIO_PARTITION_SIGNATURE)
 
 //
 // Function Prototypes
 //
 
+EFI_STATUS
+MMCHSDeviceInit (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+EFI_STATUS
+MMCHSDeviceRead (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  );
+
+EFI_STATUS
+MMCHSDeviceWrite (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  );
+
+EFI_STATUS
+MMCHSDeviceWriteV (
+  IN BIO_INSTANCE                   *Instance,
+  IN lkapi_biodev_segment_t         *Segments,
+  IN UINTN                          Count
+  );
+
+VOID *
+MMCHSDmaAllocateBuffer (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINTN                          Size
+  );
+
+VOID
+MMCHSDmaFreeBuffer (
+  IN VOID                           *Buffer,
+  IN UINTN                          Size
+  );
+
+VOID
+MMCHSDmaInit (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+BOOLEAN
+MMCHSDmaBufferOk (
+  IN BIO_INSTANCE                   *Instance,
+  IN VOID                           *Buffer,
+  IN UINTN                          BufferSize
+  );
+
+UINT8 *
+MMCHSBounceBufferGet (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+VOID
+MMCHSBounceBufferPut (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINT8                          *Buffer
+  );
+
+VOID
+MMCHSStatsRecord (
+  IN OUT LK_BLOCK_IO_OP_STATS       *Stats,
+  IN     UINT64                     StartTicks,
+  IN     UINTN                      Bytes,
+  IN     EFI_STATUS                 Status
+  );
+
+EFI_STATUS
+MMCHSStatsInstall (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+VOID
+MMCHSTraceRecord (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINT32                         Type,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize
+  );
+
+VOID
+MMCHSTraceInit (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+EFI_STATUS
+MMCHSTraceInstall (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+EFI_STATUS
+MMCHSPartitionInstall (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+VOID
+MMCHSReadAheadInit (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+EFI_STATUS
+MMCHSReadAheadRead (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  );
+
+VOID
+MMCHSReadAheadInvalidate (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  );
+
+VOID
+MMCHSBlockCacheInit (
+  IN BIO_INSTANCE                   *Instance
+  );
+
+EFI_STATUS
+MMCHSBlockCacheWrite (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  );
+
+VOID
+MMCHSBlockCachePatchRead (
+  IN     BIO_INSTANCE               *Instance,
+  IN     EFI_LBA                    Lba,
+  IN     UINTN                      BufferSize,
+  IN OUT VOID                       *Buffer
+  );
+
+EFI_STATUS
+MMCHSBlockCacheFlush (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  );
+
+VOID
+MMCHSBlockCacheDiscard (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  );
+
 EFI_STATUS
 EFIAPI
 MMCHSReset (
@@ -89,4 +373,50 @@ MMCHSFlushBlocks (
   IN EFI_BLOCK_IO_PROTOCOL  *This
   );
 
+EFI_STATUS
+EFIAPI
+MMCHSResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL         *This,
+  IN BOOLEAN                        ExtendedVerification
+  );
+
+EFI_STATUS
+EFIAPI
+MMCHSReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  OUT    VOID                       *Buffer
+  );
+
+EFI_STATUS
+EFIAPI
+MMCHSWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  IN     VOID                       *Buffer
+  );
+
+EFI_STATUS
+EFIAPI
+MMCHSFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token
+  );
+
+EFI_STATUS
+EFIAPI
+MMCHSEraseBlocks (
+  IN     EFI_ERASE_BLOCK_PROTOCOL   *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_ERASE_BLOCK_TOKEN      *Token,
+  IN     UINTN                      Size
+  );
+
 #endif
@@ -0,0 +1,477 @@
+/** @file
+  Write-back block cache for the LittleKernel block devices
+
+  Filesystem drivers update the same metadata blocks (FAT, directory entries)
+  over and over, and every single WriteBlocks call goes all the way down into
+  LK. Writes are therefore collected in a small per-device LRU cache and only
+  written back on FlushBlocks, Reset, ExitBootServices, a platform reset or
+  when a dirty block gets evicted. Runs of adjacent dirty blocks are written
+  back as one segment, and a flush hands all segments to LK at once.
+
+  Reads are not cached here (that's what the read-ahead window is for), they
+  only get patched with dirty blocks which didn't reach the device yet.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MMCHS.h"
+
+#define BIO_CACHE_BLOCK_FROM_LRU_LINK(a)   BASE_CR (a, BIO_CACHE_BLOCK, LruLink)
+#define BIO_CACHE_BLOCK_FROM_HASH_LINK(a)  BASE_CR (a, BIO_CACHE_BLOCK, HashLink)
+
+/**
+  Sets up the block cache of a device.
+
+  Everything, including the buffer used for writing back, is allocated here
+  because write-back also happens from the ExitBootServices notification where
+  memory services can't be used anymore.
+
+  @param  Instance     The device instance.
+
+**/
+VOID
+MMCHSBlockCacheInit (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  BIO_BLOCK_CACHE           *Cache;
+  UINTN                      BlockSize;
+  UINTN                      Index;
+
+  Cache     = &Instance->Cache;
+  BlockSize = Instance->BlockMedia.BlockSize;
+
+  ZeroMem (Cache, sizeof (BIO_BLOCK_CACHE));
+  InitializeListHead (&Cache->LruList);
+
+  if (BlockSize == 0 || PcdGet32 (PcdMMCHSBlockCacheSize) / BlockSize == 0) {
+    return;
+  }
+
+  Cache->NumBlocks   = PcdGet32 (PcdMMCHSBlockCacheSize) / BlockSize;
+  Cache->Blocks      = AllocateZeroPool (Cache->NumBlocks * sizeof (BIO_CACHE_BLOCK));
+  Cache->HashTable   = AllocatePool (Cache->NumBlocks * sizeof (LIST_ENTRY));
+  Cache->Data        = AllocatePool (Cache->NumBlocks * BlockSize);
+  Cache->WriteBuffer = MMCHSDmaAllocateBuffer (Instance, Cache->NumBlocks * BlockSize);
+  Cache->Segments    = AllocatePool (Cache->NumBlocks * sizeof (lkapi_biodev_segment_t));
+
+  if (Cache->Blocks == NULL || Cache->HashTable == NULL ||
+      Cache->Data == NULL || Cache->WriteBuffer == NULL || Cache->Segments == NULL) {
+    DEBUG ((DEBUG_WARN, "MMCHS: device %d: no memory for the block cache\n", Instance->LKDev.id));
+
+    if (Cache->Blocks != NULL) {
+      FreePool (Cache->Blocks);
+    }
+    if (Cache->HashTable != NULL) {
+      FreePool (Cache->HashTable);
+    }
+    if (Cache->Data != NULL) {
+      FreePool (Cache->Data);
+    }
+    if (Cache->WriteBuffer != NULL) {
+      MMCHSDmaFreeBuffer (Cache->WriteBuffer, Cache->NumBlocks * BlockSize);
+    }
+    if (Cache->Segments != NULL) {
+      FreePool (Cache->Segments);
+    }
+
+    ZeroMem (Cache, sizeof (BIO_BLOCK_CACHE));
+    InitializeListHead (&Cache->LruList);
+    return;
+  }
+
+  for (Index = 0; Index < Cache->NumBlocks; Index++) {
+    InitializeListHead (&Cache->HashTable[Index]);
+
+    Cache->Blocks[Index].Data = Cache->Data + Index * BlockSize;
+    InsertTailList (&Cache->LruList, &Cache->Blocks[Index].LruLink);
+  }
+
+  Instance->BlockMedia.WriteCaching = TRUE;
+}
+
+/**
+  Looks up a block in the cache.
+
+  @param  Cache        The block cache.
+  @param  Lba          The block to look for.
+
+  @return The cache entry of the block, or NULL if it's not cached.
+
+**/
+STATIC
+BIO_CACHE_BLOCK *
+MMCHSBlockCacheLookup (
+  IN BIO_BLOCK_CACHE                *Cache,
+  IN EFI_LBA                        Lba
+  )
+{
+  LIST_ENTRY                *Bucket;
+  LIST_ENTRY                *Link;
+  BIO_CACHE_BLOCK           *Block;
+
+  Bucket = &Cache->HashTable[(UINTN)(Lba % Cache->NumBlocks)];
+
+  for (Link = GetFirstNode (Bucket); !IsNull (Bucket, Link); Link = GetNextNode (Bucket, Link)) {
+    Block = BIO_CACHE_BLOCK_FROM_HASH_LINK (Link);
+    if (Block->Lba == Lba) {
+      return Block;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Copies the run of adjacent dirty blocks which contains Block into the write
+  buffer and describes it as a segment for MMCHSDeviceWriteV.
+
+  @param  Instance     The device instance.
+  @param  Block        A dirty cache entry which is not queued yet.
+  @param  Used         Number of blocks of the write buffer which are in use.
+                       Gets advanced by the length of the run.
+  @param  Segment      Returns the description of the run.
+
+**/
+STATIC
+VOID
+MMCHSBlockCacheQueueRun (
+  IN     BIO_INSTANCE               *Instance,
+  IN     BIO_CACHE_BLOCK            *Block,
+  IN OUT UINTN                      *Used,
+  OUT    lkapi_biodev_segment_t     *Segment
+  )
+{
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Neighbour;
+  UINTN                      BlockSize;
+  EFI_LBA                    StartLba;
+  UINT8                      *Buffer;
+  UINTN                      Count;
+
+  Cache     = &Instance->Cache;
+  BlockSize = Instance->BlockMedia.BlockSize;
+  Buffer    = Cache->WriteBuffer + *Used * BlockSize;
+
+  // find the start of the run
+  StartLba = Block->Lba;
+  while (StartLba > 0) {
+    Neighbour = MMCHSBlockCacheLookup (Cache, StartLba - 1);
+    if (Neighbour == NULL || !Neighbour->Dirty) {
+      break;
+    }
+    StartLba--;
+  }
+
+  // there can't be more dirty blocks than the write buffer holds
+  for (Count = 0; *Used + Count < Cache->NumBlocks; Count++) {
+    Neighbour = MMCHSBlockCacheLookup (Cache, StartLba + Count);
+    if (Neighbour == NULL || !Neighbour->Dirty) {
+      break;
+    }
+    CopyMem (Buffer + Count * BlockSize, Neighbour->Data, BlockSize);
+    Neighbour->Queued = TRUE;
+  }
+
+  Segment->lba        = StartLba;
+  Segment->num_blocks = Count;
+  Segment->buffer     = Buffer;
+
+  *Used += Count;
+}
+
+/**
+  Writes the queued runs to the device and drops them from the read-ahead
+  window.
+
+  @param  Instance     The device instance.
+  @param  Count        The number of queued segments.
+
+  @retval EFI_SUCCESS           The runs were written to the device.
+  @retval EFI_DEVICE_ERROR      The device reported an error, the blocks stay dirty.
+
+**/
+STATIC
+EFI_STATUS
+MMCHSBlockCacheWriteQueued (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINTN                          Count
+  )
+{
+  EFI_STATUS                 Status;
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Block;
+  UINTN                      Index;
+  UINTN                      Offset;
+
+  Cache = &Instance->Cache;
+
+  Status = MMCHSDeviceWriteV (Instance, Cache->Segments, Count);
+
+  for (Index = 0; Index < Count; Index++) {
+    // the window may have been filled while these blocks were dirty, reads
+    // only got patched with them as long as they stayed in the cache
+    MMCHSReadAheadInvalidate (Instance, Cache->Segments[Index].lba, Cache->Segments[Index].num_blocks);
+
+    for (Offset = 0; Offset < Cache->Segments[Index].num_blocks; Offset++) {
+      Block = MMCHSBlockCacheLookup (Cache, Cache->Segments[Index].lba + Offset);
+      Block->Queued = FALSE;
+      if (!EFI_ERROR (Status)) {
+        Block->Dirty = FALSE;
+        Cache->DirtyBlocks--;
+      }
+    }
+  }
+
+  return Status;
+}
+
+/**
+  Takes the least recently used cache entry for a new block, writing its
+  previous content back if necessary.
+
+  @param  Instance     The device instance.
+  @param  Lba          The block the entry is used for from now on.
+  @param  Block        Returns the entry.
+
+  @retval EFI_SUCCESS           Block points to an entry for Lba.
+  @retval EFI_DEVICE_ERROR      The evicted block could not be written back.
+
+**/
+STATIC
+EFI_STATUS
+MMCHSBlockCacheAllocate (
+  IN  BIO_INSTANCE                  *Instance,
+  IN  EFI_LBA                       Lba,
+  OUT BIO_CACHE_BLOCK               **Block
+  )
+{
+  EFI_STATUS                 Status;
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Victim;
+  UINTN                      Used;
+
+  Cache  = &Instance->Cache;
+  Victim = BIO_CACHE_BLOCK_FROM_LRU_LINK (GetPreviousNode (&Cache->LruList, &Cache->LruList));
+
+  if (Victim->Valid) {
+    if (Victim->Dirty) {
+      Used = 0;
+      MMCHSBlockCacheQueueRun (Instance, Victim, &Used, &Cache->Segments[0]);
+      Status = MMCHSBlockCacheWriteQueued (Instance, 1);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+    RemoveEntryList (&Victim->HashLink);
+  }
+
+  Victim->Lba   = Lba;
+  Victim->Valid = TRUE;
+  Victim->Dirty = FALSE;
+  InsertHeadList (&Cache->HashTable[(UINTN)(Lba % Cache->NumBlocks)], &Victim->HashLink);
+
+  *Block = Victim;
+  return EFI_SUCCESS;
+}
+
+/**
+  Write BufferSize bytes from Buffer to Lba through the cache.
+
+  The request must have been validated already. Requests bigger than half of
+  the cache go straight to the device.
+
+  @param  Instance     The device instance.
+  @param  Lba          The starting logical block address to be written.
+  @param  BufferSize   Size of Buffer, a multiple of the device block size.
+  @param  Buffer       A pointer to the source buffer for the data.
+
+  @retval EFI_SUCCESS           The data was written to the cache or the device.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing the write.
+
+**/
+EFI_STATUS
+MMCHSBlockCacheWrite (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Block;
+  UINTN                      BlockSize;
+  UINTN                      NumBlocks;
+  UINTN                      Index;
+
+  Cache     = &Instance->Cache;
+  BlockSize = Instance->BlockMedia.BlockSize;
+  NumBlocks = BufferSize / BlockSize;
+
+  if (NumBlocks > Cache->NumBlocks / 2) {
+    // the device gets the newest data, older cached copies are worthless now
+    MMCHSBlockCacheDiscard (Instance, Lba, NumBlocks);
+    return MMCHSDeviceWrite (Instance, Lba, BufferSize, Buffer);
+  }
+
+  for (Index = 0; Index < NumBlocks; Index++) {
+    Block = MMCHSBlockCacheLookup (Cache, Lba + Index);
+    if (Block == NULL) {
+      Status = MMCHSBlockCacheAllocate (Instance, Lba + Index, &Block);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+
+    CopyMem (Block->Data, (UINT8*)Buffer + Index * BlockSize, BlockSize);
+    if (!Block->Dirty) {
+      Block->Dirty = TRUE;
+      Cache->DirtyBlocks++;
+    }
+
+    RemoveEntryList (&Block->LruLink);
+    InsertHeadList (&Cache->LruList, &Block->LruLink);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Replaces data which was read from the device with dirty cached blocks.
+
+  @param  Instance     The device instance.
+  @param  Lba          The starting Logical Block Address which was read.
+  @param  BufferSize   Size of Buffer, a multiple of the device block size.
+  @param  Buffer       The data which was read from the device.
+
+**/
+VOID
+MMCHSBlockCachePatchRead (
+  IN     BIO_INSTANCE               *Instance,
+  IN     EFI_LBA                    Lba,
+  IN     UINTN                      BufferSize,
+  IN OUT VOID                       *Buffer
+  )
+{
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Block;
+  UINTN                      BlockSize;
+  UINTN                      NumBlocks;
+  UINTN                      Index;
+
+  Cache     = &Instance->Cache;
+  BlockSize = Instance->BlockMedia.BlockSize;
+  NumBlocks = BufferSize / BlockSize;
+
+  if (Cache->DirtyBlocks == 0) {
+    return;
+  }
+
+  for (Index = 0; Index < NumBlocks; Index++) {
+    Block = MMCHSBlockCacheLookup (Cache, Lba + Index);
+    if (Block != NULL && Block->Dirty) {
+      CopyMem ((UINT8*)Buffer + Index * BlockSize, Block->Data, BlockSize);
+    }
+  }
+}
+
+/**
+  Writes back all dirty blocks which overlap with the given range.
+
+  All runs of adjacent dirty blocks are collected first and then handed to
+  LK as one vectored write.
+
+  Doesn't use memory services, so it can be called from the ExitBootServices
+  notification.
+
+  @param  Instance     The device instance.
+  @param  Lba          The first block of the range.
+  @param  NumBlocks    The number of blocks in the range.
+
+  @retval EFI_SUCCESS           The range is clean.
+  @retval EFI_DEVICE_ERROR      The device reported an error while writing back the data.
+
+**/
+EFI_STATUS
+MMCHSBlockCacheFlush (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  )
+{
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Block;
+  UINTN                      Index;
+  UINTN                      Used;
+  UINTN                      Count;
+
+  Cache = &Instance->Cache;
+  Used  = 0;
+  Count = 0;
+
+  if (Cache->DirtyBlocks == 0) {
+    return EFI_SUCCESS;
+  }
+
+  for (Index = 0; Index < Cache->NumBlocks; Index++) {
+    Block = &Cache->Blocks[Index];
+    if (!Block->Dirty || Block->Queued || Block->Lba < Lba || Block->Lba - Lba >= NumBlocks) {
+      continue;
+    }
+
+    MMCHSBlockCacheQueueRun (Instance, Block, &Used, &Cache->Segments[Count++]);
+  }
+
+  return MMCHSBlockCacheWriteQueued (Instance, Count);
+}
+
+/**
+  Drops all cached copies of the given range without writing them back.
+
+  Has to be called before the range gets written to the device behind the
+  cache's back.
+
+  @param  Instance     The device instance.
+  @param  Lba          The first block which gets modified.
+  @param  NumBlocks    The number of blocks which get modified.
+
+**/
+VOID
+MMCHSBlockCacheDiscard (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  )
+{
+  BIO_BLOCK_CACHE           *Cache;
+  BIO_CACHE_BLOCK           *Block;
+  UINTN                      Index;
+
+  Cache = &Instance->Cache;
+
+  for (Index = 0; Index < Cache->NumBlocks; Index++) {
+    Block = &Cache->Blocks[Index];
+    if (!Block->Valid || Block->Lba < Lba || Block->Lba - Lba >= NumBlocks) {
+      continue;
+    }
+
+    if (Block->Dirty) {
+      Block->Dirty = FALSE;
+      Cache->DirtyBlocks--;
+    }
+    Block->Valid = FALSE;
+    RemoveEntryList (&Block->HashLink);
+
+    // free entries get reused first
+    RemoveEntryList (&Block->LruLink);
+    InsertTailList (&Cache->LruList, &Block->LruLink);
+  }
+}
@@ -0,0 +1,197 @@
+/** @file
+  DMA buffer handling for the LittleKernel block devices
+
+  LK reports which buffers its controller can DMA into directly. Caller
+  buffers which qualify are handed to LK as they are. Everything else goes
+  through a small pool of bounce buffers which get allocated once per device,
+  so no request has to allocate memory. If the pool is exhausted the caller's
+  buffer is passed on anyway and LK has to deal with it itself, just like it
+  did before it reported its constraints.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MMCHS.h"
+
+/**
+  Allocates a buffer LK can DMA into.
+
+  The buffer is page aligned and placed below the device's DMA limit.
+
+  @param  Instance     The device instance.
+  @param  Size         Size of the buffer in bytes.
+
+  @return The buffer, or NULL if there's not enough memory.
+
+**/
+VOID *
+MMCHSDmaAllocateBuffer (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINTN                          Size
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_PHYSICAL_ADDRESS       Address;
+
+  if (Instance->LKDev.dma_addr_limit != 0) {
+    Address = Instance->LKDev.dma_addr_limit;
+    Status = gBS->AllocatePages (AllocateMaxAddress, EfiBootServicesData, EFI_SIZE_TO_PAGES (Size), &Address);
+  } else {
+    Status = gBS->AllocatePages (AllocateAnyPages, EfiBootServicesData, EFI_SIZE_TO_PAGES (Size), &Address);
+  }
+
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  return (VOID*)(UINTN)Address;
+}
+
+/**
+  Frees a buffer allocated with MMCHSDmaAllocateBuffer.
+
+  @param  Buffer       The buffer.
+  @param  Size         Size of the buffer in bytes.
+
+**/
+VOID
+MMCHSDmaFreeBuffer (
+  IN VOID                           *Buffer,
+  IN UINTN                          Size
+  )
+{
+  FreePages (Buffer, EFI_SIZE_TO_PAGES (Size));
+}
+
+/**
+  Sets up the DMA constraints and the bounce buffer pool of a device.
+
+  @param  Instance     The device instance.
+
+**/
+VOID
+MMCHSDmaInit (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  UINTN                      Index;
+
+  if (Instance->LKDev.dma_alignment == 0 && Instance->LKDev.dma_addr_limit == 0) {
+    // LK doesn't DMA into caller buffers, keep what we always reported
+    return;
+  }
+
+  if (Instance->LKDev.dma_alignment != 0) {
+    Instance->BlockMedia.IoAlign = Instance->LKDev.dma_alignment;
+  }
+
+  Instance->BounceBufferSize = ALIGN_VALUE (PcdGet32 (PcdMMCHSBounceBufferSize), Instance->BlockMedia.BlockSize);
+  if (Instance->BounceBufferSize == 0) {
+    return;
+  }
+
+  for (Index = 0; Index < BIO_BOUNCE_BUFFER_COUNT; Index++) {
+    Instance->BounceBuffers[Index].Buffer = MMCHSDmaAllocateBuffer (Instance, Instance->BounceBufferSize);
+    Instance->BounceBuffers[Index].InUse  = FALSE;
+    if (Instance->BounceBuffers[Index].Buffer == NULL) {
+      DEBUG ((DEBUG_WARN, "MMCHS: device %d: no memory for a bounce buffer\n", Instance->LKDev.id));
+    }
+  }
+}
+
+/**
+  Checks whether LK can DMA into a buffer directly.
+
+  @param  Instance     The device instance.
+  @param  Buffer       The buffer.
+  @param  BufferSize   Size of the buffer in bytes.
+
+  @retval TRUE         The buffer can be passed to LK as it is.
+  @retval FALSE        The buffer needs to be bounced.
+
+**/
+BOOLEAN
+MMCHSDmaBufferOk (
+  IN BIO_INSTANCE                   *Instance,
+  IN VOID                           *Buffer,
+  IN UINTN                          BufferSize
+  )
+{
+  if (Instance->LKDev.dma_alignment > 1 &&
+      ((UINTN)Buffer & (Instance->LKDev.dma_alignment - 1)) != 0) {
+    return FALSE;
+  }
+
+  if (Instance->LKDev.dma_addr_limit != 0 &&
+      (UINT64)(UINTN)Buffer + BufferSize - 1 > Instance->LKDev.dma_addr_limit) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+  Takes a buffer from the bounce buffer pool.
+
+  @param  Instance     The device instance.
+
+  @return A buffer of Instance->BounceBufferSize bytes, or NULL if all of them
+          are in use.
+
+**/
+UINT8 *
+MMCHSBounceBufferGet (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  EFI_TPL                    OldTpl;
+  UINTN                      Index;
+  UINT8                      *Buffer;
+
+  Buffer = NULL;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Index = 0; Index < BIO_BOUNCE_BUFFER_COUNT; Index++) {
+    if (Instance->BounceBuffers[Index].Buffer != NULL && !Instance->BounceBuffers[Index].InUse) {
+      Instance->BounceBuffers[Index].InUse = TRUE;
+      Buffer = Instance->BounceBuffers[Index].Buffer;
+      break;
+    }
+  }
+  gBS->RestoreTPL (OldTpl);
+
+  return Buffer;
+}
+
+/**
+  Returns a buffer to the bounce buffer pool.
+
+  @param  Instance     The device instance.
+  @param  Buffer       A buffer returned by MMCHSBounceBufferGet.
+
+**/
+VOID
+MMCHSBounceBufferPut (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINT8                          *Buffer
+  )
+{
+  EFI_TPL                    OldTpl;
+  UINTN                      Index;
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Index = 0; Index < BIO_BOUNCE_BUFFER_COUNT; Index++) {
+    if (Instance->BounceBuffers[Index].Buffer == Buffer) {
+      Instance->BounceBuffers[Index].InUse = FALSE;
+      break;
+    }
+  }
+  gBS->RestoreTPL (OldTpl);
+}
@@ -0,0 +1,520 @@
+/** @file
+  Partition child handles for the LittleKernel block devices
+
+  LK parses the partition table of its boot device anyway, so if it exports
+  the result the child handles get installed right away instead of having
+  PartitionDxe read the MBR/GPT again. The children look like the ones
+  PartitionDxe creates: BlockIo, BlockIo2, EFI_PARTITION_INFO_PROTOCOL, a
+  hard drive device path node and the partition type GUID.
+
+  The driver opens the BlockIo of the whole device BY_DRIVER, which keeps
+  DiskIo and thereby PartitionDxe off of it. Devices LK didn't report any
+  partitions for are left alone and get scanned as usual.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MMCHS.h"
+
+/**
+  Checks a request against the bounds of a partition.
+
+  @param  Partition    The partition.
+  @param  MediaId      The media ID the caller passed.
+  @param  Lba          The first block of the request, relative to the partition.
+  @param  BufferSize   Size of the request in bytes.
+
+  @retval EFI_SUCCESS  The request may be passed on to the device.
+  @return The error to return to the caller.
+
+**/
+STATIC
+EFI_STATUS
+MMCHSPartitionCheckRequest (
+  IN BIO_PARTITION                  *Partition,
+  IN UINT32                         MediaId,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize
+  )
+{
+  EFI_BLOCK_IO_MEDIA        *Media;
+
+  Media = &Partition->BlockMedia;
+
+  if (MediaId != Media->MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if ((BufferSize % Media->BlockSize) != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  if (Lba > Media->LastBlock || BufferSize / Media->BlockSize > Media->LastBlock - Lba + 1) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionReset (
+  IN EFI_BLOCK_IO_PROTOCOL          *This,
+  IN BOOLEAN                        ExtendedVerification
+  )
+{
+  BIO_PARTITION             *Partition;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO_THIS (This);
+  return MMCHSReset (&Partition->Parent->BlockIo, ExtendedVerification);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionReadBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL          *This,
+  IN UINT32                         MediaId,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  )
+{
+  BIO_PARTITION             *Partition;
+  EFI_STATUS                 Status;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO_THIS (This);
+
+  Status = MMCHSPartitionCheckRequest (Partition, MediaId, Lba, BufferSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return MMCHSReadBlocks (&Partition->Parent->BlockIo, Partition->Parent->BlockMedia.MediaId,
+                          Partition->Start + Lba, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionWriteBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL          *This,
+  IN UINT32                         MediaId,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  )
+{
+  BIO_PARTITION             *Partition;
+  EFI_STATUS                 Status;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO_THIS (This);
+
+  Status = MMCHSPartitionCheckRequest (Partition, MediaId, Lba, BufferSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return MMCHSWriteBlocks (&Partition->Parent->BlockIo, Partition->Parent->BlockMedia.MediaId,
+                           Partition->Start + Lba, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionFlushBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL          *This
+  )
+{
+  BIO_PARTITION             *Partition;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO_THIS (This);
+  return MMCHSFlushBlocks (&Partition->Parent->BlockIo);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL         *This,
+  IN BOOLEAN                        ExtendedVerification
+  )
+{
+  BIO_PARTITION             *Partition;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO2_THIS (This);
+  return MMCHSResetEx (&Partition->Parent->BlockIo2, ExtendedVerification);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  OUT    VOID                       *Buffer
+  )
+{
+  BIO_PARTITION             *Partition;
+  EFI_STATUS                 Status;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO2_THIS (This);
+
+  Status = MMCHSPartitionCheckRequest (Partition, MediaId, Lba, BufferSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return MMCHSReadBlocksEx (&Partition->Parent->BlockIo2, Partition->Parent->BlockMedia.MediaId,
+                            Partition->Start + Lba, Token, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN     UINT32                     MediaId,
+  IN     EFI_LBA                    Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token,
+  IN     UINTN                      BufferSize,
+  IN     VOID                       *Buffer
+  )
+{
+  BIO_PARTITION             *Partition;
+  EFI_STATUS                 Status;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO2_THIS (This);
+
+  Status = MMCHSPartitionCheckRequest (Partition, MediaId, Lba, BufferSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return MMCHSWriteBlocksEx (&Partition->Parent->BlockIo2, Partition->Parent->BlockMedia.MediaId,
+                             Partition->Start + Lba, Token, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MMCHSPartitionFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL     *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN        *Token
+  )
+{
+  BIO_PARTITION             *Partition;
+
+  Partition = BIO_PARTITION_FROM_BLOCKIO2_THIS (This);
+  return MMCHSFlushBlocksEx (&Partition->Parent->BlockIo2, Token);
+}
+
+/**
+  Sets up the child of one partition LK reported.
+
+  @param  Instance     The device the partition is on.
+  @param  Entry        The partition as LK reported it.
+
+  @return The partition, or NULL if it's invalid or there's not enough memory.
+
+**/
+STATIC
+BIO_PARTITION *
+MMCHSPartitionCreate (
+  IN BIO_INSTANCE                   *Instance,
+  IN lkapi_biodev_partition_t       *Entry
+  )
+{
+  BIO_PARTITION             *Partition;
+  HARDDRIVE_DEVICE_PATH      HardDrive;
+  EFI_PARTITION_ENTRY        *Gpt;
+  MBR_PARTITION_RECORD       *Mbr;
+  UINTN                      Index;
+
+  if (Entry->first_lba > Entry->last_lba || Entry->last_lba > Instance->BlockMedia.LastBlock) {
+    DEBUG ((DEBUG_WARN, "MMCHS: device %d: partition %d is out of bounds\n", Instance->LKDev.id, Entry->number));
+    return NULL;
+  }
+
+  Partition = AllocateZeroPool (sizeof (BIO_PARTITION));
+  if (Partition == NULL) {
+    return NULL;
+  }
+
+  Partition->Signature = BIO_PARTITION_SIGNATURE;
+  Partition->Parent    = Instance;
+  Partition->Start     = Entry->first_lba;
+
+  Partition->BlockIo.Revision    = Instance->BlockIo.Revision;
+  Partition->BlockIo.Media       = &Partition->BlockMedia;
+  Partition->BlockIo.Reset       = MMCHSPartitionReset;
+  Partition->BlockIo.ReadBlocks  = MMCHSPartitionReadBlocks;
+  Partition->BlockIo.WriteBlocks = MMCHSPartitionWriteBlocks;
+  Partition->BlockIo.FlushBlocks = MMCHSPartitionFlushBlocks;
+
+  Partition->BlockIo2.Media         = &Partition->BlockMedia;
+  Partition->BlockIo2.Reset         = MMCHSPartitionResetEx;
+  Partition->BlockIo2.ReadBlocksEx  = MMCHSPartitionReadBlocksEx;
+  Partition->BlockIo2.WriteBlocksEx = MMCHSPartitionWriteBlocksEx;
+  Partition->BlockIo2.FlushBlocksEx = MMCHSPartitionFlushBlocksEx;
+
+  CopyMem (&Partition->BlockMedia, &Instance->BlockMedia, sizeof (EFI_BLOCK_IO_MEDIA));
+  Partition->BlockMedia.LogicalPartition = TRUE;
+  Partition->BlockMedia.LastBlock        = Entry->last_lba - Entry->first_lba;
+
+  ZeroMem (&HardDrive, sizeof (HardDrive));
+  HardDrive.Header.Type     = MEDIA_DEVICE_PATH;
+  HardDrive.Header.SubType  = MEDIA_HARDDRIVE_DP;
+  SetDevicePathNodeLength (&HardDrive.Header, sizeof (HardDrive));
+  HardDrive.PartitionNumber = Entry->number;
+  HardDrive.PartitionStart  = Entry->first_lba;
+  HardDrive.PartitionSize   = Entry->last_lba - Entry->first_lba + 1;
+
+  Partition->PartitionInfo.Revision = EFI_PARTITION_INFO_PROTOCOL_REVISION;
+
+  if (Entry->table_type == LKAPI_BIODEV_PARTITION_TABLE_GPT) {
+    Gpt = &Partition->PartitionInfo.Info.Gpt;
+    CopyMem (&Gpt->PartitionTypeGUID, Entry->type_guid, sizeof (EFI_GUID));
+    CopyMem (&Gpt->UniquePartitionGUID, Entry->unique_guid, sizeof (EFI_GUID));
+    Gpt->StartingLBA = Entry->first_lba;
+    Gpt->EndingLBA   = Entry->last_lba;
+    Gpt->Attributes  = Entry->attributes;
+    for (Index = 0; Index < sizeof (Gpt->PartitionName) / sizeof (CHAR16) - 1 && Entry->name[Index] != '\0'; Index++) {
+      Gpt->PartitionName[Index] = (CHAR16)Entry->name[Index];
+    }
+
+    Partition->PartitionInfo.Type   = PARTITION_TYPE_GPT;
+    Partition->PartitionInfo.System = CompareGuid (&Gpt->PartitionTypeGUID, &gEfiPartTypeSystemPartGuid) ? 1 : 0;
+    Partition->TypeGuid             = &Gpt->PartitionTypeGUID;
+
+    HardDrive.MBRType       = MBR_TYPE_EFI_PARTITION_TABLE_HEADER;
+    HardDrive.SignatureType = SIGNATURE_TYPE_GUID;
+    CopyMem (HardDrive.Signature, Entry->unique_guid, sizeof (EFI_GUID));
+  } else if (Entry->table_type == LKAPI_BIODEV_PARTITION_TABLE_MBR) {
+    Mbr = &Partition->PartitionInfo.Info.Mbr;
+    Mbr->OSIndicator = Entry->mbr_type;
+    // the record only has room for 32 bit LBAs
+    WriteUnaligned32 ((UINT32 *)Mbr->StartingLBA, (UINT32)Entry->first_lba);
+    WriteUnaligned32 ((UINT32 *)Mbr->SizeInLBA, (UINT32)HardDrive.PartitionSize);
+
+    Partition->PartitionInfo.Type   = PARTITION_TYPE_MBR;
+    Partition->PartitionInfo.System = Entry->mbr_type == EFI_PARTITION ? 1 : 0;
+    Partition->TypeGuid             = Partition->PartitionInfo.System ? &gEfiPartTypeSystemPartGuid : NULL;
+
+    HardDrive.MBRType       = MBR_TYPE_PCAT;
+    HardDrive.SignatureType = SIGNATURE_TYPE_MBR;
+    WriteUnaligned32 ((UINT32 *)HardDrive.Signature, Entry->mbr_signature);
+  } else {
+    FreePool (Partition);
+    return NULL;
+  }
+
+  Partition->DevicePath = AppendDevicePathNode (
+                            (EFI_DEVICE_PATH_PROTOCOL *)&Instance->DevicePath,
+                            &HardDrive.Header
+                            );
+  if (Partition->DevicePath == NULL) {
+    FreePool (Partition);
+    return NULL;
+  }
+
+  return Partition;
+}
+
+/**
+  Installs the protocols of a partition child.
+
+  @param  Partition    The partition.
+
+  @retval EFI_SUCCESS  The child handle was created.
+  @return Errors of the boot services.
+
+**/
+STATIC
+EFI_STATUS
+MMCHSPartitionInstallChild (
+  IN BIO_PARTITION                  *Partition
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_BLOCK_IO_PROTOCOL      *ParentBlockIo;
+
+  Status = gBS->InstallMultipleProtocolInterfaces (
+              &Partition->Handle,
+              &gEfiBlockIoProtocolGuid,         &Partition->BlockIo,
+              &gEfiBlockIo2ProtocolGuid,        &Partition->BlockIo2,
+              &gEfiPartitionInfoProtocolGuid,   &Partition->PartitionInfo,
+              &gEfiDevicePathProtocolGuid,      Partition->DevicePath,
+              NULL
+              );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // the same tag PartitionDxe puts on its children
+  if (Partition->TypeGuid != NULL) {
+    Status = gBS->InstallProtocolInterface (
+                &Partition->Handle,
+                Partition->TypeGuid,
+                EFI_NATIVE_INTERFACE,
+                NULL
+                );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "MMCHS: can't tag partition with its type: %r\n", Status));
+    }
+  }
+
+  return gBS->OpenProtocol (
+                Partition->Parent->Handle,
+                &gEfiBlockIoProtocolGuid,
+                (VOID **)&ParentBlockIo,
+                gImageHandle,
+                Partition->Handle,
+                EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER
+                );
+}
+
+/**
+  Removes a partition child again.
+
+  @param  Partition    The partition. It gets freed.
+
+**/
+STATIC
+VOID
+MMCHSPartitionDestroy (
+  IN BIO_PARTITION                  *Partition
+  )
+{
+  if (Partition->Handle != NULL) {
+    gBS->CloseProtocol (
+           Partition->Parent->Handle,
+           &gEfiBlockIoProtocolGuid,
+           gImageHandle,
+           Partition->Handle
+           );
+
+    if (Partition->TypeGuid != NULL) {
+      gBS->UninstallProtocolInterface (Partition->Handle, Partition->TypeGuid, NULL);
+    }
+
+    gBS->UninstallMultipleProtocolInterfaces (
+           Partition->Handle,
+           &gEfiBlockIoProtocolGuid,         &Partition->BlockIo,
+           &gEfiBlockIo2ProtocolGuid,        &Partition->BlockIo2,
+           &gEfiPartitionInfoProtocolGuid,   &Partition->PartitionInfo,
+           &gEfiDevicePathProtocolGuid,      Partition->DevicePath,
+           NULL
+           );
+  }
+
+  FreePool (Partition->DevicePath);
+  FreePool (Partition);
+}
+
+/**
+  Creates child handles for the partitions LK knows about.
+
+  Nothing is done if LK can't report partitions for the device. If anything
+  goes wrong all children get removed again, so PartitionDxe takes over.
+
+  @param  Instance     The device instance. The BlockIo handle has to exist.
+
+  @retval EFI_SUCCESS      The children were created.
+  @retval EFI_UNSUPPORTED  LK doesn't know the partitions of the device.
+  @return Other errors if creating the children failed.
+
+**/
+EFI_STATUS
+MMCHSPartitionInstall (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  EFI_STATUS                 Status;
+  INT32                      Count;
+  INT32                      Index;
+  lkapi_biodev_partition_t   *Entries;
+  BIO_PARTITION              **Partitions;
+  EFI_BLOCK_IO_PROTOCOL      *BlockIo;
+
+  if (Instance->LKDev.partition_list == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Count = Instance->LKDev.partition_list(&Instance->LKDev, NULL);
+  if (Count <= 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Entries    = AllocateZeroPool (sizeof (lkapi_biodev_partition_t) * Count);
+  Partitions = AllocateZeroPool (sizeof (BIO_PARTITION *) * Count);
+  if (Entries == NULL || Partitions == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  if (Instance->LKDev.partition_list(&Instance->LKDev, Entries) != Count) {
+    Status = EFI_DEVICE_ERROR;
+    goto EXIT;
+  }
+
+  // from now on DiskIo and PartitionDxe leave the device alone
+  Status = gBS->OpenProtocol (
+              Instance->Handle,
+              &gEfiBlockIoProtocolGuid,
+              (VOID **)&BlockIo,
+              gImageHandle,
+              Instance->Handle,
+              EFI_OPEN_PROTOCOL_BY_DRIVER
+              );
+  if (EFI_ERROR (Status)) {
+    goto EXIT;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    Partitions[Index] = MMCHSPartitionCreate (Instance, &Entries[Index]);
+    if (Partitions[Index] == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      break;
+    }
+
+    Status = MMCHSPartitionInstallChild (Partitions[Index]);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "MMCHS: device %d: can't use LK's partitions, falling back to scanning: %r\n",
+      Instance->LKDev.id, Status));
+
+    for (Index = 0; Index < Count; Index++) {
+      if (Partitions[Index] != NULL) {
+        MMCHSPartitionDestroy (Partitions[Index]);
+      }
+    }
+
+    gBS->CloseProtocol (Instance->Handle, &gEfiBlockIoProtocolGuid, gImageHandle, Instance->Handle);
+  }
+
+EXIT:
+  if (Entries != NULL) {
+    FreePool (Entries);
+  }
+  if (Partitions != NULL) {
+    FreePool (Partitions);
+  }
+
+  return Status;
+}
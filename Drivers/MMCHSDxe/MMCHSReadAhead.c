@@ -0,0 +1,207 @@
+/** @file
+  Sequential read-ahead for the LittleKernel block devices
+
+  Every ReadBlocks call costs a full round trip into LK, so streaming a kernel
+  or ramdisk in small chunks is dominated by per-command overhead. When a
+  read continues exactly where the previous one stopped, we fetch more blocks
+  than requested into a per-device window and serve the following reads of the
+  stream from memory. The prefetch size doubles with every sequential miss
+  until it reaches PcdMMCHSReadAheadMaxSize.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MMCHS.h"
+
+/**
+  Sets up the read-ahead window of a device.
+
+  The window buffer itself is allocated on the first sequential read, so
+  devices which never get streamed don't cost any memory.
+
+  @param  Instance     The device instance.
+
+**/
+VOID
+MMCHSReadAheadInit (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  BIO_READ_AHEAD            *ReadAhead;
+
+  ReadAhead = &Instance->ReadAhead;
+
+  ReadAhead->Buffer       = NULL;
+  ReadAhead->MaxBlocks    = PcdGet32 (PcdMMCHSReadAheadMaxSize) / Instance->BlockMedia.BlockSize;
+  ReadAhead->StartLba     = 0;
+  ReadAhead->NumBlocks    = 0;
+  ReadAhead->NextLba      = MAX_UINT64;
+  ReadAhead->WindowBlocks = 0;
+  ReadAhead->Generation   = 0;
+  ReadAhead->Hits         = 0;
+  ReadAhead->Misses       = 0;
+}
+
+/**
+  Read BufferSize bytes from Lba into Buffer, using the read-ahead window.
+
+  The request must have been validated already. Asynchronous writes
+  invalidate the window from their completion notification, which can run
+  while the window gets filled. The new window is only published if no
+  invalidation happened in the meantime.
+
+  @param  Instance     The device instance.
+  @param  Lba          The starting Logical Block Address to read from.
+  @param  BufferSize   Size of Buffer, a multiple of the device block size.
+  @param  Buffer       A pointer to the destination buffer for the data.
+
+  @retval EFI_SUCCESS           The data was read correctly from the device.
+  @retval EFI_DEVICE_ERROR      The device reported an error while performing the read.
+
+**/
+EFI_STATUS
+MMCHSReadAheadRead (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  )
+{
+  EFI_STATUS                 Status;
+  BIO_READ_AHEAD            *ReadAhead;
+  UINTN                      BlockSize;
+  UINTN                      NumBlocks;
+  UINTN                      Count;
+  UINTN                      FetchBlocks;
+  UINTN                      Generation;
+  BOOLEAN                    Sequential;
+  EFI_TPL                    OldTpl;
+
+  ReadAhead = &Instance->ReadAhead;
+  BlockSize = Instance->BlockMedia.BlockSize;
+  NumBlocks = BufferSize / BlockSize;
+
+  if (ReadAhead->MaxBlocks == 0) {
+    return MMCHSDeviceRead (Instance, Lba, BufferSize, Buffer);
+  }
+
+  Sequential = (Lba == ReadAhead->NextLba);
+  ReadAhead->NextLba = Lba + NumBlocks;
+
+  // serve whatever the window already holds
+  if (ReadAhead->NumBlocks != 0 &&
+      Lba >= ReadAhead->StartLba &&
+      Lba < ReadAhead->StartLba + ReadAhead->NumBlocks) {
+    Count = (UINTN)MIN (NumBlocks, ReadAhead->StartLba + ReadAhead->NumBlocks - Lba);
+    CopyMem (Buffer, ReadAhead->Buffer + (UINTN)(Lba - ReadAhead->StartLba) * BlockSize, Count * BlockSize);
+
+    Lba       += Count;
+    NumBlocks -= Count;
+    Buffer     = (UINT8*)Buffer + Count * BlockSize;
+
+    if (NumBlocks == 0) {
+      ReadAhead->Hits++;
+      return EFI_SUCCESS;
+    }
+
+    // the rest of the request directly follows the window
+    Sequential = TRUE;
+  }
+
+  ReadAhead->Misses++;
+
+  if (!Sequential) {
+    ReadAhead->WindowBlocks = 0;
+    return MMCHSDeviceRead (Instance, Lba, NumBlocks * BlockSize, Buffer);
+  }
+
+  // requests this big don't benefit from the window
+  if (NumBlocks >= ReadAhead->MaxBlocks) {
+    ReadAhead->NumBlocks = 0;
+    return MMCHSDeviceRead (Instance, Lba, NumBlocks * BlockSize, Buffer);
+  }
+
+  if (ReadAhead->Buffer == NULL) {
+    ReadAhead->Buffer = MMCHSDmaAllocateBuffer (Instance, ReadAhead->MaxBlocks * BlockSize);
+    if (ReadAhead->Buffer == NULL) {
+      ReadAhead->MaxBlocks = 0;
+      return MMCHSDeviceRead (Instance, Lba, NumBlocks * BlockSize, Buffer);
+    }
+  }
+
+  // grow the prefetch size while the stream continues
+  if (ReadAhead->WindowBlocks == 0) {
+    ReadAhead->WindowBlocks = NumBlocks;
+  } else {
+    ReadAhead->WindowBlocks *= 2;
+  }
+  ReadAhead->WindowBlocks = MIN (ReadAhead->WindowBlocks, ReadAhead->MaxBlocks - NumBlocks);
+
+  FetchBlocks = NumBlocks + ReadAhead->WindowBlocks;
+  if (Lba + FetchBlocks - 1 > Instance->BlockMedia.LastBlock) {
+    FetchBlocks = (UINTN)(Instance->BlockMedia.LastBlock - Lba + 1);
+  }
+
+  // the buffer gets overwritten, nothing may be served from it until the
+  // new window is published
+  ReadAhead->NumBlocks = 0;
+  Generation = ReadAhead->Generation;
+
+  Status = MMCHSDeviceRead (Instance, Lba, FetchBlocks * BlockSize, ReadAhead->Buffer);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  CopyMem (Buffer, ReadAhead->Buffer, NumBlocks * BlockSize);
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  if (ReadAhead->Generation == Generation) {
+    ReadAhead->StartLba  = Lba;
+    ReadAhead->NumBlocks = FetchBlocks;
+  }
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Drops the read-ahead window if it overlaps with the given range.
+
+  Has to be called before blocks get written to the device, and for
+  asynchronous writes again once they finished. A window which is being
+  filled right now doesn't have a range yet, so it never gets published.
+
+  @param  Instance     The device instance.
+  @param  Lba          The first block which gets modified.
+  @param  NumBlocks    The number of blocks which get modified.
+
+**/
+VOID
+MMCHSReadAheadInvalidate (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  )
+{
+  BIO_READ_AHEAD            *ReadAhead;
+
+  ReadAhead = &Instance->ReadAhead;
+
+  ReadAhead->Generation++;
+
+  if (ReadAhead->NumBlocks == 0) {
+    return;
+  }
+
+  if (Lba < ReadAhead->StartLba + ReadAhead->NumBlocks &&
+      Lba + NumBlocks > ReadAhead->StartLba) {
+    ReadAhead->NumBlocks = 0;
+  }
+}
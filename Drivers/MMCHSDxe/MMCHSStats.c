@@ -0,0 +1,137 @@
+/** @file
+  Block I/O statistics for the LittleKernel block devices
+
+  Counts operations, bytes and errors and keeps log2 latency histograms, both
+  for the requests callers issue and for the transfers which reach LK. The
+  counters are published through EFI_LK_BLOCK_IO_STATS_PROTOCOL.
+
+  Only built in if PcdMMCHSStatistics is set, all call sites are guarded by
+  FeaturePcdGet so the I/O path doesn't pay for it otherwise.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MMCHS.h"
+
+/**
+  Accounts one finished operation.
+
+  @param  Stats        The counters of the operation type.
+  @param  StartTicks   Performance counter value when the operation started.
+  @param  Bytes        Number of bytes transferred.
+  @param  Status       Result of the operation.
+
+**/
+VOID
+MMCHSStatsRecord (
+  IN OUT LK_BLOCK_IO_OP_STATS       *Stats,
+  IN     UINT64                     StartTicks,
+  IN     UINTN                      Bytes,
+  IN     EFI_STATUS                 Status
+  )
+{
+  UINT64                     TimeNs;
+  UINT64                     TimeUs;
+  UINTN                      Bucket;
+
+  TimeNs = GetTimeInNanoSecond (GetPerformanceCounter () - StartTicks);
+  TimeUs = DivU64x32 (TimeNs, 1000);
+
+  Bucket = 0;
+  if (TimeUs != 0) {
+    Bucket = MIN ((UINTN)HighBitSet64 (TimeUs) + 1, LK_BLOCK_IO_STATS_HISTOGRAM_BUCKETS - 1);
+  }
+
+  Stats->Operations++;
+  Stats->TotalTimeNs += TimeNs;
+  Stats->Histogram[Bucket]++;
+
+  if (EFI_ERROR (Status)) {
+    Stats->Errors++;
+  } else {
+    Stats->Bytes += Bytes;
+  }
+}
+
+/**
+  Returns a snapshot of the counters of a device.
+
+  @param  This         The protocol instance.
+  @param  Stats        Returns the counters.
+
+**/
+STATIC
+VOID
+MMCHSStatsGet (
+  IN  EFI_LK_BLOCK_IO_STATS_PROTOCOL  *This,
+  OUT LK_BLOCK_IO_STATS               *Stats
+  )
+{
+  BIO_INSTANCE              *Instance;
+  EFI_TPL                    OldTpl;
+
+  Instance = BIO_INSTANCE_FROM_STATS_THIS (This);
+
+  // async completions update the counters at TPL_CALLBACK
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  CopyMem (Stats, &Instance->Stats, sizeof (LK_BLOCK_IO_STATS));
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Clears the counters of a device. The current queue depth is kept.
+
+  @param  This         The protocol instance.
+
+**/
+STATIC
+VOID
+MMCHSStatsReset (
+  IN EFI_LK_BLOCK_IO_STATS_PROTOCOL  *This
+  )
+{
+  BIO_INSTANCE              *Instance;
+  EFI_TPL                    OldTpl;
+  UINT32                     QueueDepth;
+
+  Instance = BIO_INSTANCE_FROM_STATS_THIS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  QueueDepth = Instance->Stats.QueueDepth;
+  ZeroMem (&Instance->Stats, sizeof (LK_BLOCK_IO_STATS));
+  Instance->Stats.QueueDepth    = QueueDepth;
+  Instance->Stats.MaxQueueDepth = QueueDepth;
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Publishes the statistics protocol of a device.
+
+  @param  Instance     The device instance. The BlockIo handle has to exist.
+
+  @retval EFI_SUCCESS  The protocol was installed.
+  @return Errors of InstallProtocolInterface.
+
+**/
+EFI_STATUS
+MMCHSStatsInstall (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  Instance->StatsProtocol.GetStats   = MMCHSStatsGet;
+  Instance->StatsProtocol.ResetStats = MMCHSStatsReset;
+
+  return gBS->InstallProtocolInterface (
+                &Instance->Handle,
+                &gEfiLKBlockIoStatsProtocolGuid,
+                EFI_NATIVE_INTERFACE,
+                &Instance->StatsProtocol
+                );
+}
@@ -0,0 +1,173 @@
+/** @file
+  Block access trace recorder for the LittleKernel block devices
+
+  Records the LBA of every BlockIo request from driver load on, so the real
+  boot workload can be replayed by LKBlockIoBench later. Recording stops
+  when the buffer is full. The trace is published through
+  EFI_LK_BLOCK_IO_TRACE_PROTOCOL.
+
+  Only built in if PcdMMCHSTrace is set.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MMCHS.h"
+
+/**
+  Appends a request to the trace of a device.
+
+  @param  Instance     The device instance.
+  @param  Type         LK_BLOCK_IO_TRACE_READ or LK_BLOCK_IO_TRACE_WRITE.
+  @param  Lba          The first block of the request.
+  @param  BufferSize   Size of the request in bytes.
+
+**/
+VOID
+MMCHSTraceRecord (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINT32                         Type,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize
+  )
+{
+  BIO_TRACE                 *Trace;
+  LK_BLOCK_IO_TRACE_ENTRY   *Entry;
+
+  Trace = &Instance->Trace;
+
+  if (!Trace->Enabled || Trace->Count >= Trace->MaxEntries) {
+    return;
+  }
+
+  Entry = &Trace->Entries[Trace->Count++];
+  Entry->Lba       = Lba;
+  Entry->NumBlocks = (UINT32)(BufferSize / Instance->BlockMedia.BlockSize);
+  Entry->Type      = Type;
+}
+
+/**
+  Returns the requests recorded so far.
+
+  @param  This         The protocol instance.
+  @param  Entries      Returns the recorded requests.
+
+  @return The number of entries.
+
+**/
+STATIC
+UINTN
+MMCHSTraceGet (
+  IN  EFI_LK_BLOCK_IO_TRACE_PROTOCOL  *This,
+  OUT LK_BLOCK_IO_TRACE_ENTRY         **Entries
+  )
+{
+  BIO_INSTANCE              *Instance;
+
+  Instance = BIO_INSTANCE_FROM_TRACE_THIS (This);
+
+  *Entries = Instance->Trace.Entries;
+  return Instance->Trace.Count;
+}
+
+/**
+  Drops all recorded requests.
+
+  @param  This         The protocol instance.
+
+**/
+STATIC
+VOID
+MMCHSTraceClear (
+  IN EFI_LK_BLOCK_IO_TRACE_PROTOCOL  *This
+  )
+{
+  BIO_INSTANCE              *Instance;
+
+  Instance = BIO_INSTANCE_FROM_TRACE_THIS (This);
+
+  Instance->Trace.Count = 0;
+}
+
+/**
+  Pauses or resumes recording, e.g. while replaying a trace.
+
+  @param  This         The protocol instance.
+  @param  Enable       TRUE to record requests.
+
+  @return The previous state.
+
+**/
+STATIC
+BOOLEAN
+MMCHSTraceSetTracing (
+  IN EFI_LK_BLOCK_IO_TRACE_PROTOCOL  *This,
+  IN BOOLEAN                         Enable
+  )
+{
+  BIO_INSTANCE              *Instance;
+  BOOLEAN                    OldState;
+
+  Instance = BIO_INSTANCE_FROM_TRACE_THIS (This);
+
+  OldState = Instance->Trace.Enabled;
+  Instance->Trace.Enabled = Enable;
+
+  return OldState;
+}
+
+/**
+  Allocates the trace buffer of a device and starts recording.
+
+  @param  Instance     The device instance.
+
+**/
+VOID
+MMCHSTraceInit (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  BIO_TRACE                 *Trace;
+
+  Trace = &Instance->Trace;
+
+  Trace->MaxEntries = PcdGet32 (PcdMMCHSTraceEntries);
+  Trace->Count      = 0;
+  Trace->Entries    = AllocatePool (Trace->MaxEntries * sizeof (LK_BLOCK_IO_TRACE_ENTRY));
+  if (Trace->Entries == NULL) {
+    Trace->MaxEntries = 0;
+  }
+  Trace->Enabled    = TRUE;
+
+  Instance->TraceProtocol.GetTrace   = MMCHSTraceGet;
+  Instance->TraceProtocol.ClearTrace = MMCHSTraceClear;
+  Instance->TraceProtocol.SetTracing = MMCHSTraceSetTracing;
+}
+
+/**
+  Publishes the trace protocol of a device.
+
+  @param  Instance     The device instance. The BlockIo handle has to exist.
+
+  @retval EFI_SUCCESS  The protocol was installed.
+  @return Errors of InstallProtocolInterface.
+
+**/
+EFI_STATUS
+MMCHSTraceInstall (
+  IN BIO_INSTANCE                   *Instance
+  )
+{
+  return gBS->InstallProtocolInterface (
+                &Instance->Handle,
+                &gEfiLKBlockIoTraceProtocolGuid,
+                EFI_NATIVE_INTERFACE,
+                &Instance->TraceProtocol
+                );
+}
@@ -0,0 +1,58 @@
+/** @file
+  CRC32 as used by the UEFI spec (ISO 3309, reflected polynomial 0xEDB88320).
+
+  Produces the same values as gBS->CalculateCrc32, using the ARMv8 CRC32
+  instructions if the CPU has them.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __CRC32_LIB__
+#define __CRC32_LIB__
+
+/**
+  Continues a CRC32 over more data.
+
+  Crc32Update (Crc32Update (0, A, SizeA), B, SizeB) is the CRC32 of A
+  followed by B.
+
+  @param[in]  Crc - The CRC32 of the data so far, 0 to start
+  @param[in]  Buffer - The data
+  @param[in]  Size - Size of Buffer in bytes
+
+  @return     The CRC32 including Buffer
+
+**/
+UINT32
+EFIAPI
+Crc32Update (
+  IN  UINT32                           Crc,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  );
+
+
+/**
+  Calculates the CRC32 of a buffer.
+
+  @param[in]  Buffer - The data
+  @param[in]  Size - Size of Buffer in bytes
+
+  @return     The CRC32 of Buffer
+
+**/
+UINT32
+EFIAPI
+Crc32Calculate (
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  );
+
+#endif
@@ -47,5 +47,26 @@ WriteNvVarsToBlockIo (
   );
 
 
+/**
+  Schedules writing the non-volatile variables to the device.
+
+  Updates which come in within PcdNvVarsWriteBackDelay milliseconds get
+  written together, when the timer expires, at ReadyToBoot or before the
+  platform gets reset. From ReadyToBoot on updates are written right away.
+  Updates still pending at ExitBootServices are handed to the runtime log
+  if there is one, otherwise they're written from BeforeExitBootServices.
+
+  @return     The EFI_STATUS while attempting to schedule the write.
+  @retval     EFI_SUCCESS - The variables will be written
+  @retval     EFI_NOT_STARTED - A interface has not been connected
+
+**/
+EFI_STATUS
+EFIAPI
+ScheduleNvVarsWriteBack (
+  VOID
+  );
+
+
 #endif
 
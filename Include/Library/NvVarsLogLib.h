@@ -0,0 +1,199 @@
+/** @file
+  On-device format of the NvVars log and functions to replay it.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __NV_VARS_LOG_LIB__
+#define __NV_VARS_LOG_LIB__
+
+#include <Protocol/BlockIo.h>
+
+#define NVVARS_LOG_SIGNATURE SIGNATURE_32('n', 'v', 'l', 'g')
+#define NVVARS_LOG_RECORD_SIGNATURE SIGNATURE_32('n', 'v', 'l', 'r')
+#define NVVARS_RUNTIME_LOG_SIGNATURE SIGNATURE_32('n', 'v', 'r', 't')
+
+//
+// Header at LBA 0 if the device holds a log of the raw variable store.
+// ActiveLba is the first block of the half holding the current generation.
+//
+typedef struct {
+  UINT32  Signature;
+  UINT32  Generation;
+  UINT32  ImageSize;
+  UINT32  ActiveLba;
+  UINT32  HalfBlocks;
+  UINT32  Checksum;
+} NVVARS_LOG_HEADER;
+
+//
+// Log record, followed by RangeCount NVVARS_LOG_RANGEs and DataSize bytes
+// of data. Records start on a block boundary.
+//
+typedef struct {
+  UINT32  Signature;
+  UINT32  Generation;
+  UINT32  RangeCount;
+  UINT32  DataSize;
+  UINT32  Checksum;
+} NVVARS_LOG_RECORD;
+
+typedef struct {
+  UINT32  Offset;
+  UINT32  Length;
+} NVVARS_LOG_RANGE;
+
+//
+// Runtime log at PcdNvVarsRuntimeLogBase. The log on the device can't be
+// written once the OS owns the hardware, so the FVB driver appends the
+// writes to the store it gets after ExitBootServices here instead. They
+// continue the log generation Generation, whose last record ends before
+// NextLba, and get replayed on top of it by LK or the next boot.
+//
+// Head is the number of bytes of entries following the header. It's only
+// advanced once an entry is complete. Overflow gets set when an entry
+// didn't fit, the entries before it are still valid.
+//
+typedef struct {
+  UINT32  Signature;
+  UINT32  Size;
+  UINT32  Generation;
+  UINT32  Head;
+  UINT64  NextLba;
+  UINT32  Overflow;
+  UINT32  Reserved;
+} NVVARS_RUNTIME_LOG_HEADER;
+
+//
+// Runtime log entry, followed by Length bytes written at Offset of the
+// store image and padded to 8 bytes. Checksum covers the entry and data.
+//
+typedef struct {
+  UINT32  Offset;
+  UINT32  Length;
+  UINT32  Checksum;
+  UINT32  Reserved;
+} NVVARS_RUNTIME_LOG_ENTRY;
+
+/**
+  Calculates the checksum of a record or the header.
+
+  @param[in]  Buffer - The record or header
+  @param[in]  Size - Size of the record or header in bytes
+  @param[in]  Checksum - The checksum field inside Buffer
+
+  @return     The CRC32 of Buffer with the checksum field set to 0
+
+**/
+UINT32
+EFIAPI
+NvVarsLogChecksum (
+  IN  VOID                             *Buffer,
+  IN  UINTN                            Size,
+  IN  UINT32                           *Checksum
+  );
+
+
+/**
+  Rebuilds the variable store image from the log on a device.
+
+  Only ReadBlocks and Media of BlockIo are used, so it doesn't have to be a
+  full BlockIo implementation.
+
+  @param[in]  BlockIo - The device holding the log
+  @param[in]  Header - The header read from LBA 0
+  @param[out] Image - The image, Header->ImageSize bytes
+  @param[out] NextLba - Optional, returns the block after the last valid record
+
+  @retval     EFI_SUCCESS - The image was rebuilt
+  @retval     EFI_VOLUME_CORRUPTED - There's no valid log on the device
+  @return     Errors of the device
+
+**/
+EFI_STATUS
+EFIAPI
+NvVarsLogReplay (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo,
+  IN  NVVARS_LOG_HEADER                *Header,
+  OUT VOID                             *Image,
+  OUT EFI_LBA                          *NextLba OPTIONAL
+  );
+
+
+/**
+  Starts a runtime log continuing a log generation, dropping its entries.
+
+  @param[in]  Log - The runtime log
+  @param[in]  Size - Size of the runtime log in bytes, including the header
+  @param[in]  Generation - The generation of the log on the device
+  @param[in]  NextLba - The block following its last record
+
+**/
+VOID
+EFIAPI
+NvVarsRuntimeLogArm (
+  IN  NVVARS_RUNTIME_LOG_HEADER        *Log,
+  IN  UINTN                            Size,
+  IN  UINT32                           Generation,
+  IN  EFI_LBA                          NextLba
+  );
+
+
+/**
+  Appends a write to the variable store to the runtime log.
+
+  Only touches the log itself, so it can be called at runtime.
+
+  @param[in]  Log - The runtime log
+  @param[in]  Offset - Offset of the write in the store image
+  @param[in]  Buffer - The data written
+  @param[in]  Length - Number of bytes written
+
+  @retval     EFI_SUCCESS - The write was appended
+  @retval     EFI_NOT_STARTED - The log hasn't been armed
+  @retval     EFI_OUT_OF_RESOURCES - The log is full
+
+**/
+EFI_STATUS
+EFIAPI
+NvVarsRuntimeLogAppend (
+  IN  NVVARS_RUNTIME_LOG_HEADER        *Log,
+  IN  UINTN                            Offset,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Length
+  );
+
+
+/**
+  Applies the entries of a runtime log to an image replayed from the log
+  on the device, if it continues that log.
+
+  Entries are applied in order up to the first one which doesn't check out.
+
+  @param[in]      Log - The runtime log
+  @param[in]      Generation - The generation replayed
+  @param[in]      NextLba - The block following the last record replayed
+  @param[in, out] Image - The image
+  @param[in]      ImageSize - Size of Image in bytes
+
+  @return     The number of entries applied
+
+**/
+UINTN
+EFIAPI
+NvVarsRuntimeLogApply (
+  IN      NVVARS_RUNTIME_LOG_HEADER    *Log,
+  IN      UINT32                       Generation,
+  IN      EFI_LBA                      NextLba,
+  IN OUT  VOID                         *Image,
+  IN      UINTN                        ImageSize
+  );
+
+#endif
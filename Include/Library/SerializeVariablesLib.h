@@ -60,6 +60,34 @@ SerializeVariablesNewInstance (
   );
 
 
+/**
+  Creates a new variable serialization instance which serializes
+  straight into a buffer of the caller.
+
+  The buffer doesn't grow, adding variables which don't fit fails with
+  RETURN_BUFFER_TOO_SMALL. If Buffer is NULL, nothing is stored and the
+  instance only counts the size the variables need, which
+  SerializeVariablesToBuffer returns along with RETURN_BUFFER_TOO_SMALL.
+
+  @param[out]  Handle - Handle for a variable serialization instance
+  @param[in]   Buffer - The buffer to serialize into, or NULL
+  @param[in]   BufferSize - Size of Buffer in bytes
+
+  @retval      RETURN_SUCCESS - The variable serialization instance was
+                 successfully created.
+  @retval      RETURN_OUT_OF_RESOURCES - There we not enough resources to
+                 create the variable serialization instance.
+
+**/
+RETURN_STATUS
+EFIAPI
+SerializeVariablesNewInstanceInBuffer (
+  OUT EFI_HANDLE                      *Handle,
+  IN  VOID                            *Buffer OPTIONAL,
+  IN  UINTN                           BufferSize
+  );
+
+
 /**
   Free memory associated with a variable serialization instance
 
@@ -225,5 +253,26 @@ SerializeVariablesToBuffer (
   );
 
 
+/**
+  Returns the CRC32 of the serialized variables, as calculated by
+  CalculateCrc32 over the data SerializeVariablesToBuffer returns.
+
+  @param[in]   Handle - Handle for a variable serialization instance
+  @param[out]  Crc32 - Returns the CRC32
+
+  @retval      RETURN_SUCCESS - The CRC32 was returned
+  @retval      RETURN_INVALID_PARAMETER - Handle was not a valid
+                 variable serialization instance, or it only counts
+                 the size of the variables.
+
+**/
+RETURN_STATUS
+EFIAPI
+SerializeVariablesGetCrc32 (
+  IN  EFI_HANDLE                          Handle,
+  OUT UINT32                              *Crc32
+  );
+
+
 #endif
 
@@ -8,6 +8,28 @@
 extern EFI_GUID gLKApiAddrGuid;
 extern EFI_GUID gLKVNORGuid;
 
+//
+// Data of the gLKApiAddrGuid HOB
+//
+typedef struct {
+  UINT64 Api;
+  UINT64 ApiSize;
+} LK_API_HOB_DATA;
+
+//
+// Size of lkapi_t if LK doesn't report it, and of the bio_list entries if
+// LK doesn't report that
+//
+#define LKAPI_BASE_SIZE         (OFFSET_OF (lkapi_t, usbgadget_get_interface) + sizeof (VOID *))
+#define LKAPI_BIODEV_BASE_SIZE  OFFSET_OF (lkapi_biodev_t, submit)
+
+//
+// TRUE if LK's lkapi_t has the given member. Optional callbacks may still
+// be NULL.
+//
+#define LKAPI_HAS_MEMBER(Member) \
+  (GetLKApiSize () >= OFFSET_OF (lkapi_t, Member) + sizeof (((lkapi_t *)0)->Member))
+
 /**
   Returns the pointer to the LK API.
 
@@ -21,6 +43,34 @@ GetLKApi (
   VOID
   );
 
+/**
+  Returns the size of the LK API structure LK provides. Members past it
+  mustn't be read, LK predates them.
+
+  @return The size of the LK API structure in bytes.
+
+**/
+UINTN
+EFIAPI
+GetLKApiSize (
+  VOID
+  );
+
+/**
+  Returns LK's block devices. Members LK doesn't know about are NULL/0.
+  Not available in SEC.
+
+  @param  Count       Returns the number of devices.
+
+  @return The devices, to be freed with FreePool, or NULL if there are none.
+
+**/
+lkapi_biodev_t *
+EFIAPI
+GetLKBioDevices (
+  OUT UINTN *Count
+  );
+
 
 
 /**
@@ -59,10 +59,62 @@ typedef void *(*lkapi_boot_mmap_cb_t)(void *pdata, unsigned long long addr, unsi
 typedef unsigned int (*lkapi_int_handler)(void *arg);
 typedef void (*lkapi_timer_callback_t)(void);
 
+#define LKAPI_BIODEV_REQUEST_READ  0
+#define LKAPI_BIODEV_REQUEST_WRITE 1
+
+typedef struct lkapi_biodev_request lkapi_biodev_request_t;
+struct lkapi_biodev_request {
+    unsigned int type;
+    unsigned long long lba;
+    unsigned long buffersize;
+    void *buffer;
+
+    // signaled using event_signal once the transfer has finished
+    void *event;
+    void *pdata;
+};
+
+// one contiguous run of blocks of a vectored transfer
+typedef struct lkapi_biodev_segment lkapi_biodev_segment_t;
+struct lkapi_biodev_segment {
+    unsigned long long lba;
+    unsigned long num_blocks;
+    void *buffer;
+};
+
+#define LKAPI_BIODEV_PARTITION_TABLE_MBR 1
+#define LKAPI_BIODEV_PARTITION_TABLE_GPT 2
+
+// one entry of the partition table LK parsed when it booted
+typedef struct lkapi_biodev_partition lkapi_biodev_partition_t;
+struct lkapi_biodev_partition {
+    unsigned int table_type;
+    // position in the table, starting at 1
+    unsigned int number;
+    unsigned long long first_lba;
+    unsigned long long last_lba;
+
+    // GPT only, in on-disk byte order
+    unsigned char type_guid[16];
+    unsigned char unique_guid[16];
+    unsigned long long attributes;
+    char name[72];
+
+    // MBR only
+    unsigned char mbr_type;
+    unsigned int mbr_signature;
+};
+
+// bio_list fills in entries of lkapi_t.biodev_size bytes, which may differ
+// from this one's size if LK was built against another version. UEFI copies
+// each of them and passes the copy to the callbacks, so those may only use
+// the members up to api_pdata.
 typedef struct lkapi_biodev lkapi_biodev_t;
 struct lkapi_biodev {
     int id;
     unsigned int type;
+    // may already be set by bio_list, so init can be deferred until the
+    // device gets accessed. 0 if only known after init.
     unsigned int block_size;
     unsigned long long num_blocks;
     void *api_pdata;
@@ -70,6 +122,32 @@ struct lkapi_biodev {
     int (*init)(lkapi_biodev_t *dev);
     int (*read)(lkapi_biodev_t *dev, unsigned long long lba, unsigned long buffersize, void *buffer);
     int (*write)(lkapi_biodev_t *dev, unsigned long long lba, unsigned long buffersize, void *buffer);
+
+    // optional: queue a request without waiting for it. NULL if not supported.
+    int (*submit)(lkapi_biodev_t *dev, lkapi_biodev_request_t *req);
+    // waits for a submitted request (if needed) and returns its result
+    int (*complete)(lkapi_biodev_t *dev, lkapi_biodev_request_t *req);
+
+    // optional: transfer several segments with a single command sequence.
+    // NULL if not supported.
+    int (*readv)(lkapi_biodev_t *dev, lkapi_biodev_segment_t *segments, unsigned int count);
+    int (*writev)(lkapi_biodev_t *dev, lkapi_biodev_segment_t *segments, unsigned int count);
+
+    // optional: discard/erase num_blocks blocks starting at lba. NULL if not supported.
+    int (*erase)(lkapi_biodev_t *dev, unsigned long long lba, unsigned long long num_blocks);
+    // erase unit in blocks, ranges aligned to it get erased fastest. 0 if unknown.
+    unsigned int erase_granularity;
+
+    // buffers aligned to this (a power of 2, at most a page) get DMA'd into
+    // directly, others get copied by LK. 0 if LK never DMAs into caller buffers.
+    unsigned int dma_alignment;
+    // highest address the controller can DMA to. 0 if there's no limit.
+    unsigned long long dma_addr_limit;
+
+    // optional: copies the partitions LK found on the device to list and
+    // returns their number. list may be NULL to only get the number.
+    // NULL if not supported, returns 0 if there's no partition table.
+    int (*partition_list)(lkapi_biodev_t *dev, lkapi_biodev_partition_t *list);
 };
 
 
@@ -84,6 +162,7 @@ struct lkapi_biodev {
 #define LKAPI_LCD_PIXELFORMAT_INVALID -1
 #define LKAPI_LCD_PIXELFORMAT_RGB888   0
 #define LKAPI_LCD_PIXELFORMAT_RGB565   1
+#define LKAPI_LCD_PIXELFORMAT_XRGB8888 2
 
 #define LKAPI_UDC_EVENT_ONLINE  1
 #define LKAPI_UDC_EVENT_OFFLINE 2
@@ -131,6 +210,13 @@ struct lkapi_usbgadget_iface {
 //
 // main callback structure
 //
+// LK passes its address in r0 when it jumps to UEFI. LK which puts
+// LKAPI_ABI_MAGIC into r1 reports the size of its lkapi_t in r2, so members
+// added since can be checked for. Without it only the members up to
+// usbgadget_get_interface exist.
+//
+#define LKAPI_ABI_MAGIC 0x4c4b4142
+
 typedef struct {
     void (*platform_early_init)(void);
     void (*platform_init)(void);
@@ -198,6 +284,21 @@ typedef struct {
     void (*event_signal)(void *event);
 
     lkapi_usbgadget_iface_t *(*usbgadget_get_interface)(void);
+
+    // size of the lkapi_biodev_t entries bio_list fills in. If it isn't
+    // there, they end before submit.
+    unsigned int biodev_size;
+
+    // optional: like lcd_flush, but only pushes the given part of the
+    // framebuffer to the panel. NULL if not supported.
+    void (*lcd_flush_rect)(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+    // optional: alignment in pixels (a power of 2) of all four values passed
+    // to lcd_flush_rect. 0 if the panel can only be flushed as a whole.
+    unsigned int (*lcd_flush_rect_align)(void);
+    // optional: LK signals event using event_signal whenever the panel can
+    // take the next flush, on vsync or once the last flush finished. NULL
+    // stops it. returns 0 if LK will signal it, NULL if not supported.
+    int (*lcd_set_vsync_event)(void *event);
 } lkapi_t;
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef __LK_BLOCK_IO_STATS_H__
+#define __LK_BLOCK_IO_STATS_H__
+
+#include <Uefi/UefiSpec.h>
+
+#define EFI_LK_BLOCK_IO_STATS_PROTOCOL_GUID \
+  { \
+    0x5e1a7c93, 0x0d42, 0x4b8f, {0xa6, 0x3e, 0x91, 0x2c, 0x7b, 0x58, 0xd4, 0x0f } \
+  }
+
+typedef struct _EFI_LK_BLOCK_IO_STATS_PROTOCOL  EFI_LK_BLOCK_IO_STATS_PROTOCOL;
+
+//
+// Latency histogram: bucket 0 counts operations which took less than 1us,
+// bucket n counts the ones which took [2^(n-1), 2^n) us. The last bucket
+// also counts everything slower.
+//
+#define LK_BLOCK_IO_STATS_HISTOGRAM_BUCKETS 32
+
+typedef struct {
+  UINT64 Operations;
+  UINT64 Bytes;
+  UINT64 Errors;
+  UINT64 TotalTimeNs;
+  UINT64 Histogram[LK_BLOCK_IO_STATS_HISTOGRAM_BUCKETS];
+} LK_BLOCK_IO_OP_STATS;
+
+typedef struct {
+  // requests as issued by BlockIo/BlockIo2 callers
+  LK_BLOCK_IO_OP_STATS Read;
+  LK_BLOCK_IO_OP_STATS Write;
+  // transfers handed to LK, after caching and read-ahead
+  LK_BLOCK_IO_OP_STATS DeviceRead;
+  LK_BLOCK_IO_OP_STATS DeviceWrite;
+  // BlockIo2 requests which are queued in LK
+  UINT32 QueueDepth;
+  UINT32 MaxQueueDepth;
+} LK_BLOCK_IO_STATS;
+
+struct _EFI_LK_BLOCK_IO_STATS_PROTOCOL {
+  VOID (*GetStats)(EFI_LK_BLOCK_IO_STATS_PROTOCOL*, LK_BLOCK_IO_STATS*);
+  VOID (*ResetStats)(EFI_LK_BLOCK_IO_STATS_PROTOCOL*);
+};
+
+extern EFI_GUID gEfiLKBlockIoStatsProtocolGuid;
+
+#endif
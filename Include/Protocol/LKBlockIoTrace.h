@@ -0,0 +1,32 @@
+#ifndef __LK_BLOCK_IO_TRACE_H__
+#define __LK_BLOCK_IO_TRACE_H__
+
+#include <Uefi/UefiSpec.h>
+
+#define EFI_LK_BLOCK_IO_TRACE_PROTOCOL_GUID \
+  { \
+    0x8f2d64b1, 0x3a7e, 0x4c05, {0x9e, 0x18, 0x6b, 0xf0, 0x2d, 0x93, 0x5a, 0xc7 } \
+  }
+
+typedef struct _EFI_LK_BLOCK_IO_TRACE_PROTOCOL  EFI_LK_BLOCK_IO_TRACE_PROTOCOL;
+
+#define LK_BLOCK_IO_TRACE_READ  0
+#define LK_BLOCK_IO_TRACE_WRITE 1
+
+typedef struct {
+  UINT64 Lba;
+  UINT32 NumBlocks;
+  UINT32 Type;
+} LK_BLOCK_IO_TRACE_ENTRY;
+
+struct _EFI_LK_BLOCK_IO_TRACE_PROTOCOL {
+  // returns the number of recorded requests. Entries stays valid until ClearTrace.
+  UINTN   (*GetTrace)(EFI_LK_BLOCK_IO_TRACE_PROTOCOL*, LK_BLOCK_IO_TRACE_ENTRY **Entries);
+  VOID    (*ClearTrace)(EFI_LK_BLOCK_IO_TRACE_PROTOCOL*);
+  // returns the previous state
+  BOOLEAN (*SetTracing)(EFI_LK_BLOCK_IO_TRACE_PROTOCOL*, BOOLEAN);
+};
+
+extern EFI_GUID gEfiLKBlockIoTraceProtocolGuid;
+
+#endif
@@ -15,13 +15,26 @@ typedef enum {
   LK_DISPLAY_FLUSH_MODE_MANUAL,
 } LK_DISPLAY_FLUSH_MODE;
 
+typedef struct {
+  // flushes to the panel
+  UINT64 FlushCount;
+  // updates which got merged into a pending flush
+  UINT64 SkippedFrames;
+  // microseconds per flush, copying to VRAM included
+  UINT64 AverageCopyTime;
+} LK_DISPLAY_STATS;
+
 struct _EFI_LK_DISPLAY_PROTOCOL {
   UINT32 (*GetDensity)(EFI_LK_DISPLAY_PROTOCOL*);
   VOID   (*SetFlushMode)(EFI_LK_DISPLAY_PROTOCOL*, LK_DISPLAY_FLUSH_MODE);
   LK_DISPLAY_FLUSH_MODE (*GetFlushMode)(EFI_LK_DISPLAY_PROTOCOL*);
+  // pushes the whole framebuffer to the panel
   VOID   (*FlushScreen)(EFI_LK_DISPLAY_PROTOCOL*);
   UINT32 (*GetPortraitMode)(VOID);
   UINT32 (*GetLandscapeMode)(VOID);
+  // pushes the given part and what Blt changed since the last flush
+  VOID   (*FlushScreenRect)(EFI_LK_DISPLAY_PROTOCOL*, UINTN X, UINTN Y, UINTN Width, UINTN Height);
+  VOID   (*GetStats)(EFI_LK_DISPLAY_PROTOCOL*, LK_DISPLAY_STATS*);
 };
 
 extern EFI_GUID gEfiLKDisplayProtocolGuid;
@@ -0,0 +1,27 @@
+#ifndef __LK_RESET_NOTIFY_H__
+#define __LK_RESET_NOTIFY_H__
+
+#include <Uefi/UefiSpec.h>
+
+#define EFI_LK_RESET_NOTIFY_PROTOCOL_GUID \
+  { \
+    0x6d3b9e42, 0x1c58, 0x4f7a, {0xb2, 0x9d, 0x04, 0xe6, 0x8a, 0x3f, 0x71, 0xc5 } \
+  }
+
+typedef struct _EFI_LK_RESET_NOTIFY_PROTOCOL  EFI_LK_RESET_NOTIFY_PROTOCOL;
+
+//
+// Called by ResetSystem right before the platform gets reset, from within
+// the ResetSystem call and at the TPL of its caller. It isn't called if that
+// is above TPL_NOTIFY or after ExitBootServices. It can't rely on events
+// being dispatched but may use boot services otherwise.
+//
+typedef VOID (EFIAPI *LK_RESET_NOTIFY_FUNCTION)(VOID *Context);
+
+struct _EFI_LK_RESET_NOTIFY_PROTOCOL {
+  EFI_STATUS (*RegisterResetNotify)(EFI_LK_RESET_NOTIFY_PROTOCOL*, LK_RESET_NOTIFY_FUNCTION, VOID*);
+};
+
+extern EFI_GUID gEfiLKResetNotifyProtocolGuid;
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __LK_VARIABLE_STORE_H__
+#define __LK_VARIABLE_STORE_H__
+
+#include <Uefi/UefiSpec.h>
+
+#define EFI_LK_VARIABLE_STORE_PROTOCOL_GUID \
+  { \
+    0x3c9f1d2a, 0x7b64, 0x4e83, {0x8d, 0x05, 0xe2, 0x71, 0xa9, 0x4c, 0x16, 0xb8 } \
+  }
+
+typedef struct _EFI_LK_VARIABLE_STORE_PROTOCOL  EFI_LK_VARIABLE_STORE_PROTOCOL;
+
+//
+// Range of the store image which got written since the dirty ranges were
+// taken the last time. Ranges are sorted and don't overlap.
+//
+#define LK_VARIABLE_STORE_MAX_DIRTY_RANGES 32
+
+typedef struct {
+  UINTN Offset;
+  UINTN Length;
+} LK_VARIABLE_STORE_RANGE;
+
+struct _EFI_LK_VARIABLE_STORE_PROTOCOL {
+  // the raw image of the variable store (FV header, variable store header
+  // and the variables), as the variable driver writes it through the FVB
+  VOID  (*GetStore)(EFI_LK_VARIABLE_STORE_PROTOCOL*, VOID **Buffer, UINTN *Size);
+  // copies the dirty ranges to Ranges, which has room for
+  // LK_VARIABLE_STORE_MAX_DIRTY_RANGES entries, and forgets them.
+  // Returns the number of ranges.
+  UINTN (*TakeDirtyRanges)(EFI_LK_VARIABLE_STORE_PROTOCOL*, LK_VARIABLE_STORE_RANGE *Ranges);
+  // makes the writes after ExitBootServices go to the runtime log, as the
+  // continuation of the given generation of the NvVars log ending before
+  // NextLba. The dirty ranges go into it first. Returns EFI_UNSUPPORTED if
+  // there's no runtime log.
+  EFI_STATUS (*ArmRuntimeLog)(EFI_LK_VARIABLE_STORE_PROTOCOL*, UINT32 Generation, UINT64 NextLba);
+  // TRUE if there's a runtime log ArmRuntimeLog can hand the writes to
+  BOOLEAN (*HasRuntimeLog)(EFI_LK_VARIABLE_STORE_PROTOCOL*);
+};
+
+extern EFI_GUID gEfiLKVariableStoreProtocolGuid;
+
+#endif
@@ -0,0 +1,207 @@
+/** @file
+  CRC32 library
+
+  Uses the ARMv8 CRC32 instructions if ID_ISAR5/ID_AA64ISAR0 report them,
+  which is checked once. Otherwise falls back to slicing-by-8, which
+  consumes 8 bytes per step using eight 1KB tables built on first use.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <Base.h>
+
+#include <Library/Crc32Lib.h>
+
+#define CRC32_POLYNOMIAL  0xedb88320
+
+/**
+  Returns whether the CPU implements the CRC32 instructions.
+
+**/
+BOOLEAN
+EFIAPI
+InternalCrc32HwSupported (
+  VOID
+  );
+
+/**
+  Continues a CRC32 with the CRC32 instructions.
+
+  @param[in]  Crc - The CRC so far, not inverted
+  @param[in]  Buffer - The data
+  @param[in]  Size - Size of Buffer in bytes
+
+  @return     The CRC including Buffer, not inverted
+
+**/
+UINT32
+EFIAPI
+InternalCrc32HwUpdate (
+  IN  UINT32                           Crc,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  );
+
+typedef enum {
+  Crc32ImplUnknown,
+  Crc32ImplHw,
+  Crc32ImplTable
+} CRC32_IMPL;
+
+STATIC CRC32_IMPL   mCrc32Impl = Crc32ImplUnknown;
+STATIC UINT32       mCrc32Table[8][256];
+
+/**
+  Picks the implementation and builds the tables if they're needed.
+
+**/
+STATIC
+VOID
+Crc32Init (
+  VOID
+  )
+{
+  UINTN   Index;
+  UINTN   Slice;
+  UINTN   Bit;
+  UINT32  Value;
+
+  if (InternalCrc32HwSupported ()) {
+    mCrc32Impl = Crc32ImplHw;
+    return;
+  }
+
+  for (Index = 0; Index < 256; Index++) {
+    Value = (UINT32) Index;
+    for (Bit = 0; Bit < 8; Bit++) {
+      Value = (Value & 1) ? (Value >> 1) ^ CRC32_POLYNOMIAL : (Value >> 1);
+    }
+    mCrc32Table[0][Index] = Value;
+  }
+
+  //
+  // Table n advances a byte by n more zero bytes
+  //
+  for (Index = 0; Index < 256; Index++) {
+    Value = mCrc32Table[0][Index];
+    for (Slice = 1; Slice < 8; Slice++) {
+      Value = mCrc32Table[0][Value & 0xff] ^ (Value >> 8);
+      mCrc32Table[Slice][Index] = Value;
+    }
+  }
+
+  mCrc32Impl = Crc32ImplTable;
+}
+
+/**
+  Continues a CRC32 using slicing-by-8.
+
+  @param[in]  Crc - The CRC so far, not inverted
+  @param[in]  Buffer - The data
+  @param[in]  Size - Size of Buffer in bytes
+
+  @return     The CRC including Buffer, not inverted
+
+**/
+STATIC
+UINT32
+Crc32TableUpdate (
+  IN  UINT32                           Crc,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  )
+{
+  CONST UINT8   *Ptr;
+  UINT32        Low;
+  UINT32        High;
+
+  Ptr = Buffer;
+
+  while (Size != 0 && ((UINTN) Ptr & (sizeof (UINT32) - 1)) != 0) {
+    Crc = mCrc32Table[0][(Crc ^ *Ptr++) & 0xff] ^ (Crc >> 8);
+    Size--;
+  }
+
+  //
+  // The data is read as little endian words, like all our targets are
+  //
+  while (Size >= 8) {
+    Low  = *(CONST UINT32 *) Ptr ^ Crc;
+    High = *(CONST UINT32 *) (Ptr + 4);
+    Crc  = mCrc32Table[7][Low & 0xff] ^
+           mCrc32Table[6][(Low >> 8) & 0xff] ^
+           mCrc32Table[5][(Low >> 16) & 0xff] ^
+           mCrc32Table[4][Low >> 24] ^
+           mCrc32Table[3][High & 0xff] ^
+           mCrc32Table[2][(High >> 8) & 0xff] ^
+           mCrc32Table[1][(High >> 16) & 0xff] ^
+           mCrc32Table[0][High >> 24];
+    Ptr  += 8;
+    Size -= 8;
+  }
+
+  while (Size != 0) {
+    Crc = mCrc32Table[0][(Crc ^ *Ptr++) & 0xff] ^ (Crc >> 8);
+    Size--;
+  }
+
+  return Crc;
+}
+
+/**
+  Continues a CRC32 over more data.
+
+  Crc32Update (Crc32Update (0, A, SizeA), B, SizeB) is the CRC32 of A
+  followed by B.
+
+  @param[in]  Crc - The CRC32 of the data so far, 0 to start
+  @param[in]  Buffer - The data
+  @param[in]  Size - Size of Buffer in bytes
+
+  @return     The CRC32 including Buffer
+
+**/
+UINT32
+EFIAPI
+Crc32Update (
+  IN  UINT32                           Crc,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  )
+{
+  if (mCrc32Impl == Crc32ImplUnknown) {
+    Crc32Init ();
+  }
+
+  if (mCrc32Impl == Crc32ImplHw) {
+    return ~InternalCrc32HwUpdate (~Crc, Buffer, Size);
+  }
+
+  return ~Crc32TableUpdate (~Crc, Buffer, Size);
+}
+
+/**
+  Calculates the CRC32 of a buffer.
+
+  @param[in]  Buffer - The data
+  @param[in]  Size - Size of Buffer in bytes
+
+  @return     The CRC32 of Buffer
+
+**/
+UINT32
+EFIAPI
+Crc32Calculate (
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  )
+{
+  return Crc32Update (0, Buffer, Size);
+}
@@ -1,9 +1,12 @@
 #include <PiPei.h>
+#include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/HobLib.h>
+#include <Library/MemoryAllocationLib.h>
 #include <LittleKernel.h>
 
 STATIC lkapi_t* mLKApi = NULL;
+STATIC UINTN mLKApiSize = 0;
 
 /**
   Returns the pointer to the LK API
@@ -17,8 +20,8 @@ GetLKApi (
   VOID
   )
 {
-  VOID                *Hob;
-  CONST UINT64        *LKApiHobData;
+  VOID                    *Hob;
+  CONST LK_API_HOB_DATA   *LKApiHobData;
 
   if (mLKApi != NULL)
     return mLKApi;
@@ -29,10 +32,88 @@ GetLKApi (
   }
   LKApiHobData = GET_GUID_HOB_DATA (Hob);
 
-  mLKApi = (lkapi_t*)(UINTN)*LKApiHobData;
+  mLKApi = (lkapi_t*)(UINTN)LKApiHobData->Api;
   if (mLKApi == NULL) {
     return NULL;
   }
 
+  mLKApiSize = (UINTN)LKApiHobData->ApiSize;
+
   return mLKApi;
 }
+
+/**
+  Returns the size of the LK API structure LK provides.
+
+  @return The size of the LK API structure in bytes.
+
+**/
+UINTN
+EFIAPI
+GetLKApiSize (
+  VOID
+  )
+{
+  if (GetLKApi () == NULL) {
+    return 0;
+  }
+
+  return mLKApiSize;
+}
+
+/**
+  Returns LK's block devices. Members LK doesn't know about are NULL/0.
+
+  @param  Count       Returns the number of devices.
+
+  @return The devices, to be freed with FreePool, or NULL if there are none.
+
+**/
+lkapi_biodev_t *
+EFIAPI
+GetLKBioDevices (
+  OUT UINTN *Count
+  )
+{
+  lkapi_t             *LKApi;
+  INT32               LKCount;
+  UINTN               LKDeviceSize;
+  UINT8               *LKDevices;
+  lkapi_biodev_t      *Devices;
+  UINTN               Index;
+
+  *Count = 0;
+
+  LKApi = GetLKApi ();
+  LKCount = LKApi->bio_list (NULL);
+  if (LKCount <= 0) {
+    return NULL;
+  }
+
+  // bio_list fills in an array, so LK's entry size has to be used
+  LKDeviceSize = LKAPI_BIODEV_BASE_SIZE;
+  if (LKAPI_HAS_MEMBER (biodev_size) && LKApi->biodev_size >= LKAPI_BIODEV_BASE_SIZE) {
+    LKDeviceSize = LKApi->biodev_size;
+  }
+
+  LKDevices = AllocatePool (LKDeviceSize * LKCount);
+  Devices = AllocateZeroPool (sizeof (lkapi_biodev_t) * LKCount);
+  if (LKDevices == NULL || Devices == NULL) {
+    if (LKDevices != NULL) {
+      FreePool (LKDevices);
+    }
+    if (Devices != NULL) {
+      FreePool (Devices);
+    }
+    return NULL;
+  }
+
+  LKApi->bio_list ((lkapi_biodev_t*)LKDevices);
+  for (Index = 0; Index < (UINTN)LKCount; Index++) {
+    CopyMem (&Devices[Index], LKDevices + Index * LKDeviceSize, MIN (LKDeviceSize, sizeof (lkapi_biodev_t)));
+  }
+  FreePool (LKDevices);
+
+  *Count = LKCount;
+  return Devices;
+}
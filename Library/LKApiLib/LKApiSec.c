@@ -5,6 +5,8 @@
 
 // LIBLK functions
 extern lkapi_t* LKApiAddr;
+extern UINT32 LKApiMagic;
+extern UINT32 LKApiSize;
 
 /**
   Returns the pointer to the LK API
@@ -21,6 +23,26 @@ GetLKApi (
   return LKApiAddr;
 }
 
+/**
+  Returns the size of the LK API structure LK provides.
+
+  @return The size of the LK API structure in bytes.
+
+**/
+UINTN
+EFIAPI
+GetLKApiSize (
+  VOID
+  )
+{
+  // r1 and r2 are whatever LK left in them if it doesn't report the size
+  if (LKApiMagic != LKAPI_ABI_MAGIC || LKApiSize < LKAPI_BASE_SIZE) {
+    return LKAPI_BASE_SIZE;
+  }
+
+  return LKApiSize;
+}
+
 /**
   Updates the pointer to the LK API.
 
@@ -33,11 +55,12 @@ BuildLKApiHob (
   VOID
   )
 {
-  UINT64 *LKApiHobData;
+  LK_API_HOB_DATA *LKApiHobData;
 
   LKApiHobData = BuildGuidHob (&gLKApiAddrGuid, sizeof *LKApiHobData);
   ASSERT (LKApiHobData != NULL);
-  *LKApiHobData = (UINTN)LKApiAddr;
+  LKApiHobData->Api = (UINTN)LKApiAddr;
+  LKApiHobData->ApiSize = GetLKApiSize ();
 
   return EFI_SUCCESS;
 }
@@ -17,8 +17,146 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
 
-#define NVVARS_SIGNATURE SIGNATURE_32('n', 'v', 'i', 'o')
+//
+// Reads of large stores are split into chunks, so the checksum of one
+// chunk can be calculated while the next one is read
+//
+#define NVVARS_READ_CHUNK_SIZE  SIZE_256KB
+
+
+/**
+  Waits for a BlockIo2 request.
+
+  @param[in]  Token - The token the request was issued with
+
+  @return     The status of the request
+
+**/
+STATIC
+EFI_STATUS
+WaitForBlockIo2 (
+  IN  EFI_BLOCK_IO2_TOKEN              *Token
+  )
+{
+  UINTN                       Index;
+  EFI_STATUS                  Status;
+
+  Status = gBS->WaitForEvent (1, &Token->Event, &Index);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return Token->TransactionStatus;
+}
+
+
+/**
+  Reads the blocks of the NvVars data following the first one, and
+  continues the checksum over them.
+
+  Through BlockIo2 the next chunk is already being read while the checksum
+  of the current one is calculated.
+
+  @param[in]      BlockIo - The BlockIo to read from
+  @param[in]      Buffer - The buffer for all the data, holding the first block
+  @param[in]      ReadSize - Size of all the data, a multiple of the block size
+  @param[in]      CrcEnd - Offset in Buffer where the checksummed data ends
+  @param[in, out] Crc - The checksum of the data in the first block, returns
+                    the checksum of all of it
+
+  @return     EFI_STATUS based on the success or failure of the reads
+
+**/
+STATIC
+EFI_STATUS
+ReadNvVarsRemainder (
+  IN      EFI_BLOCK_IO_PROTOCOL        *BlockIo,
+  IN      UINT8                        *Buffer,
+  IN      UINTN                        ReadSize,
+  IN      UINTN                        CrcEnd,
+  IN OUT  UINT32                       *Crc
+  )
+{
+  EFI_STATUS                  Status;
+  UINTN                       BlockSize;
+  UINTN                       ChunkSize;
+  UINTN                       Offset;
+  UINTN                       Length;
+  UINTN                       NextOffset;
+  UINTN                       NextLength;
+  EFI_BLOCK_IO2_PROTOCOL      *BlockIo2;
+  EFI_BLOCK_IO2_TOKEN         Token;
+  EFI_TPL                     OldTpl;
+
+  BlockSize = BlockIo->Media->BlockSize;
+  ChunkSize = MAX (NVVARS_READ_CHUNK_SIZE - NVVARS_READ_CHUNK_SIZE % BlockSize, BlockSize);
+
+  //
+  // Waiting for a request is only possible at TPL_APPLICATION
+  //
+  BlockIo2 = mBlockIo2;
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  gBS->RestoreTPL (OldTpl);
+  if (OldTpl != TPL_APPLICATION || ReadSize - BlockSize <= ChunkSize) {
+    BlockIo2 = NULL;
+  }
+
+  Token.Event = NULL;
+  if (BlockIo2 != NULL) {
+    Status = gBS->CreateEvent (0, TPL_CALLBACK, NULL, NULL, &Token.Event);
+    if (EFI_ERROR (Status)) {
+      BlockIo2 = NULL;
+    }
+  }
+
+  Status = EFI_SUCCESS;
+  Offset = BlockSize;
+  Length = MIN (ChunkSize, ReadSize - Offset);
+  if (Length != 0 && BlockIo2 != NULL) {
+    Status = BlockIo2->ReadBlocksEx (
+                         BlockIo2, BlockIo->Media->MediaId, Offset / BlockSize,
+                         &Token, Length, Buffer + Offset
+                         );
+  }
+
+  while (!EFI_ERROR (Status) && Length != 0) {
+    if (BlockIo2 != NULL) {
+      Status = WaitForBlockIo2 (&Token);
+    } else {
+      Status = BlockIo->ReadBlocks (
+                          BlockIo, BlockIo->Media->MediaId, Offset / BlockSize,
+                          Length, Buffer + Offset
+                          );
+    }
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    NextOffset = Offset + Length;
+    NextLength = MIN (ChunkSize, ReadSize - NextOffset);
+    if (NextLength != 0 && BlockIo2 != NULL) {
+      Status = BlockIo2->ReadBlocksEx (
+                           BlockIo2, BlockIo->Media->MediaId, NextOffset / BlockSize,
+                           &Token, NextLength, Buffer + NextOffset
+                           );
+    }
+
+    if (Offset < CrcEnd) {
+      *Crc = Crc32Update (*Crc, Buffer + Offset, MIN (Length, CrcEnd - Offset));
+    }
+
+    Offset = NextOffset;
+    Length = NextLength;
+  }
+
+  if (Token.Event != NULL) {
+    gBS->CloseEvent (Token.Event);
+  }
+
+  return Status;
+}
 
 
 /**
@@ -37,7 +175,10 @@ ReadNvVars (
   EFI_STATUS                  Status;
   UINTN                       DataSize;
   UINTN                       ReadSize;
+  UINTN                       HeaderSize;
   VOID                        *FileContents;
+  VOID                        *NewContents;
+  VOID                        *Data;
   EFI_HANDLE                  SerializedVariables;
   UINT32                      *BufPtr32;
   UINT32                      Checksum;
@@ -62,41 +203,93 @@ ReadNvVars (
   }
   BufPtr32 = (UINT32*)FileContents;
 
-  // check signature
-  if (BufPtr32[0] != NVVARS_SIGNATURE) {
+  // log of the raw variable store
+  if (BufPtr32[0] == NVVARS_LOG_SIGNATURE) {
+    Status = ReadNvVarsLog (BlockIo, (NVVARS_LOG_HEADER*)FileContents);
+    FreePool (FileContents);
+    return Status;
+  }
+
+  // check signature, compressed data has a longer header
+  if (BufPtr32[0] == NVVARS_PACKED_SIGNATURE) {
+    if (((NVVARS_PACKED_HEADER*)FileContents)->Version != NVVARS_PACKED_VERSION) {
+      FreePool (FileContents);
+      return EFI_INCOMPATIBLE_VERSION;
+    }
+    HeaderSize = sizeof (NVVARS_PACKED_HEADER);
+  } else if (BufPtr32[0] == NVVARS_SIGNATURE) {
+    HeaderSize = sizeof(UINT32)*3;
+  } else {
     FreePool (FileContents);
     return EFI_UNSUPPORTED;
   }
 
   // get data size
   DataSize = BufPtr32[1];
-  ReadSize = ALIGN_VALUE(sizeof(UINT32)*3 + DataSize, BlockIo->Media->BlockSize);
-
-  // increase buffer size to fit all data
-  FreePool (FileContents);
-  FileContents = AllocatePool (ReadSize);
-  BufPtr32 = (UINT32*)FileContents;
-  if (FileContents == NULL) {
-    return EFI_OUT_OF_RESOURCES;
+  if ((UINT64)HeaderSize + DataSize >
+      MultU64x32 (BlockIo->Media->LastBlock + 1, BlockIo->Media->BlockSize)) {
+    FreePool (FileContents);
+    return EFI_VOLUME_CORRUPTED;
   }
+  ReadSize = ALIGN_VALUE(HeaderSize + DataSize, BlockIo->Media->BlockSize);
 
-  // read all data
-  Status = BlockIo->ReadBlocks(
+  // checksum the data of the first block right away
+  Checksum = Crc32Calculate (
+               (UINT8*)FileContents + HeaderSize,
+               MIN (DataSize, BlockIo->Media->BlockSize - HeaderSize)
+               );
+
+  // keep the first block and read only the rest behind it
+  if (ReadSize > BlockIo->Media->BlockSize) {
+    NewContents = ReallocatePool (BlockIo->Media->BlockSize, ReadSize, FileContents);
+    if (NewContents == NULL) {
+      FreePool (FileContents);
+      return EFI_OUT_OF_RESOURCES;
+    }
+    FileContents = NewContents;
+    BufPtr32 = (UINT32*)FileContents;
+
+    Status = ReadNvVarsRemainder (
                BlockIo,
-               BlockIo->Media->MediaId,
-               0,
+               FileContents,
                ReadSize,
-               FileContents
+               HeaderSize + DataSize,
+               &Checksum
                );
-  if (EFI_ERROR (Status)) {
-    FreePool (FileContents);
-    return Status;
+    if (EFI_ERROR (Status)) {
+      FreePool (FileContents);
+      return Status;
+    }
   }
 
   // verify data
-  Status = gBS->CalculateCrc32(FileContents + sizeof(UINT32)*3, DataSize, &Checksum);
-  if (EFI_ERROR(Status) || BufPtr32[2] != Checksum) {
-    return Status;
+  if (BufPtr32[2] != Checksum) {
+    FreePool (FileContents);
+    return EFI_CRC_ERROR;
+  }
+
+  // decompress data
+  Data = (UINT8*)FileContents + HeaderSize;
+  if (HeaderSize == sizeof (NVVARS_PACKED_HEADER)) {
+    DataSize = ((NVVARS_PACKED_HEADER*)FileContents)->DataSize;
+    Data = AllocatePool (DataSize);
+    if (Data == NULL) {
+      FreePool (FileContents);
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    Status = NvVarsDecompress (
+               (UINT8*)FileContents + HeaderSize,
+               BufPtr32[1],
+               Data,
+               DataSize
+               );
+    FreePool (FileContents);
+    FileContents = Data;
+    if (EFI_ERROR (Status)) {
+      FreePool (FileContents);
+      return Status;
+    }
   }
 
   DEBUG ((
@@ -107,7 +300,7 @@ ReadNvVars (
 
   Status = SerializeVariablesNewInstanceFromBuffer (
              &SerializedVariables,
-             FileContents + sizeof(UINT32)*3,
+             Data,
              DataSize
              );
   if (!RETURN_ERROR (Status)) {
@@ -221,7 +414,6 @@ LoadNvVarsFromBlockIo (
 }
 
 
-STATIC
 RETURN_STATUS
 EFIAPI
 IterateVariablesCallbackAddAllNvVariables (
@@ -255,6 +447,73 @@ IterateVariablesCallbackAddAllNvVariables (
 }
 
 
+/**
+  Replaces the serialized variables to be written by their compressed
+  form, if that takes fewer blocks.
+
+  @param[in]      BlockIo - The BlockIo which gets written
+  @param[in, out] Buffer - The NVVARS_SIGNATURE header and data, on return
+                    possibly a new buffer with a NVVARS_PACKED_HEADER
+  @param[in, out] BufferSize - The size of Buffer, a multiple of the block size
+
+**/
+STATIC
+VOID
+PackNvVars (
+  IN      EFI_BLOCK_IO_PROTOCOL        *BlockIo,
+  IN OUT  VOID                         **Buffer,
+  IN OUT  UINTN                        *BufferSize
+  )
+{
+  UINT32                      *BufPtr;
+  NVVARS_PACKED_HEADER        *Packed;
+  UINTN                       PackedSize;
+  UINTN                       Size;
+
+  if (*BufferSize <= BlockIo->Media->BlockSize) {
+    return;
+  }
+
+  //
+  // Only worth it if it saves at least one block
+  //
+  PackedSize = *BufferSize - BlockIo->Media->BlockSize;
+  Packed = AllocateZeroPool (PackedSize);
+  if (Packed == NULL) {
+    return;
+  }
+
+  BufPtr = (UINT32*)*Buffer;
+  Size = NvVarsCompress (
+           BufPtr + 3,
+           BufPtr[1],
+           Packed + 1,
+           PackedSize - sizeof (*Packed)
+           );
+  if (Size == 0) {
+    FreePool (Packed);
+    return;
+  }
+
+  Packed->Signature = NVVARS_PACKED_SIGNATURE;
+  Packed->Size = (UINT32)Size;
+  Packed->Checksum = Crc32Calculate (Packed + 1, Size);
+  Packed->Version = NVVARS_PACKED_VERSION;
+  Packed->DataSize = BufPtr[1];
+
+  DEBUG ((
+    EFI_D_INFO,
+    "FsAccess.c: Compressed %Lu bytes of NV Variables to %Lu\n",
+    (UINT64)BufPtr[1],
+    (UINT64)Size
+    ));
+
+  FreePool (*Buffer);
+  *Buffer = Packed;
+  *BufferSize = ALIGN_VALUE(sizeof (*Packed) + Size, BlockIo->Media->BlockSize);
+}
+
+
 /**
   Saves the non-volatile variables to the BlockIo interface.
 
@@ -273,61 +532,91 @@ SaveNvVarsToBlockIo (
   UINTN                       VariableDataSize;
   UINTN                       BufferSize;
   VOID                        *VariableData;
+  UINT32                      *BufPtr;
   EFI_HANDLE                  SerializedVariables;
 
-  SerializedVariables = NULL;
+  //
+  // Prefer appending the changes of the raw store to the log
+  //
+  Status = SaveNvVarsLogToBlockIo (BlockIo);
+  if (Status != EFI_UNSUPPORTED) {
+    if (!EFI_ERROR (Status)) {
+      SetNvVarsVariable();
+    }
+    return Status;
+  }
 
-  Status = SerializeVariablesNewInstance (&SerializedVariables);
+  //
+  // Size the variables first, so they can be serialized right behind the
+  // header of the block-aligned buffer which gets written
+  //
+  Status = SerializeVariablesNewInstanceInBuffer (&SerializedVariables, NULL, 0);
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
-  Status = SerializeVariablesIterateSystemVariables (
+  Status = IterateNvVariables (
              IterateVariablesCallbackAddAllNvVariables,
              (VOID*) SerializedVariables
              );
+  VariableDataSize = 0;
+  if (!EFI_ERROR (Status)) {
+    Status = SerializeVariablesToBuffer (SerializedVariables, NULL, &VariableDataSize);
+    if (Status == RETURN_BUFFER_TOO_SMALL) {
+      Status = EFI_SUCCESS;
+    }
+  }
+  SerializeVariablesFreeInstance (SerializedVariables);
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
-  VariableData = NULL;
-  VariableDataSize = 0;
-  BufferSize = 0;
-  Status = SerializeVariablesToBuffer (
-             SerializedVariables,
-             NULL,
-             &VariableDataSize
+  BufferSize = ALIGN_VALUE(sizeof(UINT32)*3 + VariableDataSize, BlockIo->Media->BlockSize);
+  VariableData = AllocateZeroPool (BufferSize);
+  if (VariableData == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = SerializeVariablesNewInstanceInBuffer (
+             &SerializedVariables,
+             (UINT8*)VariableData + sizeof(UINT32)*3,
+             BufferSize - sizeof(UINT32)*3
              );
-  if (Status == RETURN_BUFFER_TOO_SMALL) {
-    BufferSize = ALIGN_VALUE(sizeof(UINT32)*3 + VariableDataSize, BlockIo->Media->BlockSize);
-    VariableData = AllocatePool (BufferSize);
-    if (VariableData == NULL) {
-      Status = EFI_OUT_OF_RESOURCES;
-    } else {
-      UINT32* BufPtr = (UINT32*)VariableData;
-      BufPtr[0] = NVVARS_SIGNATURE;
-      BufPtr[1] = VariableDataSize;
-
-      Status = SerializeVariablesToBuffer (
-                 SerializedVariables,
-                 VariableData + sizeof(UINT32)*3,
-                 &VariableDataSize
-                 );
-
-      Status = gBS->CalculateCrc32(VariableData + sizeof(UINT32)*3, VariableDataSize, &BufPtr[2]);
-      if (EFI_ERROR(Status)) {
-        ASSERT(FALSE);
-        return Status;
-      }
-    }
+  if (EFI_ERROR (Status)) {
+    FreePool (VariableData);
+    return Status;
+  }
+
+  Status = IterateNvVariables (
+             IterateVariablesCallbackAddAllNvVariables,
+             (VOID*) SerializedVariables
+             );
+  if (!EFI_ERROR (Status)) {
+    VariableDataSize = BufferSize - sizeof(UINT32)*3;
+    Status = SerializeVariablesToBuffer (
+               SerializedVariables,
+               (UINT8*)VariableData + sizeof(UINT32)*3,
+               &VariableDataSize
+               );
+  }
+  if (!EFI_ERROR (Status)) {
+    BufPtr = (UINT32*)VariableData;
+    BufPtr[0] = NVVARS_SIGNATURE;
+    BufPtr[1] = (UINT32)VariableDataSize;
+    Status = SerializeVariablesGetCrc32 (SerializedVariables, &BufPtr[2]);
   }
 
   SerializeVariablesFreeInstance (SerializedVariables);
 
   if (EFI_ERROR (Status)) {
+    FreePool (VariableData);
     return Status;
   }
 
+  if (FeaturePcdGet (PcdNvVarsCompress)) {
+    PackNvVars (BlockIo, &VariableData, &BufferSize);
+  }
+
   WriteSize = BufferSize;
   Status = BlockIo->WriteBlocks(
                BlockIo,
@@ -336,20 +625,26 @@ SaveNvVarsToBlockIo (
                WriteSize,
                VariableData
                );
+  FreePool (VariableData);
+  if (!EFI_ERROR (Status)) {
+    //
+    // The device may cache writes. At ExitBootServices and reset that
+    // cache may already have been written back when we get here.
+    //
+    Status = BlockIo->FlushBlocks (BlockIo);
+  }
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
-  if (!EFI_ERROR (Status)) {
-    //
-    // Write a variable to indicate we've already loaded the
-    // variable data.  If it is found, we skip the loading on
-    // subsequent attempts.
-    //
-    SetNvVarsVariable();
+  //
+  // Write a variable to indicate we've already loaded the
+  // variable data.  If it is found, we skip the loading on
+  // subsequent attempts.
+  //
+  SetNvVarsVariable();
 
-    DEBUG ((EFI_D_INFO, "Saved NV Variables to NvVars BlockIo\n"));
-  }
+  DEBUG ((EFI_D_INFO, "Saved NV Variables to NvVars BlockIo\n"));
 
   return Status;
 
@@ -18,6 +18,7 @@
 
 EFI_HANDLE            mNvVarsLibBlockIoHandle = NULL;
 EFI_BLOCK_IO_PROTOCOL *mBlockIo = NULL;
+EFI_BLOCK_IO2_PROTOCOL *mBlockIo2 = NULL;
 
 
 /**
@@ -50,6 +51,13 @@ ConnectNvVarsToBlockIo (
     return Status;
   }
 
+  //
+  // Used to overlap reads with checksumming, if the device has it
+  //
+  if (EFI_ERROR (gBS->HandleProtocol (BlockIoHandle, &gEfiBlockIo2ProtocolGuid, (VOID **)&mBlockIo2))) {
+    mBlockIo2 = NULL;
+  }
+
   //
   // We might fail to load the variable, since the BlockIo initially
   // will contain valid NvVars data.
@@ -63,6 +71,7 @@ ConnectNvVarsToBlockIo (
   Status = SaveNvVarsToBlockIo (mBlockIo);
   if (!EFI_ERROR (Status)) {
     mNvVarsLibBlockIoHandle = BlockIoHandle;
+    NvVarsWriteBackInit ();
   }
 
   return Status;
@@ -89,6 +98,7 @@ WriteNvVarsToBlockIo (
     //
     return EFI_NOT_STARTED;
   } else {
+    NvVarsWriteBackCancel ();
     return SaveNvVarsToBlockIo (mBlockIo);
   }
 }
@@ -17,14 +17,41 @@
 
 #include <Uefi.h>
 
+#include <Pi/PiFirmwareVolume.h>
+
+#include <Guid/VariableFormat.h>
+
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+#include <Protocol/LKResetNotify.h>
+#include <Protocol/LKVariableStore.h>
 
 #include <Library/BaseLib.h>
+#include <Library/Crc32Lib.h>
+#include <Library/NvVarsLogLib.h>
 #include <Library/SerializeVariablesLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
 #include <Library/UefiLib.h>
 
+#define NVVARS_SIGNATURE SIGNATURE_32('n', 'v', 'i', 'o')
+#define NVVARS_PACKED_SIGNATURE SIGNATURE_32('n', 'v', 'p', 'k')
+
+#define NVVARS_PACKED_VERSION 1
+
+//
+// Header at LBA 0 if the device holds compressed serialized variables.
+// The first fields match the NVVARS_SIGNATURE header, Size and Checksum
+// are of the compressed data following the header.
+//
+typedef struct {
+  UINT32  Signature;
+  UINT32  Size;
+  UINT32  Checksum;
+  UINT32  Version;
+  UINT32  DataSize;
+} NVVARS_PACKED_HEADER;
+
 /**
   Loads the non-volatile variables from the BlockIo interface.
 
@@ -52,5 +79,204 @@ SaveNvVarsToBlockIo (
   EFI_BLOCK_IO_PROTOCOL                            *BlockIo
   );
 
+
+/**
+  Adds a variable to a serialization instance if it's non-volatile.
+
+  Matches VARIABLE_SERIALIZATION_ITERATION_CALLBACK, Context is the
+  serialization instance.
+
+**/
+RETURN_STATUS
+EFIAPI
+IterateVariablesCallbackAddAllNvVariables (
+  IN  VOID                         *Context,
+  IN  CHAR16                       *VariableName,
+  IN  EFI_GUID                     *VendorGuid,
+  IN  UINT32                       Attributes,
+  IN  UINTN                        DataSize,
+  IN  VOID                         *Data
+  );
+
+
+/**
+  Calls a function for every valid variable in a raw variable store image.
+
+  @param[in]  Image - The image, starting with the FV header
+  @param[in]  ImageSize - Size of the image in bytes
+  @param[in]  CallbackFunction - Function called for every variable
+  @param[in]  Context - Passed to CallbackFunction
+
+  @retval     EFI_SUCCESS - All variables were visited
+  @retval     EFI_VOLUME_CORRUPTED - The image doesn't hold a variable store
+  @return     Errors returned by CallbackFunction
+
+**/
+EFI_STATUS
+IterateVariableStoreImage (
+  IN  VOID                                       *Image,
+  IN  UINTN                                      ImageSize,
+  IN  VARIABLE_SERIALIZATION_ITERATION_CALLBACK  CallbackFunction,
+  IN  VOID                                       *Context
+  );
+
+
+/**
+  Compresses a buffer.
+
+  @param[in]  Source - The data to compress
+  @param[in]  SourceSize - Size of Source in bytes
+  @param[out] Destination - Receives the compressed data
+  @param[in]  DestinationSize - Size of Destination in bytes
+
+  @return     Size of the compressed data, 0 if it doesn't fit Destination
+              or there's not enough memory
+
+**/
+UINTN
+NvVarsCompress (
+  IN  CONST VOID                       *Source,
+  IN  UINTN                            SourceSize,
+  OUT VOID                             *Destination,
+  IN  UINTN                            DestinationSize
+  );
+
+
+/**
+  Decompresses a buffer compressed by NvVarsCompress.
+
+  @param[in]  Source - The compressed data
+  @param[in]  SourceSize - Size of Source in bytes
+  @param[out] Destination - Receives the data
+  @param[in]  DestinationSize - Size of the data in bytes
+
+  @retval     EFI_SUCCESS - Destination was filled
+  @retval     EFI_VOLUME_CORRUPTED - Source is malformed or doesn't decompress
+                to exactly DestinationSize bytes
+
+**/
+EFI_STATUS
+NvVarsDecompress (
+  IN  CONST VOID                       *Source,
+  IN  UINTN                            SourceSize,
+  OUT VOID                             *Destination,
+  IN  UINTN                            DestinationSize
+  );
+
+
+/**
+  Calls a function for every non-volatile variable, walking the variable
+  store directly if possible.
+
+  @param[in]  CallbackFunction - Function called for every variable
+  @param[in]  Context - Passed to CallbackFunction
+
+  @return     EFI_STATUS based on the success or failure of the iteration
+
+**/
+EFI_STATUS
+IterateNvVariables (
+  IN  VARIABLE_SERIALIZATION_ITERATION_CALLBACK  CallbackFunction,
+  IN  VOID                                       *Context
+  );
+
+
+/**
+  Sets the variables found in a raw variable store image.
+
+  @param[in]  Image - The image, starting with the FV header
+  @param[in]  ImageSize - Size of the image in bytes
+
+  @return     EFI_STATUS based on the success or failure of the restore
+
+**/
+EFI_STATUS
+RestoreVariableStoreImage (
+  IN  VOID                             *Image,
+  IN  UINTN                            ImageSize
+  );
+
+
+/**
+  Replays the log and restores the variables.
+
+  @param[in]  BlockIo - The BlockIo to read from
+  @param[in]  Header - The header read from LBA 0
+
+  @return     EFI_STATUS based on the success or failure of the restore
+
+**/
+EFI_STATUS
+ReadNvVarsLog (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo,
+  IN  NVVARS_LOG_HEADER                *Header
+  );
+
+
+/**
+  Appends the changes since the last save to the log on the device,
+  compacting it if it's full.
+
+  @param[in]  BlockIo - The BlockIo to write to
+
+  @retval     EFI_SUCCESS - The log on the device is up to date
+  @retval     EFI_UNSUPPORTED - There's no variable store to save or it
+                doesn't fit, the variables have to be serialized instead
+  @return     Other errors of the device
+
+**/
+EFI_STATUS
+SaveNvVarsLogToBlockIo (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo
+  );
+
+
+/**
+  Tells whether NvVarsLogArmRuntimeLog will hand the writes after
+  ExitBootServices, and the ones not saved yet, to the runtime log.
+
+**/
+BOOLEAN
+NvVarsLogCanArmRuntimeLog (
+  VOID
+  );
+
+
+/**
+  Lets the writes to the variable store after ExitBootServices continue
+  the log on the device through the runtime log, if it's up to date.
+
+**/
+VOID
+NvVarsLogArmRuntimeLog (
+  VOID
+  );
+
+
+/**
+  Sets up the deferred write-back once a device has been connected.
+
+**/
+VOID
+NvVarsWriteBackInit (
+  VOID
+  );
+
+
+/**
+  Drops pending updates because the caller is writing the variables right
+  now.
+
+**/
+VOID
+NvVarsWriteBackCancel (
+  VOID
+  );
+
+
+extern EFI_HANDLE            mNvVarsLibBlockIoHandle;
+extern EFI_BLOCK_IO_PROTOCOL *mBlockIo;
+extern EFI_BLOCK_IO2_PROTOCOL *mBlockIo2;
+
 #endif
 
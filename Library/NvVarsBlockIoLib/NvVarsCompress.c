@@ -0,0 +1,328 @@
+/** @file
+  LZ compression of the serialized variables
+
+  Uses the LZ4 block format: every sequence is a token, literals and a
+  16 bit match offset. It compresses variable names, GUIDs and device
+  paths well, and decompressing it is hardly more than copying.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "NvVarsBlockIoLib.h"
+
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       0xffff
+#define LZ_HASH_BITS        12
+
+//
+// The format requires the last 5 bytes to be literals, and the last match
+// to start at least 12 bytes before the end
+//
+#define LZ_LAST_LITERALS    5
+#define LZ_MATCH_LIMIT      12
+
+#define LZ_HASH(Value)      (((Value) * 2654435761U) >> (32 - LZ_HASH_BITS))
+
+
+/**
+  Writes a length which didn't fit its 4 bits of the token.
+
+  @param[in]  Out - Where to write to
+  @param[in]  Length - The length minus 15
+
+  @return     The position following the written bytes
+
+**/
+STATIC
+UINT8 *
+LzWriteLength (
+  IN  UINT8                            *Out,
+  IN  UINTN                            Length
+  )
+{
+  while (Length >= 255) {
+    *Out++ = 255;
+    Length -= 255;
+  }
+  *Out++ = (UINT8) Length;
+
+  return Out;
+}
+
+
+/**
+  Writes a sequence of literals, optionally followed by a match.
+
+  @param[in]  Out - Where to write to
+  @param[in]  OutEnd - End of the output buffer
+  @param[in]  Literals - The literals
+  @param[in]  LiteralLength - Number of literals
+  @param[in]  Offset - Distance of the match, ignored without a match
+  @param[in]  MatchLength - Length of the match, 0 for the last sequence
+
+  @return     The position following the sequence, or NULL if it doesn't fit
+
+**/
+STATIC
+UINT8 *
+LzWriteSequence (
+  IN  UINT8                            *Out,
+  IN  UINT8                            *OutEnd,
+  IN  CONST UINT8                      *Literals,
+  IN  UINTN                            LiteralLength,
+  IN  UINTN                            Offset,
+  IN  UINTN                            MatchLength
+  )
+{
+  UINT8                       *Token;
+  UINTN                       Needed;
+
+  Needed = 1 + LiteralLength + LiteralLength / 255 + 1;
+  if (MatchLength != 0) {
+    Needed += 2 + MatchLength / 255 + 1;
+  }
+  if (Needed > (UINTN) (OutEnd - Out)) {
+    return NULL;
+  }
+
+  Token = Out++;
+  if (LiteralLength >= 15) {
+    *Token = 15 << 4;
+    Out = LzWriteLength (Out, LiteralLength - 15);
+  } else {
+    *Token = (UINT8) (LiteralLength << 4);
+  }
+
+  CopyMem (Out, Literals, LiteralLength);
+  Out += LiteralLength;
+
+  if (MatchLength != 0) {
+    *Out++ = (UINT8) Offset;
+    *Out++ = (UINT8) (Offset >> 8);
+
+    MatchLength -= LZ_MIN_MATCH;
+    if (MatchLength >= 15) {
+      *Token |= 15;
+      Out = LzWriteLength (Out, MatchLength - 15);
+    } else {
+      *Token |= (UINT8) MatchLength;
+    }
+  }
+
+  return Out;
+}
+
+
+/**
+  Compresses a buffer.
+
+  @param[in]  Source - The data to compress
+  @param[in]  SourceSize - Size of Source in bytes
+  @param[out] Destination - Receives the compressed data
+  @param[in]  DestinationSize - Size of Destination in bytes
+
+  @return     Size of the compressed data, 0 if it doesn't fit Destination
+              or there's not enough memory
+
+**/
+UINTN
+NvVarsCompress (
+  IN  CONST VOID                       *Source,
+  IN  UINTN                            SourceSize,
+  OUT VOID                             *Destination,
+  IN  UINTN                            DestinationSize
+  )
+{
+  CONST UINT8                 *In;
+  UINT8                       *Out;
+  UINT8                       *OutEnd;
+  UINT32                      *HashTable;
+  UINTN                       Anchor;
+  UINTN                       Pos;
+  UINTN                       Candidate;
+  UINTN                       Length;
+  UINT32                      Value;
+  UINT32                      Hash;
+
+  In = Source;
+  Out = Destination;
+  OutEnd = Out + DestinationSize;
+  Anchor = 0;
+
+  if (SourceSize > MAX_UINT32) {
+    return 0;
+  }
+
+  //
+  // Positions are stored plus one, so a zero entry is empty
+  //
+  HashTable = AllocateZeroPool (sizeof (UINT32) << LZ_HASH_BITS);
+  if (HashTable == NULL) {
+    return 0;
+  }
+
+  Pos = 0;
+  while (SourceSize > LZ_MATCH_LIMIT && Pos < SourceSize - LZ_MATCH_LIMIT) {
+    Value = ReadUnaligned32 ((CONST UINT32 *) (In + Pos));
+    Hash = LZ_HASH (Value);
+    Candidate = HashTable[Hash];
+    HashTable[Hash] = (UINT32) Pos + 1;
+
+    if (Candidate == 0 ||
+        Pos - (Candidate - 1) > LZ_MAX_OFFSET ||
+        ReadUnaligned32 ((CONST UINT32 *) (In + Candidate - 1)) != Value) {
+      Pos++;
+      continue;
+    }
+    Candidate--;
+
+    while (Pos > Anchor && Candidate > 0 && In[Pos - 1] == In[Candidate - 1]) {
+      Pos--;
+      Candidate--;
+    }
+
+    Length = LZ_MIN_MATCH;
+    while (Pos + Length < SourceSize - LZ_LAST_LITERALS &&
+           In[Pos + Length] == In[Candidate + Length]) {
+      Length++;
+    }
+
+    Out = LzWriteSequence (Out, OutEnd, In + Anchor, Pos - Anchor, Pos - Candidate, Length);
+    if (Out == NULL) {
+      FreePool (HashTable);
+      return 0;
+    }
+
+    Pos += Length;
+    Anchor = Pos;
+  }
+
+  FreePool (HashTable);
+
+  Out = LzWriteSequence (Out, OutEnd, In + Anchor, SourceSize - Anchor, 0, 0);
+  if (Out == NULL) {
+    return 0;
+  }
+
+  return Out - (UINT8 *) Destination;
+}
+
+
+/**
+  Decompresses a buffer compressed by NvVarsCompress.
+
+  @param[in]  Source - The compressed data
+  @param[in]  SourceSize - Size of Source in bytes
+  @param[out] Destination - Receives the data
+  @param[in]  DestinationSize - Size of the data in bytes
+
+  @retval     EFI_SUCCESS - Destination was filled
+  @retval     EFI_VOLUME_CORRUPTED - Source is malformed or doesn't decompress
+                to exactly DestinationSize bytes
+
+**/
+EFI_STATUS
+NvVarsDecompress (
+  IN  CONST VOID                       *Source,
+  IN  UINTN                            SourceSize,
+  OUT VOID                             *Destination,
+  IN  UINTN                            DestinationSize
+  )
+{
+  CONST UINT8                 *In;
+  CONST UINT8                 *InEnd;
+  UINT8                       *Out;
+  UINT8                       *OutEnd;
+  UINT8                       Token;
+  UINT8                       Byte;
+  UINTN                       Length;
+  UINTN                       Offset;
+
+  In = Source;
+  InEnd = In + SourceSize;
+  Out = Destination;
+  OutEnd = Out + DestinationSize;
+
+  while (In < InEnd) {
+    Token = *In++;
+
+    Length = Token >> 4;
+    if (Length == 15) {
+      do {
+        if (In == InEnd) {
+          return EFI_VOLUME_CORRUPTED;
+        }
+        Byte = *In++;
+        Length += Byte;
+      } while (Byte == 255);
+    }
+
+    if (Length > (UINTN) (InEnd - In) || Length > (UINTN) (OutEnd - Out)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    CopyMem (Out, In, Length);
+    In += Length;
+    Out += Length;
+
+    //
+    // The last sequence has no match
+    //
+    if (In == InEnd) {
+      break;
+    }
+
+    if (InEnd - In < 2) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    Offset = In[0] | (In[1] << 8);
+    In += 2;
+    if (Offset == 0 || Offset > (UINTN) (Out - (UINT8 *) Destination)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Length = Token & 15;
+    if (Length == 15) {
+      do {
+        if (In == InEnd) {
+          return EFI_VOLUME_CORRUPTED;
+        }
+        Byte = *In++;
+        Length += Byte;
+      } while (Byte == 255);
+    }
+    Length += LZ_MIN_MATCH;
+
+    if (Length > (UINTN) (OutEnd - Out)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    if (Offset >= Length) {
+      CopyMem (Out, Out - Offset, Length);
+      Out += Length;
+    } else {
+      //
+      // The match overlaps the bytes it produces, a run
+      //
+      while (Length-- != 0) {
+        *Out = *(Out - Offset);
+        Out++;
+      }
+    }
+  }
+
+  if (Out != OutEnd) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,429 @@
+/** @file
+  Append-only NvVars log
+
+  The device holds a log of changes to the raw variable store image instead
+  of a single blob which gets rewritten on every save:
+
+    LBA 0   NVVARS_LOG_HEADER, padded to a block
+    LBA 1   log area, split into two halves
+
+  Every record starts on a block boundary and consists of NVVARS_LOG_RECORD,
+  a table of NVVARS_LOG_RANGEs and the bytes of those ranges. It is covered
+  by a CRC32. A save appends one record holding the ranges the FVB driver
+  reported as dirty, so its cost is proportional to the change and the
+  writes move across the whole log area.
+
+  The active half starts with a snapshot, a record covering the whole image.
+  When a record doesn't fit anymore the log is compacted: a new snapshot
+  with the next generation number is written to the other half, then the
+  header gets switched over to it. If that gets interrupted the old half is
+  still intact. Replay applies the records of the header's generation in
+  order and stops at the first one which doesn't check out, which at worst
+  loses the last save.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "NvVarsBlockIoLib.h"
+
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
+
+//
+// State of the log on the device. Until the first save of a boot has
+// written a snapshot the records can't be appended to, since the variables
+// have been restored into a store with a different layout.
+//
+STATIC BOOLEAN                mLogValid = FALSE;
+STATIC UINT32                 mLogGeneration = 0;
+STATIC EFI_LBA                mLogActiveLba = 0;
+STATIC EFI_LBA                mLogNextLba = 0;
+
+
+/**
+  Returns the number of blocks of each log half.
+
+  @param[in]  BlockIo - The device
+
+**/
+STATIC
+UINTN
+NvVarsLogHalfBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo
+  )
+{
+  UINT64                      AreaBlocks;
+
+  AreaBlocks = BlockIo->Media->LastBlock;
+  if (PcdGet32 (PcdNvVarsLogSize) != 0) {
+    AreaBlocks = MIN (AreaBlocks, PcdGet32 (PcdNvVarsLogSize) / BlockIo->Media->BlockSize);
+  }
+
+  return (UINTN) (AreaBlocks / 2);
+}
+
+
+/**
+  Replays the log and restores the variables.
+
+  @param[in]  BlockIo - The BlockIo to read from
+  @param[in]  Header - The header read from LBA 0
+
+  @return     EFI_STATUS based on the success or failure of the restore
+
+**/
+EFI_STATUS
+ReadNvVarsLog (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo,
+  IN  NVVARS_LOG_HEADER                *Header
+  )
+{
+  EFI_STATUS                  Status;
+  VOID                        *Image;
+
+  if (Header->ImageSize == 0) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Image = AllocatePool (Header->ImageSize);
+  if (Image == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = NvVarsLogReplay (BlockIo, Header, Image, NULL);
+  if (!EFI_ERROR (Status)) {
+    Status = RestoreVariableStoreImage (Image, Header->ImageSize);
+  }
+
+  FreePool (Image);
+
+  return Status;
+}
+
+
+/**
+  Appends a record to the log.
+
+  @param[in]  BlockIo - The BlockIo to write to
+  @param[in]  Lba - Where the record goes
+  @param[in]  Image - The variable store image
+  @param[in]  Ranges - The ranges of Image to put into the record
+  @param[in]  Count - The number of ranges
+  @param[out] Blocks - Returns the number of blocks the record took
+
+  @return     EFI_STATUS based on the success or failure of the write
+
+**/
+STATIC
+EFI_STATUS
+NvVarsLogWriteRecord (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo,
+  IN  EFI_LBA                          Lba,
+  IN  UINT8                            *Image,
+  IN  LK_VARIABLE_STORE_RANGE          *Ranges,
+  IN  UINTN                            Count,
+  OUT UINTN                            *Blocks
+  )
+{
+  EFI_STATUS                  Status;
+  UINTN                       DataSize;
+  UINTN                       RecordSize;
+  UINTN                       Index;
+  UINT8                       *Record;
+  NVVARS_LOG_RECORD           *RecordHeader;
+  NVVARS_LOG_RANGE            *RecordRanges;
+  UINT8                       *Data;
+
+  DataSize = 0;
+  for (Index = 0; Index < Count; Index++) {
+    DataSize += Ranges[Index].Length;
+  }
+
+  RecordSize = sizeof (NVVARS_LOG_RECORD) + Count * sizeof (NVVARS_LOG_RANGE) + DataSize;
+  *Blocks = ALIGN_VALUE (RecordSize, BlockIo->Media->BlockSize) / BlockIo->Media->BlockSize;
+
+  Record = AllocateZeroPool (*Blocks * BlockIo->Media->BlockSize);
+  if (Record == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  RecordHeader = (NVVARS_LOG_RECORD*) Record;
+  RecordHeader->Signature = NVVARS_LOG_RECORD_SIGNATURE;
+  RecordHeader->Generation = mLogGeneration;
+  RecordHeader->RangeCount = (UINT32) Count;
+  RecordHeader->DataSize = (UINT32) DataSize;
+
+  RecordRanges = (NVVARS_LOG_RANGE*) (RecordHeader + 1);
+  Data = (UINT8*) (RecordRanges + Count);
+  for (Index = 0; Index < Count; Index++) {
+    RecordRanges[Index].Offset = (UINT32) Ranges[Index].Offset;
+    RecordRanges[Index].Length = (UINT32) Ranges[Index].Length;
+    CopyMem (Data, Image + Ranges[Index].Offset, Ranges[Index].Length);
+    Data += Ranges[Index].Length;
+  }
+
+  RecordHeader->Checksum = NvVarsLogChecksum (Record, RecordSize, &RecordHeader->Checksum);
+
+  Status = BlockIo->WriteBlocks (
+             BlockIo,
+             BlockIo->Media->MediaId,
+             Lba,
+             *Blocks * BlockIo->Media->BlockSize,
+             Record
+             );
+
+  FreePool (Record);
+
+  return Status;
+}
+
+
+/**
+  Starts a new log generation in the other half with a snapshot of the
+  whole image.
+
+  @param[in]  BlockIo - The BlockIo to write to
+  @param[in]  Image - The variable store image
+  @param[in]  ImageSize - Size of the image in bytes
+  @param[in]  HalfBlocks - Number of blocks of each log half
+
+  @return     EFI_STATUS based on the success or failure of the write
+
+**/
+STATIC
+EFI_STATUS
+NvVarsLogCompact (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo,
+  IN  UINT8                            *Image,
+  IN  UINTN                            ImageSize,
+  IN  UINTN                            HalfBlocks
+  )
+{
+  EFI_STATUS                  Status;
+  NVVARS_LOG_HEADER           *Header;
+  LK_VARIABLE_STORE_RANGE     Snapshot;
+  EFI_LBA                     NewActiveLba;
+  UINTN                       Blocks;
+
+  Header = AllocateZeroPool (BlockIo->Media->BlockSize);
+  if (Header == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Continue the generations of the log on the device, if there's one
+  //
+  if (!mLogValid) {
+    Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, 0, BlockIo->Media->BlockSize, Header);
+    if (!EFI_ERROR (Status) &&
+        Header->Signature == NVVARS_LOG_SIGNATURE &&
+        Header->Checksum == NvVarsLogChecksum (Header, sizeof (*Header), &Header->Checksum)) {
+      mLogGeneration = Header->Generation;
+      mLogActiveLba = Header->ActiveLba;
+    } else {
+      mLogActiveLba = 0;
+    }
+  }
+
+  mLogValid = FALSE;
+  mLogGeneration++;
+  NewActiveLba = (mLogActiveLba == 1) ? 1 + HalfBlocks : 1;
+
+  Snapshot.Offset = 0;
+  Snapshot.Length = ImageSize;
+  Status = NvVarsLogWriteRecord (BlockIo, NewActiveLba, Image, &Snapshot, 1, &Blocks);
+  if (EFI_ERROR (Status)) {
+    FreePool (Header);
+    return Status;
+  }
+
+  //
+  // The snapshot has to be on the device before the header points to it
+  //
+  Status = BlockIo->FlushBlocks (BlockIo);
+  if (EFI_ERROR (Status)) {
+    FreePool (Header);
+    return Status;
+  }
+
+  ZeroMem (Header, BlockIo->Media->BlockSize);
+  Header->Signature = NVVARS_LOG_SIGNATURE;
+  Header->Generation = mLogGeneration;
+  Header->ImageSize = (UINT32) ImageSize;
+  Header->ActiveLba = (UINT32) NewActiveLba;
+  Header->HalfBlocks = (UINT32) HalfBlocks;
+  Header->Checksum = NvVarsLogChecksum (Header, sizeof (*Header), &Header->Checksum);
+
+  Status = BlockIo->WriteBlocks (BlockIo, BlockIo->Media->MediaId, 0, BlockIo->Media->BlockSize, Header);
+  FreePool (Header);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  mLogValid = TRUE;
+  mLogActiveLba = NewActiveLba;
+  mLogNextLba = NewActiveLba + Blocks;
+
+  DEBUG ((EFI_D_INFO, "NvVars: compacted the log into generation %u at LBA %Lu\n",
+    mLogGeneration, (UINT64) NewActiveLba));
+
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Appends the changes since the last save to the log on the device,
+  compacting it if it's full.
+
+  @param[in]  BlockIo - The BlockIo to write to
+
+  @retval     EFI_SUCCESS - The log on the device is up to date
+  @retval     EFI_UNSUPPORTED - There's no variable store to save or it
+                doesn't fit, the variables have to be serialized instead
+  @return     Other errors of the device
+
+**/
+EFI_STATUS
+SaveNvVarsLogToBlockIo (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_LK_VARIABLE_STORE_PROTOCOL  *VariableStore;
+  LK_VARIABLE_STORE_RANGE         Ranges[LK_VARIABLE_STORE_MAX_DIRTY_RANGES];
+  UINTN                           Count;
+  UINTN                           Index;
+  UINT8                           *Image;
+  UINTN                           ImageSize;
+  UINTN                           BlockSize;
+  UINTN                           HalfBlocks;
+  UINTN                           RecordSize;
+  UINTN                           Blocks;
+
+  Status = gBS->LocateProtocol (&gEfiLKVariableStoreProtocolGuid, NULL, (VOID**) &VariableStore);
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  VariableStore->GetStore (VariableStore, (VOID**) &Image, &ImageSize);
+
+  //
+  // A half has to hold at least the snapshot
+  //
+  BlockSize = BlockIo->Media->BlockSize;
+  HalfBlocks = NvVarsLogHalfBlocks (BlockIo);
+  RecordSize = sizeof (NVVARS_LOG_RECORD) + sizeof (NVVARS_LOG_RANGE) + ImageSize;
+  if (ALIGN_VALUE (RecordSize, BlockSize) / BlockSize > HalfBlocks) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Count = VariableStore->TakeDirtyRanges (VariableStore, Ranges);
+
+  if (!mLogValid) {
+    Status = NvVarsLogCompact (BlockIo, Image, ImageSize, HalfBlocks);
+  } else if (Count == 0) {
+    return EFI_SUCCESS;
+  } else {
+    RecordSize = sizeof (NVVARS_LOG_RECORD) + Count * sizeof (NVVARS_LOG_RANGE);
+    for (Index = 0; Index < Count; Index++) {
+      RecordSize += Ranges[Index].Length;
+    }
+
+    if (mLogNextLba + ALIGN_VALUE (RecordSize, BlockSize) / BlockSize > mLogActiveLba + HalfBlocks) {
+      Status = NvVarsLogCompact (BlockIo, Image, ImageSize, HalfBlocks);
+    } else {
+      Status = NvVarsLogWriteRecord (BlockIo, mLogNextLba, Image, Ranges, Count, &Blocks);
+      if (!EFI_ERROR (Status)) {
+        mLogNextLba += Blocks;
+        DEBUG ((EFI_D_INFO, "NvVars: appended %Lu bytes to the log\n", (UINT64) Blocks * BlockSize));
+      } else {
+        //
+        // The ranges are gone, start over with a snapshot next time
+        //
+        mLogValid = FALSE;
+      }
+    }
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = BlockIo->FlushBlocks (BlockIo);
+    if (EFI_ERROR (Status)) {
+      mLogValid = FALSE;
+    }
+  }
+
+  return Status;
+}
+
+
+/**
+  Tells whether NvVarsLogArmRuntimeLog will hand the writes after
+  ExitBootServices, and the ones not saved yet, to the runtime log.
+
+  @retval     TRUE - The log on the device is up to date and there's a
+                runtime log to continue it
+  @retval     FALSE - Unsaved writes have to be saved before
+                ExitBootServices
+
+**/
+BOOLEAN
+NvVarsLogCanArmRuntimeLog (
+  VOID
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_LK_VARIABLE_STORE_PROTOCOL  *VariableStore;
+
+  if (!mLogValid) {
+    return FALSE;
+  }
+
+  Status = gBS->LocateProtocol (&gEfiLKVariableStoreProtocolGuid, NULL, (VOID**) &VariableStore);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  return VariableStore->HasRuntimeLog (VariableStore);
+}
+
+
+/**
+  Lets the writes to the variable store after ExitBootServices continue
+  the log on the device through the runtime log, if it's up to date.
+
+**/
+VOID
+NvVarsLogArmRuntimeLog (
+  VOID
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_LK_VARIABLE_STORE_PROTOCOL  *VariableStore;
+
+  //
+  // After a failed save the log doesn't match the store anymore
+  //
+  if (!mLogValid) {
+    return;
+  }
+
+  Status = gBS->LocateProtocol (&gEfiLKVariableStoreProtocolGuid, NULL, (VOID**) &VariableStore);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  Status = VariableStore->ArmRuntimeLog (VariableStore, mLogGeneration, mLogNextLba);
+  if (!EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_INFO, "NvVars: runtime writes continue generation %u at LBA %Lu\n",
+      mLogGeneration, (UINT64) mLogNextLba));
+  }
+}
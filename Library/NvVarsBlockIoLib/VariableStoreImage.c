@@ -0,0 +1,304 @@
+/** @file
+  Raw variable store images for NvVarsBlockIoLib
+
+  Parses the variable store image EmuVariableFvbRuntimeDxe holds, as it's
+  kept on the device by the NvVars log.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "NvVarsBlockIoLib.h"
+
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+/**
+  Looks for the copy a variable in transition is being replaced with.
+
+  @param[in]  Ptr - The record following the variable in transition
+  @param[in]  End - End of the variable store
+  @param[in]  HeaderSize - Size of the variable headers of the store
+  @param[in]  Authenticated - Whether the store uses authenticated headers
+  @param[in]  Name - Name of the variable in transition
+  @param[in]  NameSize - Size of Name in bytes
+  @param[in]  VendorGuid - GUID of the variable in transition
+
+  @retval     TRUE - A later record holds the variable
+  @retval     FALSE - The variable in transition is the valid one
+
+**/
+STATIC
+BOOLEAN
+HasAddedCopy (
+  IN  UINT8                            *Ptr,
+  IN  UINT8                            *End,
+  IN  UINTN                            HeaderSize,
+  IN  BOOLEAN                          Authenticated,
+  IN  CHAR16                           *Name,
+  IN  UINTN                            NameSize,
+  IN  EFI_GUID                         *VendorGuid
+  )
+{
+  VARIABLE_HEADER               *Variable;
+  AUTHENTICATED_VARIABLE_HEADER *AuthVariable;
+  UINTN                         OtherNameSize;
+  UINTN                         OtherDataSize;
+  EFI_GUID                      *OtherGuid;
+  UINT8                         *OtherName;
+
+  while (Ptr + HeaderSize <= End) {
+    Variable = (VARIABLE_HEADER*) Ptr;
+    if (Variable->StartId != VARIABLE_DATA) {
+      break;
+    }
+
+    if (Authenticated) {
+      AuthVariable = (AUTHENTICATED_VARIABLE_HEADER*) Ptr;
+      OtherNameSize = AuthVariable->NameSize;
+      OtherDataSize = AuthVariable->DataSize;
+      OtherGuid = &AuthVariable->VendorGuid;
+    } else {
+      OtherNameSize = Variable->NameSize;
+      OtherDataSize = Variable->DataSize;
+      OtherGuid = &Variable->VendorGuid;
+    }
+
+    if (OtherNameSize == MAX_UINT32 || OtherDataSize == MAX_UINT32 ||
+        OtherNameSize + GET_PAD_SIZE (OtherNameSize) + OtherDataSize > (UINTN) (End - Ptr - HeaderSize)) {
+      break;
+    }
+
+    OtherName = Ptr + HeaderSize;
+    if (Variable->State == VAR_ADDED && OtherNameSize == NameSize &&
+        CompareGuid (OtherGuid, VendorGuid) && CompareMem (OtherName, Name, NameSize) == 0) {
+      return TRUE;
+    }
+
+    Ptr = (UINT8*) HEADER_ALIGN (OtherName + OtherNameSize + GET_PAD_SIZE (OtherNameSize) + OtherDataSize);
+  }
+
+  return FALSE;
+}
+
+
+/**
+  Calls a function for every valid variable in a raw variable store image.
+
+  Deleted records are skipped. A record in transition is only passed on if
+  its replacement hasn't been added yet, like the variable driver does.
+  Those are rare, so this stays a single pass over the store.
+
+  @param[in]  Image - The image, starting with the FV header
+  @param[in]  ImageSize - Size of the image in bytes
+  @param[in]  CallbackFunction - Function called for every variable
+  @param[in]  Context - Passed to CallbackFunction
+
+  @retval     EFI_SUCCESS - All variables were visited
+  @retval     EFI_VOLUME_CORRUPTED - The image doesn't hold a variable store
+  @return     Errors returned by CallbackFunction
+
+**/
+EFI_STATUS
+IterateVariableStoreImage (
+  IN  VOID                                       *Image,
+  IN  UINTN                                      ImageSize,
+  IN  VARIABLE_SERIALIZATION_ITERATION_CALLBACK  CallbackFunction,
+  IN  VOID                                       *Context
+  )
+{
+  EFI_FIRMWARE_VOLUME_HEADER  *FvHeader;
+  VARIABLE_STORE_HEADER       *StoreHeader;
+  BOOLEAN                     Authenticated;
+  UINTN                       HeaderSize;
+  UINT8                       *Ptr;
+  UINT8                       *End;
+  VARIABLE_HEADER             *Variable;
+  AUTHENTICATED_VARIABLE_HEADER *AuthVariable;
+  UINT32                      Attributes;
+  UINTN                       NameSize;
+  UINTN                       DataSize;
+  EFI_GUID                    *VendorGuid;
+  CHAR16                      *Name;
+  UINT8                       *Data;
+  RETURN_STATUS               Status;
+
+  FvHeader = (EFI_FIRMWARE_VOLUME_HEADER*) Image;
+  if (ImageSize < sizeof (EFI_FIRMWARE_VOLUME_HEADER) ||
+      FvHeader->Signature != EFI_FVH_SIGNATURE ||
+      FvHeader->HeaderLength + sizeof (VARIABLE_STORE_HEADER) > ImageSize) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  StoreHeader = (VARIABLE_STORE_HEADER*) ((UINT8*) Image + FvHeader->HeaderLength);
+  if (CompareGuid (&StoreHeader->Signature, &gEfiAuthenticatedVariableGuid)) {
+    Authenticated = TRUE;
+    HeaderSize = sizeof (AUTHENTICATED_VARIABLE_HEADER);
+  } else if (CompareGuid (&StoreHeader->Signature, &gEfiVariableGuid)) {
+    Authenticated = FALSE;
+    HeaderSize = sizeof (VARIABLE_HEADER);
+  } else {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  if (StoreHeader->Format != VARIABLE_STORE_FORMATTED) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  End = (UINT8*) Image + ImageSize;
+  if (StoreHeader->Size < (UINTN) (End - (UINT8*) StoreHeader)) {
+    End = (UINT8*) StoreHeader + StoreHeader->Size;
+  }
+
+  Ptr = (UINT8*) HEADER_ALIGN (StoreHeader + 1);
+  while (Ptr + HeaderSize <= End) {
+    Variable = (VARIABLE_HEADER*) Ptr;
+    if (Variable->StartId != VARIABLE_DATA) {
+      break;
+    }
+
+    if (Authenticated) {
+      AuthVariable = (AUTHENTICATED_VARIABLE_HEADER*) Ptr;
+      Attributes = AuthVariable->Attributes;
+      NameSize = AuthVariable->NameSize;
+      DataSize = AuthVariable->DataSize;
+      VendorGuid = &AuthVariable->VendorGuid;
+    } else {
+      Attributes = Variable->Attributes;
+      NameSize = Variable->NameSize;
+      DataSize = Variable->DataSize;
+      VendorGuid = &Variable->VendorGuid;
+    }
+
+    //
+    // A record whose header was written but not its sizes ends the store
+    //
+    if (NameSize == MAX_UINT32 || DataSize == MAX_UINT32 ||
+        NameSize + GET_PAD_SIZE (NameSize) + DataSize > (UINTN) (End - Ptr - HeaderSize)) {
+      break;
+    }
+
+    Name = (CHAR16*) (Ptr + HeaderSize);
+    Data = (UINT8*) Name + NameSize + GET_PAD_SIZE (NameSize);
+
+    Ptr = (UINT8*) HEADER_ALIGN (Data + DataSize);
+
+    if (NameSize < sizeof (CHAR16) || Name[NameSize / sizeof (CHAR16) - 1] != L'\0') {
+      continue;
+    }
+
+    //
+    // A variable which is being updated is still valid until the new copy,
+    // which comes later in the store, has been added
+    //
+    if (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      if (HasAddedCopy (Ptr, End, HeaderSize, Authenticated, Name, NameSize, VendorGuid)) {
+        continue;
+      }
+    } else if (Variable->State != VAR_ADDED) {
+      continue;
+    }
+
+    Status = CallbackFunction (Context, Name, VendorGuid, Attributes, DataSize, Data);
+    if (RETURN_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Calls a function for every non-volatile variable.
+
+  Walks the store of EmuVariableFvbRuntimeDxe directly if it's there,
+  which takes a single pass instead of a GetNextVariableName and
+  GetVariable call per variable, each searching the store again.
+
+  @param[in]  CallbackFunction - Function called for every variable
+  @param[in]  Context - Passed to CallbackFunction
+
+  @return     EFI_STATUS based on the success or failure of the iteration
+
+**/
+EFI_STATUS
+IterateNvVariables (
+  IN  VARIABLE_SERIALIZATION_ITERATION_CALLBACK  CallbackFunction,
+  IN  VOID                                       *Context
+  )
+{
+  EFI_STATUS                      Status;
+  EFI_LK_VARIABLE_STORE_PROTOCOL  *VariableStore;
+  VOID                            *Store;
+  UINTN                           StoreSize;
+  EFI_TPL                         OldTpl;
+
+  Status = gBS->LocateProtocol (&gEfiLKVariableStoreProtocolGuid, NULL, (VOID**) &VariableStore);
+  if (!EFI_ERROR (Status)) {
+    VariableStore->GetStore (VariableStore, &Store, &StoreSize);
+
+    //
+    // The variable driver updates the store at TPL_NOTIFY
+    //
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    Status = IterateVariableStoreImage (Store, StoreSize, CallbackFunction, Context);
+    gBS->RestoreTPL (OldTpl);
+
+    if (Status != EFI_VOLUME_CORRUPTED) {
+      return Status;
+    }
+  }
+
+  return SerializeVariablesIterateSystemVariables (CallbackFunction, Context);
+}
+
+
+/**
+  Restores the variables of a raw variable store image.
+
+  @param[in]  Image - The image, starting with the FV header
+  @param[in]  ImageSize - Size of the image in bytes
+
+  @return     EFI_STATUS based on the success or failure of the restore
+
+**/
+EFI_STATUS
+RestoreVariableStoreImage (
+  IN  VOID                             *Image,
+  IN  UINTN                            ImageSize
+  )
+{
+  EFI_STATUS                  Status;
+  EFI_HANDLE                  SerializedVariables;
+
+  Status = SerializeVariablesNewInstance (&SerializedVariables);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = IterateVariableStoreImage (
+             Image,
+             ImageSize,
+             IterateVariablesCallbackAddAllNvVariables,
+             (VOID*) SerializedVariables
+             );
+  if (!EFI_ERROR (Status)) {
+    Status = SerializeVariablesSetSerializedVariables (SerializedVariables);
+  }
+
+  SerializeVariablesFreeInstance (SerializedVariables);
+
+  DEBUG ((EFI_D_INFO, "NvVars: restored variables from a %Lu byte store image: %r\n",
+    (UINT64) ImageSize, Status));
+
+  return Status;
+}
+
@@ -0,0 +1,372 @@
+/** @file
+  Deferred write-back of the NvVars data
+
+  Every write to the emulated variable store used to rewrite the whole
+  NvVars area, so a boot manager pass which updates a handful of variables
+  wrote it as many times. Updates are now collected for
+  PcdNvVarsWriteBackDelay milliseconds and written out together. Pending
+  updates get written at ReadyToBoot, after which updates are written
+  immediately, and before the platform resets. If ReadyToBoot got skipped
+  they're left to the runtime log, which the FVB driver keeps the writes
+  after ExitBootServices in. Without a usable runtime log they get written
+  from BeforeExitBootServices, since nothing may be allocated from the
+  ExitBootServices notification anymore.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "NvVarsBlockIoLib.h"
+
+#include <Guid/EventGroup.h>
+
+#include <Library/DebugLib.h>
+#include <Library/PcdLib.h>
+
+STATIC EFI_EVENT              mWriteBackTimer = NULL;
+STATIC EFI_EVENT              mWriteBackBeforeExitBootServicesEvent = NULL;
+STATIC EFI_EVENT              mWriteBackExitBootServicesEvent = NULL;
+STATIC EFI_EVENT              mWriteBackReadyToBootEvent = NULL;
+STATIC EFI_EVENT              mWriteBackResetNotifyEvent = NULL;
+STATIC VOID                   *mWriteBackResetNotifyRegistration = NULL;
+STATIC BOOLEAN                mWriteBackPending = FALSE;
+STATIC BOOLEAN                mWriteBackImmediate = FALSE;
+
+// number of times the variables were written to the device, and the number
+// of updates which got written along with an earlier one
+STATIC UINTN                  mWriteBackPersists = 0;
+STATIC UINTN                  mWriteBackCollapsed = 0;
+
+
+/**
+  Writes the variables to the device if there are pending updates.
+
+**/
+STATIC
+VOID
+NvVarsWriteBackRun (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+
+  if (!mWriteBackPending) {
+    return;
+  }
+
+  mWriteBackPending = FALSE;
+  gBS->SetTimer (mWriteBackTimer, TimerCancel, 0);
+
+  Status = SaveNvVarsToBlockIo (mBlockIo);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "NvVars: write-back failed: %r\n", Status));
+    return;
+  }
+
+  mWriteBackPersists++;
+}
+
+
+/**
+  Notification function of the write-back timer.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+NvVarsWriteBackTimerEvent (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  NvVarsWriteBackRun ();
+}
+
+
+/**
+  Notification function of the ReadyToBoot event group.
+
+  The boot option's loader may call ExitBootServices any time now, so write
+  what's pending and don't defer updates anymore.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+NvVarsWriteBackReadyToBootEvent (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  mWriteBackImmediate = TRUE;
+  NvVarsWriteBackRun ();
+}
+
+
+/**
+  Notification function of the BeforeExitBootServices event group.
+
+  ExitBootServices got called without ReadyToBoot, e.g. by a loader started
+  from the shell. Pending updates get written now unless the runtime log
+  takes them over, updates from here on are written immediately.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+NvVarsWriteBackBeforeExitBootServicesEvent (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  mWriteBackImmediate = TRUE;
+  if (!NvVarsLogCanArmRuntimeLog ()) {
+    NvVarsWriteBackRun ();
+  }
+}
+
+
+/**
+  Notification function of EVT_SIGNAL_EXIT_BOOT_SERVICES.
+
+  Writing the variables allocates memory, which mustn't happen anymore at
+  this point. Updates still pending were left to the runtime log by
+  NvVarsWriteBackBeforeExitBootServicesEvent, it picks up the unsaved parts
+  of the store.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+NvVarsWriteBackExitBootServicesEvent (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  if (mWriteBackPending) {
+    DEBUG ((EFI_D_WARN, "NvVars: updates pending at ExitBootServices\n"));
+    mWriteBackPending = FALSE;
+  }
+  NvVarsLogArmRuntimeLog ();
+
+  DEBUG ((EFI_D_INFO, "NvVars: %Lu writes, %Lu updates collapsed\n",
+    (UINT64)mWriteBackPersists, (UINT64)mWriteBackCollapsed));
+}
+
+
+/**
+  Reset notify function, called by ResetSystem right before the reset.
+
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+NvVarsWriteBackResetNotify (
+  IN VOID                           *Context
+  )
+{
+  NvVarsWriteBackRun ();
+}
+
+
+/**
+  Registers NvVarsWriteBackResetNotify once the reset notify protocol is
+  there.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+NvVarsWriteBackResetNotifyInstalled (
+  IN EFI_EVENT                      Event,
+  IN VOID                           *Context
+  )
+{
+  EFI_STATUS                    Status;
+  EFI_LK_RESET_NOTIFY_PROTOCOL  *ResetNotify;
+
+  Status = gBS->LocateProtocol (&gEfiLKResetNotifyProtocolGuid, NULL, (VOID **)&ResetNotify);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  gBS->CloseEvent (Event);
+  mWriteBackResetNotifyEvent = NULL;
+
+  Status = ResetNotify->RegisterResetNotify (ResetNotify, NvVarsWriteBackResetNotify, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "NvVars: can't register reset notify: %r\n", Status));
+  }
+}
+
+
+/**
+  Sets up the deferred write-back once a device has been connected.
+
+  If anything fails updates get written immediately.
+
+**/
+VOID
+NvVarsWriteBackInit (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+
+  if (PcdGet32 (PcdNvVarsWriteBackDelay) == 0 || mWriteBackTimer != NULL) {
+    return;
+  }
+
+  Status = gBS->CreateEventEx (
+                  EVT_NOTIFY_SIGNAL,
+                  TPL_CALLBACK,
+                  NvVarsWriteBackBeforeExitBootServicesEvent,
+                  NULL,
+                  &gEfiEventBeforeExitBootServicesGuid,
+                  &mWriteBackBeforeExitBootServicesEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                  TPL_CALLBACK,
+                  NvVarsWriteBackExitBootServicesEvent,
+                  NULL,
+                  &mWriteBackExitBootServicesEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (mWriteBackBeforeExitBootServicesEvent);
+    return;
+  }
+
+  Status = EfiCreateEventReadyToBootEx (
+             TPL_CALLBACK,
+             NvVarsWriteBackReadyToBootEvent,
+             NULL,
+             &mWriteBackReadyToBootEvent
+             );
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (mWriteBackExitBootServicesEvent);
+    gBS->CloseEvent (mWriteBackBeforeExitBootServicesEvent);
+    return;
+  }
+
+  mWriteBackResetNotifyEvent = EfiCreateProtocolNotifyEvent (
+                                 &gEfiLKResetNotifyProtocolGuid,
+                                 TPL_CALLBACK,
+                                 NvVarsWriteBackResetNotifyInstalled,
+                                 NULL,
+                                 &mWriteBackResetNotifyRegistration
+                                 );
+  if (mWriteBackResetNotifyEvent == NULL) {
+    gBS->CloseEvent (mWriteBackReadyToBootEvent);
+    gBS->CloseEvent (mWriteBackExitBootServicesEvent);
+    gBS->CloseEvent (mWriteBackBeforeExitBootServicesEvent);
+    return;
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_CALLBACK,
+                  NvVarsWriteBackTimerEvent,
+                  NULL,
+                  &mWriteBackTimer
+                  );
+  if (EFI_ERROR (Status)) {
+    if (mWriteBackResetNotifyEvent != NULL) {
+      gBS->CloseEvent (mWriteBackResetNotifyEvent);
+    }
+    gBS->CloseEvent (mWriteBackReadyToBootEvent);
+    gBS->CloseEvent (mWriteBackExitBootServicesEvent);
+    gBS->CloseEvent (mWriteBackBeforeExitBootServicesEvent);
+    mWriteBackTimer = NULL;
+  }
+}
+
+
+/**
+  Drops pending updates because the caller is writing the variables right
+  now.
+
+**/
+VOID
+NvVarsWriteBackCancel (
+  VOID
+  )
+{
+  if (mWriteBackPending) {
+    mWriteBackPending = FALSE;
+    mWriteBackCollapsed++;
+    gBS->SetTimer (mWriteBackTimer, TimerCancel, 0);
+  }
+}
+
+
+/**
+  Schedules writing the non-volatile variables to the device.
+
+  @return     The EFI_STATUS while attempting to schedule the write.
+  @retval     EFI_SUCCESS - The variables will be written
+  @retval     EFI_NOT_STARTED - A interface has not been connected
+
+**/
+EFI_STATUS
+EFIAPI
+ScheduleNvVarsWriteBack (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+
+  if (mNvVarsLibBlockIoHandle == NULL) {
+    return EFI_NOT_STARTED;
+  }
+
+  if (mWriteBackTimer == NULL || mWriteBackImmediate) {
+    return WriteNvVarsToBlockIo ();
+  }
+
+  if (mWriteBackPending) {
+    mWriteBackCollapsed++;
+    return EFI_SUCCESS;
+  }
+
+  // the window isn't extended by later updates, so a steady stream of them
+  // still gets written every PcdNvVarsWriteBackDelay milliseconds
+  Status = gBS->SetTimer (
+                  mWriteBackTimer,
+                  TimerRelative,
+                  MultU64x32 (PcdGet32 (PcdNvVarsWriteBackDelay), 10000)
+                  );
+  if (EFI_ERROR (Status)) {
+    return WriteNvVarsToBlockIo ();
+  }
+
+  mWriteBackPending = TRUE;
+  return EFI_SUCCESS;
+}
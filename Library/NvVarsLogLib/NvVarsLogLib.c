@@ -0,0 +1,238 @@
+/** @file
+  Replay of the NvVars log
+
+  Shared by NvVarsBlockIoLib, which restores the variables from the log
+  once the device shows up, and by the early restore which puts the image
+  in place before the variable driver starts. Both get the writes the OS
+  made at runtime during the last boot on top.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <Uefi.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/Crc32Lib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/NvVarsLogLib.h>
+#include <Library/PcdLib.h>
+
+/**
+  Calculates the checksum of a record or the header.
+
+  @param[in]  Buffer - The record or header
+  @param[in]  Size - Size of the record or header in bytes
+  @param[in]  Checksum - The checksum field inside Buffer
+
+  @return     The CRC32 of Buffer with the checksum field set to 0
+
+**/
+UINT32
+EFIAPI
+NvVarsLogChecksum (
+  IN  VOID                             *Buffer,
+  IN  UINTN                            Size,
+  IN  UINT32                           *Checksum
+  )
+{
+  UINT32                      Saved;
+  UINT32                      Crc;
+
+  Saved = *Checksum;
+  *Checksum = 0;
+  Crc = Crc32Calculate (Buffer, Size);
+  *Checksum = Saved;
+
+  return Crc;
+}
+
+
+/**
+  Rebuilds the variable store image from the log on a device.
+
+  Only ReadBlocks and Media of BlockIo are used, so it doesn't have to be a
+  full BlockIo implementation.
+
+  @param[in]  BlockIo - The device holding the log
+  @param[in]  Header - The header read from LBA 0
+  @param[out] Image - The image, Header->ImageSize bytes
+  @param[out] NextLba - Optional, returns the block after the last valid record
+
+  @retval     EFI_SUCCESS - The image was rebuilt
+  @retval     EFI_VOLUME_CORRUPTED - There's no valid log on the device
+  @return     Errors of the device
+
+**/
+EFI_STATUS
+EFIAPI
+NvVarsLogReplay (
+  IN  EFI_BLOCK_IO_PROTOCOL            *BlockIo,
+  IN  NVVARS_LOG_HEADER                *Header,
+  OUT VOID                             *Image,
+  OUT EFI_LBA                          *NextLba OPTIONAL
+  )
+{
+  EFI_STATUS                  Status;
+  UINTN                       BlockSize;
+  UINT8                       *Record;
+  UINTN                       RecordBufferSize;
+  NVVARS_LOG_RECORD           *RecordHeader;
+  NVVARS_LOG_RANGE            *Ranges;
+  UINT8                       *Data;
+  UINTN                       RecordSize;
+  UINTN                       RecordBlocks;
+  UINTN                       DataSize;
+  UINTN                       Index;
+  EFI_LBA                     Lba;
+  EFI_LBA                     EndLba;
+  UINTN                       Records;
+
+  BlockSize = BlockIo->Media->BlockSize;
+
+  if (Header->Signature != NVVARS_LOG_SIGNATURE ||
+      Header->Checksum != NvVarsLogChecksum (Header, sizeof (*Header), &Header->Checksum) ||
+      Header->ImageSize == 0 || Header->ActiveLba == 0 ||
+      (UINT64) Header->ActiveLba + Header->HalfBlocks > BlockIo->Media->LastBlock + 1) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  RecordBufferSize = BlockSize;
+  Record = AllocatePool (RecordBufferSize);
+  if (Record == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = EFI_SUCCESS;
+  Lba = Header->ActiveLba;
+  EndLba = Header->ActiveLba + Header->HalfBlocks;
+  Records = 0;
+
+  while (Lba < EndLba) {
+    Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, Lba, BlockSize, Record);
+    if (EFI_ERROR (Status)) {
+      goto Exit;
+    }
+
+    RecordHeader = (NVVARS_LOG_RECORD*) Record;
+    if (RecordHeader->Signature != NVVARS_LOG_RECORD_SIGNATURE ||
+        RecordHeader->Generation != Header->Generation ||
+        RecordHeader->RangeCount == 0 ||
+        RecordHeader->RangeCount > Header->ImageSize ||
+        RecordHeader->DataSize > Header->ImageSize) {
+      break;
+    }
+
+    RecordSize = sizeof (NVVARS_LOG_RECORD) +
+                 RecordHeader->RangeCount * sizeof (NVVARS_LOG_RANGE) +
+                 RecordHeader->DataSize;
+    RecordBlocks = ALIGN_VALUE (RecordSize, BlockSize) / BlockSize;
+    if (RecordBlocks > EndLba - Lba) {
+      break;
+    }
+
+    //
+    // Fetch the rest of the record
+    //
+    if (RecordBlocks > 1) {
+      if (RecordBlocks * BlockSize > RecordBufferSize) {
+        Data = ReallocatePool (RecordBufferSize, RecordBlocks * BlockSize, Record);
+        if (Data == NULL) {
+          Status = EFI_OUT_OF_RESOURCES;
+          goto Exit;
+        }
+        Record = Data;
+        RecordBufferSize = RecordBlocks * BlockSize;
+        RecordHeader = (NVVARS_LOG_RECORD*) Record;
+      }
+
+      Status = BlockIo->ReadBlocks (
+                 BlockIo,
+                 BlockIo->Media->MediaId,
+                 Lba + 1,
+                 (RecordBlocks - 1) * BlockSize,
+                 Record + BlockSize
+                 );
+      if (EFI_ERROR (Status)) {
+        goto Exit;
+      }
+    }
+
+    if (RecordHeader->Checksum != NvVarsLogChecksum (Record, RecordSize, &RecordHeader->Checksum)) {
+      DEBUG ((EFI_D_WARN, "NvVars: log record at LBA %Lu is torn, dropping it\n", (UINT64) Lba));
+      break;
+    }
+
+    Ranges = (NVVARS_LOG_RANGE*) (RecordHeader + 1);
+    Data = (UINT8*) (Ranges + RecordHeader->RangeCount);
+
+    //
+    // The first record has to be the snapshot the others build on
+    //
+    if (Records == 0 &&
+        (RecordHeader->RangeCount != 1 || Ranges[0].Offset != 0 || Ranges[0].Length != Header->ImageSize)) {
+      break;
+    }
+
+    DataSize = 0;
+    for (Index = 0; Index < RecordHeader->RangeCount; Index++) {
+      if (Ranges[Index].Offset > Header->ImageSize ||
+          Ranges[Index].Length > Header->ImageSize - Ranges[Index].Offset) {
+        break;
+      }
+      DataSize += Ranges[Index].Length;
+    }
+    if (Index != RecordHeader->RangeCount || DataSize != RecordHeader->DataSize) {
+      break;
+    }
+
+    for (Index = 0; Index < RecordHeader->RangeCount; Index++) {
+      CopyMem ((UINT8*) Image + Ranges[Index].Offset, Data, Ranges[Index].Length);
+      Data += Ranges[Index].Length;
+    }
+
+    Records++;
+    Lba += RecordBlocks;
+  }
+
+  if (Records == 0) {
+    Status = EFI_VOLUME_CORRUPTED;
+    goto Exit;
+  }
+
+  DEBUG ((EFI_D_INFO, "NvVars: replayed %Lu log records\n", (UINT64) Records));
+
+  //
+  // The runtime log is only applied if it continues right where the log
+  // on the device ends
+  //
+  if (FixedPcdGet64 (PcdNvVarsRuntimeLogBase) != 0) {
+    Records = NvVarsRuntimeLogApply (
+                (NVVARS_RUNTIME_LOG_HEADER*) (UINTN) FixedPcdGet64 (PcdNvVarsRuntimeLogBase),
+                Header->Generation,
+                Lba,
+                Image,
+                Header->ImageSize
+                );
+    if (Records != 0) {
+      DEBUG ((EFI_D_INFO, "NvVars: applied %Lu writes made at runtime\n", (UINT64) Records));
+    }
+  }
+
+  if (NextLba != NULL) {
+    *NextLba = Lba;
+  }
+
+Exit:
+  FreePool (Record);
+
+  return Status;
+}
@@ -0,0 +1,209 @@
+/** @file
+  Runtime log of the variable store writes after ExitBootServices
+
+  The FVB driver appends to it from SetVariable at runtime, so appending
+  must not use boot services and doesn't wait for anything. Runtime
+  services aren't reentrant, so there's only ever one writer. There's no
+  reader until the next boot either, so the log doesn't wrap around and
+  just stops taking entries once it's full.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <Uefi.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/NvVarsLogLib.h>
+
+#define NVVARS_RUNTIME_LOG_ALIGNMENT  8
+
+/**
+  Starts a runtime log continuing a log generation, dropping its entries.
+
+  @param[in]  Log - The runtime log
+  @param[in]  Size - Size of the runtime log in bytes, including the header
+  @param[in]  Generation - The generation of the log on the device
+  @param[in]  NextLba - The block following its last record
+
+**/
+VOID
+EFIAPI
+NvVarsRuntimeLogArm (
+  IN  NVVARS_RUNTIME_LOG_HEADER        *Log,
+  IN  UINTN                            Size,
+  IN  UINT32                           Generation,
+  IN  EFI_LBA                          NextLba
+  )
+{
+  ASSERT (Size > sizeof (*Log));
+
+  //
+  // Nothing may see the new generation with the entries of the old one
+  //
+  Log->Signature = 0;
+  MemoryFence ();
+
+  Log->Size = (UINT32) MIN (Size - sizeof (*Log), MAX_UINT32);
+  Log->Generation = Generation;
+  Log->Head = 0;
+  Log->NextLba = NextLba;
+  Log->Overflow = 0;
+  Log->Reserved = 0;
+  MemoryFence ();
+
+  Log->Signature = NVVARS_RUNTIME_LOG_SIGNATURE;
+}
+
+
+/**
+  Appends a write to the variable store to the runtime log.
+
+  Only touches the log itself, so it can be called at runtime.
+
+  @param[in]  Log - The runtime log
+  @param[in]  Offset - Offset of the write in the store image
+  @param[in]  Buffer - The data written
+  @param[in]  Length - Number of bytes written
+
+  @retval     EFI_SUCCESS - The write was appended
+  @retval     EFI_NOT_STARTED - The log hasn't been armed
+  @retval     EFI_OUT_OF_RESOURCES - The log is full
+
+**/
+EFI_STATUS
+EFIAPI
+NvVarsRuntimeLogAppend (
+  IN  NVVARS_RUNTIME_LOG_HEADER        *Log,
+  IN  UINTN                            Offset,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Length
+  )
+{
+  NVVARS_RUNTIME_LOG_ENTRY    *Entry;
+  UINTN                       EntrySize;
+
+  if (Log->Signature != NVVARS_RUNTIME_LOG_SIGNATURE) {
+    return EFI_NOT_STARTED;
+  }
+
+  if (Log->Overflow != 0) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // A dropped write must not be followed by later ones, those could build
+  // on it
+  //
+  if (Log->Head > Log->Size || Offset > MAX_UINT32 || Length > Log->Size) {
+    Log->Overflow = 1;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  EntrySize = ALIGN_VALUE (sizeof (*Entry) + Length, NVVARS_RUNTIME_LOG_ALIGNMENT);
+  if (EntrySize > Log->Size - Log->Head) {
+    Log->Overflow = 1;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Entry = (NVVARS_RUNTIME_LOG_ENTRY*) ((UINT8*) (Log + 1) + Log->Head);
+
+  Entry->Offset = (UINT32) Offset;
+  Entry->Length = (UINT32) Length;
+  Entry->Reserved = 0;
+  CopyMem (Entry + 1, Buffer, Length);
+  Entry->Checksum = NvVarsLogChecksum (Entry, sizeof (*Entry) + Length, &Entry->Checksum);
+
+  //
+  // The entry has to be complete before it becomes part of the log
+  //
+  MemoryFence ();
+  Log->Head += (UINT32) EntrySize;
+
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Applies the entries of a runtime log to an image replayed from the log
+  on the device, if it continues that log.
+
+  Entries are applied in order up to the first one which doesn't check out.
+
+  @param[in]      Log - The runtime log
+  @param[in]      Generation - The generation replayed
+  @param[in]      NextLba - The block following the last record replayed
+  @param[in, out] Image - The image
+  @param[in]      ImageSize - Size of Image in bytes
+
+  @return     The number of entries applied
+
+**/
+UINTN
+EFIAPI
+NvVarsRuntimeLogApply (
+  IN      NVVARS_RUNTIME_LOG_HEADER    *Log,
+  IN      UINT32                       Generation,
+  IN      EFI_LBA                      NextLba,
+  IN OUT  VOID                         *Image,
+  IN      UINTN                        ImageSize
+  )
+{
+  NVVARS_RUNTIME_LOG_ENTRY    *Entry;
+  UINT8                       *Entries;
+  UINTN                       Head;
+  UINTN                       Position;
+  UINTN                       Count;
+
+  if (Log->Signature != NVVARS_RUNTIME_LOG_SIGNATURE ||
+      Log->Generation != Generation ||
+      Log->NextLba != NextLba ||
+      Log->Head > Log->Size) {
+    return 0;
+  }
+
+  Entries = (UINT8*) (Log + 1);
+  Head = Log->Head;
+  Position = 0;
+  Count = 0;
+
+  while (Head - Position >= sizeof (*Entry)) {
+    Entry = (NVVARS_RUNTIME_LOG_ENTRY*) (Entries + Position);
+    if (Entry->Length > Head - Position - sizeof (*Entry) ||
+        Entry->Checksum != NvVarsLogChecksum (Entry, sizeof (*Entry) + Entry->Length, &Entry->Checksum)) {
+      DEBUG ((EFI_D_WARN, "NvVars: runtime log entry at %Lu is corrupted\n", (UINT64) Position));
+      break;
+    }
+
+    //
+    // Writes to the FTW areas behind the store aren't part of the image
+    //
+    if (Entry->Offset < ImageSize) {
+      CopyMem (
+        (UINT8*) Image + Entry->Offset,
+        Entry + 1,
+        MIN (Entry->Length, ImageSize - Entry->Offset)
+        );
+    }
+
+    Count++;
+    Position += MIN (
+                  ALIGN_VALUE (sizeof (*Entry) + Entry->Length, NVVARS_RUNTIME_LOG_ALIGNMENT),
+                  Head - Position
+                  );
+  }
+
+  if (Log->Overflow != 0) {
+    DEBUG ((EFI_D_WARN, "NvVars: the runtime log overflowed, later writes were lost\n"));
+  }
+
+  return Count;
+}
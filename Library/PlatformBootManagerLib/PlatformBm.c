@@ -115,7 +115,7 @@ EmuVariablesUpdatedCallback (
   IN  VOID      *Context
   )
 {
-  WriteNvVarsToBlockIo ();
+  ScheduleNvVarsWriteBack ();
 }
 
 EFI_STATUS
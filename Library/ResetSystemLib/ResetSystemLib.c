@@ -20,14 +20,93 @@
 #include <PiDxe.h>
 
 #include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
 #include <Library/IoLib.h>
 #include <Library/EfiResetSystemLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+#include <Library/UefiRuntimeLib.h>
+
+#include <Protocol/LKResetNotify.h>
 
 #include <LittleKernel.h>
 
+typedef struct {
+  LIST_ENTRY                Link;
+  LK_RESET_NOTIFY_FUNCTION  Notify;
+  VOID                      *Context;
+} RESET_NOTIFY_ENTRY;
+
 lkapi_t* LKApi = NULL;
 
+STATIC LIST_ENTRY mResetNotifyList = INITIALIZE_LIST_HEAD_VARIABLE (mResetNotifyList);
+
+STATIC
+EFI_STATUS
+RegisterResetNotify (
+  IN EFI_LK_RESET_NOTIFY_PROTOCOL   *This,
+  IN LK_RESET_NOTIFY_FUNCTION       Notify,
+  IN VOID                           *Context
+  )
+{
+  RESET_NOTIFY_ENTRY  *Entry;
+
+  if (Notify == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  // allocate now, ResetSystem only walks the list
+  Entry = AllocatePool (sizeof (RESET_NOTIFY_ENTRY));
+  if (Entry == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Entry->Notify = Notify;
+  Entry->Context = Context;
+  InsertTailList (&mResetNotifyList, &Entry->Link);
+
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_LK_RESET_NOTIFY_PROTOCOL mResetNotify = {
+  RegisterResetNotify
+};
+
+/**
+  Calls the registered reset notify functions.
+
+  Signaling an event group would only queue their notification functions
+  and those don't run before the reset if ResetSystem was called at
+  TPL_CALLBACK or above, so call them directly.
+
+**/
+STATIC
+VOID
+CallResetNotifies (
+  VOID
+  )
+{
+  EFI_TPL             OldTpl;
+  LIST_ENTRY          *Link;
+  RESET_NOTIFY_ENTRY  *Entry;
+
+  // raising is the only way to get the current TPL
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  gBS->RestoreTPL (OldTpl);
+  if (OldTpl > TPL_NOTIFY) {
+    DEBUG ((DEBUG_WARN, "ResetSystem: called at TPL %d, cached data can't be written back\n", OldTpl));
+    return;
+  }
+
+  for (Link = GetFirstNode (&mResetNotifyList);
+       !IsNull (&mResetNotifyList, Link);
+       Link = GetNextNode (&mResetNotifyList, Link)) {
+    Entry = BASE_CR (Link, RESET_NOTIFY_ENTRY, Link);
+    Entry->Notify (Entry->Context);
+  }
+}
+
 CHAR8*
 Unicode2Ascii (
   CONST CHAR16* UnicodeStr
@@ -68,6 +147,12 @@ LibResetSystem (
   // convert to ascii
   CHAR8* AsciiResetStr = NULL;
 
+  // give drivers a chance to write back cached data.
+  // after ExitBootServices they already did that.
+  if (!EfiAtRuntime ()) {
+    CallResetNotifies ();
+  }
+
   if (ResetData) {
     AsciiResetStr = Unicode2Ascii(ResetData);
     if (AsciiResetStr==NULL) {
@@ -115,7 +200,8 @@ LibResetSystem (
   @param  ImageHandle   The firmware allocated handle for the EFI image.
   @param  SystemTable   A pointer to the EFI System Table.
 
-  @retval EFI_SUCCESS   The constructor always returns EFI_SUCCESS.
+  @retval EFI_SUCCESS   The reset notify protocol was installed.
+  @retval other         The reset notify protocol couldn't be installed.
 
 **/
 EFI_STATUS
@@ -127,6 +213,10 @@ LibInitializeResetSystem (
 {
   LKApi = GetLKApi();
 
-  return EFI_SUCCESS;
+  return gBS->InstallMultipleProtocolInterfaces (
+                &ImageHandle,
+                &gEfiLKResetNotifyProtocolGuid, &mResetNotify,
+                NULL
+                );
 }
 
@@ -355,6 +355,10 @@ EnsureExtraBufferSpace (
     return RETURN_SUCCESS;
   }
 
+  if (Instance->CallerBuffer) {
+    return (Instance->BufferPtr == NULL) ? RETURN_SUCCESS : RETURN_BUFFER_TOO_SMALL;
+  }
+
   //
   // Double the required size to lessen the need to re-allocate in the future
   //
@@ -385,14 +389,27 @@ AppendToBuffer (
   IN  UINTN        Size
   )
 {
+  STATIC CONST UINT8 Padding[sizeof (UINT32)] = { 0 };
   UINTN NewSize;
 
   ASSERT (Instance != NULL);
   ASSERT (Data != NULL);
 
   NewSize = Instance->DataSize + Size;
+
+  //
+  // Sizing instance, nothing gets stored
+  //
+  if (Instance->BufferPtr == NULL) {
+    Instance->DataSize = ALIGN_VALUE(NewSize, sizeof(UINT32));
+    return;
+  }
+
   ASSERT ((Instance->DataSize + Size) <= Instance->BufferSize);
 
+  Instance->Crc = Crc32Update (Instance->Crc, Data, Size);
+  Instance->Crc = Crc32Update (Instance->Crc, Padding, ALIGN_VALUE(Size, sizeof(UINT32))-Size);
+
   CopyMem (
     (VOID*) (((UINT8*) (Instance->BufferPtr)) + Instance->DataSize),
     Data,
@@ -440,6 +457,50 @@ SerializeVariablesNewInstance (
 }
 
 
+/**
+  Creates a new variable serialization instance which serializes
+  straight into a buffer of the caller.
+
+  The buffer doesn't grow, adding variables which don't fit fails with
+  RETURN_BUFFER_TOO_SMALL. If Buffer is NULL, nothing is stored and the
+  instance only counts the size the variables need, which
+  SerializeVariablesToBuffer returns along with RETURN_BUFFER_TOO_SMALL.
+
+  @param[out]  Handle - Handle for a variable serialization instance
+  @param[in]   Buffer - The buffer to serialize into, or NULL
+  @param[in]   BufferSize - Size of Buffer in bytes
+
+  @retval      RETURN_SUCCESS - The variable serialization instance was
+                 successfully created.
+  @retval      RETURN_OUT_OF_RESOURCES - There we not enough resources to
+                 create the variable serialization instance.
+
+**/
+RETURN_STATUS
+EFIAPI
+SerializeVariablesNewInstanceInBuffer (
+  OUT EFI_HANDLE                      *Handle,
+  IN  VOID                            *Buffer OPTIONAL,
+  IN  UINTN                           BufferSize
+  )
+{
+  RETURN_STATUS  Status;
+  SV_INSTANCE    *New;
+
+  Status = SerializeVariablesNewInstance (Handle);
+  if (RETURN_ERROR (Status)) {
+    return Status;
+  }
+
+  New = SV_FROM_HANDLE (*Handle);
+  New->BufferPtr = Buffer;
+  New->BufferSize = (Buffer == NULL) ? 0 : BufferSize;
+  New->CallerBuffer = TRUE;
+
+  return RETURN_SUCCESS;
+}
+
+
 /**
   Free memory associated with a variable serialization instance
 
@@ -467,7 +528,7 @@ SerializeVariablesFreeInstance (
 
   Instance->Signature = 0;
 
-  if (Instance->BufferPtr != NULL) {
+  if (Instance->BufferPtr != NULL && !Instance->CallerBuffer) {
     FreePool (Instance->BufferPtr);
   }
 
@@ -895,7 +956,11 @@ SerializeVariablesToBuffer (
     return RETURN_INVALID_PARAMETER;
   }
 
-  if (*Size < Instance->DataSize) {
+  //
+  // A sizing instance has no data, only its size
+  //
+  if (*Size < Instance->DataSize ||
+      (Instance->CallerBuffer && Instance->BufferPtr == NULL)) {
     *Size = Instance->DataSize;
     return RETURN_BUFFER_TOO_SMALL;
   }
@@ -905,7 +970,44 @@ SerializeVariablesToBuffer (
   }
 
   *Size = Instance->DataSize;
-  CopyMem (Buffer, Instance->BufferPtr, Instance->DataSize);
+  if (Buffer != Instance->BufferPtr) {
+    CopyMem (Buffer, Instance->BufferPtr, Instance->DataSize);
+  }
+
+  return RETURN_SUCCESS;
+}
+
+
+/**
+  Returns the CRC32 of the serialized variables, as calculated by
+  CalculateCrc32 over the data SerializeVariablesToBuffer returns.
+
+  @param[in]   Handle - Handle for a variable serialization instance
+  @param[out]  Crc32 - Returns the CRC32
+
+  @retval      RETURN_SUCCESS - The CRC32 was returned
+  @retval      RETURN_INVALID_PARAMETER - Handle was not a valid
+                 variable serialization instance, or it only counts
+                 the size of the variables.
+
+**/
+RETURN_STATUS
+EFIAPI
+SerializeVariablesGetCrc32 (
+  IN  EFI_HANDLE                          Handle,
+  OUT UINT32                              *Crc32
+  )
+{
+  SV_INSTANCE    *Instance;
+
+  Instance = SV_FROM_HANDLE (Handle);
+
+  if ((Instance->Signature != SV_SIGNATURE) || (Crc32 == NULL) ||
+      (Instance->CallerBuffer && Instance->BufferPtr == NULL)) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  *Crc32 = Instance->Crc;
 
   return RETURN_SUCCESS;
 }
@@ -19,6 +19,7 @@
 
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/Crc32Lib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/SerializeVariablesLib.h>
@@ -34,6 +35,15 @@ typedef struct {
   VOID                                *BufferPtr;
   UINTN                               BufferSize;
   UINTN                               DataSize;
+  //
+  // BufferPtr belongs to the caller and doesn't grow. If it's NULL the
+  // instance only counts DataSize.
+  //
+  BOOLEAN                             CallerBuffer;
+  //
+  // CRC32 of the data so far
+  //
+  UINT32                              Crc;
 } SV_INSTANCE;
 
 #endif
@@ -0,0 +1,281 @@
+/** @file
+  Checks the submit/complete contract of lkapi_biodev_t against the mock
+  device, and measures what overlapping transfers with work gains.
+
+  MMCHSDxe's BlockIo2 path hands a request to LK with submit, LK signals
+  the request's event through event_signal once it's done and the event's
+  notify calls complete. The overlap run does the same with a reader which
+  works on one chunk while the next one is being read, the way DiskIo2 or
+  the kernel loader would, and compares it with blocking reads.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "MockBioDev.h"
+
+#define BLOCK_SIZE        512
+#define NUM_BLOCKS        8192
+#define MAX_REQUESTS      8
+
+STATIC lkapi_t  mApi;
+
+//
+// The events the tests pass are counters of how often they were signaled
+//
+STATIC
+VOID
+TestEventSignal (
+  VOID  *Event
+  )
+{
+  __atomic_fetch_add ((UINT32 *) Event, 1, __ATOMIC_SEQ_CST);
+}
+
+STATIC
+VOID
+TestSync (
+  IN MOCK_BIODEV  *Mock
+  )
+{
+  lkapi_biodev_t  *Dev;
+  UINT8           Write[4 * BLOCK_SIZE];
+  UINT8           Read[4 * BLOCK_SIZE];
+
+  Dev = &Mock->Dev;
+  HostFillRandom (Write, sizeof (Write), 1);
+
+  HOST_CHECK (Dev->write (Dev, 100, sizeof (Write), Write) == 0, "write failed");
+  HOST_CHECK (Dev->read (Dev, 100, sizeof (Read), Read) == 0, "read failed");
+  HOST_CHECK (memcmp (Write, Read, sizeof (Read)) == 0, "read back the wrong data");
+
+  HOST_CHECK (Dev->read (Dev, NUM_BLOCKS - 1, 2 * BLOCK_SIZE, Read) != 0, "read past the end succeeded");
+  HOST_CHECK (Dev->read (Dev, 0, BLOCK_SIZE + 1, Read) != 0, "read of a partial block succeeded");
+}
+
+STATIC
+VOID
+TestAsync (
+  IN MOCK_BIODEV  *Mock
+  )
+{
+  lkapi_biodev_t          *Dev;
+  lkapi_biodev_request_t  Requests[MAX_REQUESTS];
+  UINT32                  Signaled[MAX_REQUESTS];
+  UINT8                   *Expected;
+  UINT8                   *Buffers;
+  UINT64                  Start;
+  UINT64                  SubmitNs;
+  UINTN                   Index;
+  UINTN                   Size;
+
+  Dev = &Mock->Dev;
+  Size = 8 * BLOCK_SIZE;
+  Expected = AllocatePool (MAX_REQUESTS * Size);
+  Buffers = AllocateZeroPool (MAX_REQUESTS * Size);
+  ASSERT (Expected != NULL && Buffers != NULL);
+
+  HostFillRandom (Expected, MAX_REQUESTS * Size, 2);
+  HOST_CHECK (Dev->write (Dev, 1000, MAX_REQUESTS * Size, Expected) == 0, "write failed");
+
+  ZeroMem (Requests, sizeof (Requests));
+  ZeroMem (Signaled, sizeof (Signaled));
+
+  // submitting must not wait for the device
+  Start = HostTimeNs ();
+  for (Index = 0; Index < MAX_REQUESTS; Index++) {
+    Requests[Index].type       = LKAPI_BIODEV_REQUEST_READ;
+    Requests[Index].lba        = 1000 + Index * (Size / BLOCK_SIZE);
+    Requests[Index].buffersize = Size;
+    Requests[Index].buffer     = Buffers + Index * Size;
+    Requests[Index].event      = &Signaled[Index];
+    HOST_CHECK (Dev->submit (Dev, &Requests[Index]) == 0, "submit %lu failed", (unsigned long) Index);
+  }
+  SubmitNs = HostTimeNs () - Start;
+  HOST_CHECK (SubmitNs < Mock->LatencyNs, "submitting %u requests took %lu us, longer than one request",
+    MAX_REQUESTS, (unsigned long) (SubmitNs / 1000));
+
+  // and they may be completed in any order
+  for (Index = MAX_REQUESTS; Index-- > 0;) {
+    HOST_CHECK (Dev->complete (Dev, &Requests[Index]) == 0, "request %lu failed", (unsigned long) Index);
+  }
+
+  // complete may return before event_signal got called
+  MockBioDevDestroy (Mock);
+
+  for (Index = 0; Index < MAX_REQUESTS; Index++) {
+    HOST_CHECK (Signaled[Index] == 1, "request %lu signaled %u times", (unsigned long) Index, Signaled[Index]);
+  }
+  HOST_CHECK (memcmp (Expected, Buffers, MAX_REQUESTS * Size) == 0, "asynchronous reads got the wrong data");
+
+  FreePool (Expected);
+  FreePool (Buffers);
+}
+
+STATIC
+VOID
+TestSubmitErrors (
+  IN MOCK_BIODEV  *Mock
+  )
+{
+  lkapi_biodev_request_t  Request;
+  UINT8                   Buffer[2 * BLOCK_SIZE];
+
+  ZeroMem (&Request, sizeof (Request));
+  Request.type       = LKAPI_BIODEV_REQUEST_READ;
+  Request.lba        = NUM_BLOCKS - 1;
+  Request.buffersize = sizeof (Buffer);
+  Request.buffer     = Buffer;
+  HOST_CHECK (Mock->Dev.submit (&Mock->Dev, &Request) != 0, "submit past the end succeeded");
+}
+
+/**
+  Reads Count chunks and works on each of them for WorkNs.
+
+  @return     How long it took in ns
+
+**/
+STATIC
+UINT64
+RunReader (
+  IN MOCK_BIODEV  *Mock,
+  IN BOOLEAN      Overlap,
+  IN UINTN        ChunkSize,
+  IN UINTN        Count,
+  IN UINT64       WorkNs
+  )
+{
+  lkapi_biodev_t          *Dev;
+  lkapi_biodev_request_t  Requests[2];
+  UINT32                  Signaled[2];
+  UINT8                   *Buffers;
+  UINT8                   *Chunk;
+  UINT64                  Start;
+  UINT64                  Elapsed;
+  UINTN                   Index;
+
+  Dev = &Mock->Dev;
+  Buffers = AllocatePool (2 * ChunkSize);
+  ASSERT (Buffers != NULL);
+  ZeroMem (Requests, sizeof (Requests));
+  ZeroMem (Signaled, sizeof (Signaled));
+
+  Start = HostTimeNs ();
+  for (Index = 0; Index < Count; Index++) {
+    Chunk = Buffers + (Index & 1) * ChunkSize;
+
+    if (!Overlap) {
+      HOST_CHECK (Dev->read (Dev, Index * (ChunkSize / BLOCK_SIZE), ChunkSize, Chunk) == 0, "read failed");
+    } else {
+      if (Index == 0) {
+        Requests[0].type       = LKAPI_BIODEV_REQUEST_READ;
+        Requests[0].lba        = 0;
+        Requests[0].buffersize = ChunkSize;
+        Requests[0].buffer     = Buffers;
+        Requests[0].event      = &Signaled[0];
+        HOST_CHECK (Dev->submit (Dev, &Requests[0]) == 0, "submit failed");
+      }
+
+      // start on the next chunk before working on this one
+      if (Index + 1 < Count) {
+        Requests[(Index + 1) & 1].type       = LKAPI_BIODEV_REQUEST_READ;
+        Requests[(Index + 1) & 1].lba        = (Index + 1) * (ChunkSize / BLOCK_SIZE);
+        Requests[(Index + 1) & 1].buffersize = ChunkSize;
+        Requests[(Index + 1) & 1].buffer     = Buffers + ((Index + 1) & 1) * ChunkSize;
+        Requests[(Index + 1) & 1].event      = &Signaled[(Index + 1) & 1];
+        HOST_CHECK (Dev->submit (Dev, &Requests[(Index + 1) & 1]) == 0, "submit failed");
+      }
+
+      HOST_CHECK (Dev->complete (Dev, &Requests[Index & 1]) == 0, "read failed");
+    }
+
+    HOST_CHECK (memcmp (Chunk, Mock->Data + Index * ChunkSize, ChunkSize) == 0,
+      "chunk %lu has the wrong data", (unsigned long) Index);
+    HostSpinNs (WorkNs);
+  }
+
+  Elapsed = HostTimeNs () - Start;
+
+  // complete may return before event_signal got called, and Signaled is
+  // about to go away
+  if (Overlap) {
+    while (__atomic_load_n (&Signaled[0], __ATOMIC_SEQ_CST) + __atomic_load_n (&Signaled[1], __ATOMIC_SEQ_CST) < Count) {
+    }
+    HOST_CHECK (Signaled[0] + Signaled[1] == Count, "%lu requests signaled %u times",
+      (unsigned long) Count, Signaled[0] + Signaled[1]);
+  }
+
+  FreePool (Buffers);
+
+  return Elapsed;
+}
+
+STATIC
+VOID
+Bench (
+  VOID
+  )
+{
+  STATIC CONST UINT64   WorkNs[] = { 500000, 2000000, 8000000 };
+  MOCK_BIODEV           *Mock;
+  UINTN                 Index;
+  UINTN                 ChunkSize;
+  UINTN                 Count;
+  UINT64                Sync;
+  UINT64                Async;
+
+  // roughly an eMMC doing 256KB reads: 200us per command, 100MB/s
+  ChunkSize = 256 * 1024;
+  Count = 16;
+  Mock = MockBioDevCreate (&mApi, BLOCK_SIZE, ChunkSize / BLOCK_SIZE * Count, 200000, 100 * SIZE_1MB);
+  ASSERT (Mock != NULL);
+  HostFillRandom (Mock->Data, ChunkSize * Count, 3);
+
+  printf ("%u x %luKB reads, %lu us each\n", (unsigned) Count, (unsigned long) ChunkSize / 1024,
+    (unsigned long) (Mock->LatencyNs + (UINT64) ChunkSize * 1000000000 / Mock->BytesPerSecond) / 1000);
+  printf ("work/chunk   blocking  overlapped  speedup\n");
+  for (Index = 0; Index < ARRAY_SIZE (WorkNs); Index++) {
+    Sync = RunReader (Mock, FALSE, ChunkSize, Count, WorkNs[Index]);
+    Async = RunReader (Mock, TRUE, ChunkSize, Count, WorkNs[Index]);
+    printf ("%7lu us %8lu ms %8lu ms %8.2fx\n", (unsigned long) (WorkNs[Index] / 1000),
+      (unsigned long) (Sync / 1000000), (unsigned long) (Async / 1000000), (double) Sync / Async);
+  }
+
+  MockBioDevDestroy (Mock);
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  MOCK_BIODEV   *Mock;
+
+  mApi.event_signal = TestEventSignal;
+
+  Mock = MockBioDevCreate (&mApi, BLOCK_SIZE, NUM_BLOCKS, 2000000, 0);
+  ASSERT (Mock != NULL);
+  TestSync (Mock);
+  TestSubmitErrors (Mock);
+  // destroys the device, to wait for the last event_signal
+  TestAsync (Mock);
+
+  Mock = MockBioDevCreate (&mApi, BLOCK_SIZE, NUM_BLOCKS, 50000, 0);
+  ASSERT (Mock != NULL);
+  HostFillRandom (Mock->Data, NUM_BLOCKS * BLOCK_SIZE, 4);
+  RunReader (Mock, TRUE, 16 * BLOCK_SIZE, 8, 0);
+  MockBioDevDestroy (Mock);
+
+  if (HostWantBench (Argc, Argv)) {
+    Bench ();
+  }
+
+  return HostDone (Argv[0]);
+}
@@ -0,0 +1,211 @@
+/** @file
+  Checks Library/Crc32Lib against a bitwise CRC-32 (ISO 3309).
+
+  Every combination of start offset and size up to a few words is tried,
+  so the alignment prologue, the bulk loop and the tail of both the table
+  and the instruction path get covered, and every split point of a buffer
+  is tried with Crc32Update. With --bench it also reports the throughput
+  against a byte at a time table.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <HostBase.h>
+
+#include <Library/Crc32Lib.h>
+
+BOOLEAN
+EFIAPI
+InternalCrc32HwSupported (
+  VOID
+  );
+
+#define TEST_BUFFER_SIZE  1024
+#define BENCH_SIZE        SIZE_4MB
+#define BENCH_ROUNDS      16
+
+STATIC UINT32   mByteTable[256];
+
+STATIC
+UINT32
+ReferenceCrc32 (
+  IN CONST UINT8  *Buffer,
+  IN UINTN        Size
+  )
+{
+  UINT32  Crc;
+  UINTN   Bit;
+
+  Crc = 0xffffffff;
+  while (Size-- != 0) {
+    Crc ^= *Buffer++;
+    for (Bit = 0; Bit < 8; Bit++) {
+      Crc = (Crc & 1) ? (Crc >> 1) ^ 0xedb88320 : (Crc >> 1);
+    }
+  }
+
+  return ~Crc;
+}
+
+STATIC
+UINT32
+ByteTableCrc32 (
+  IN CONST UINT8  *Buffer,
+  IN UINTN        Size
+  )
+{
+  UINT32  Crc;
+
+  Crc = 0xffffffff;
+  while (Size-- != 0) {
+    Crc = mByteTable[(Crc ^ *Buffer++) & 0xff] ^ (Crc >> 8);
+  }
+
+  return ~Crc;
+}
+
+STATIC
+VOID
+TestKnownValues (
+  VOID
+  )
+{
+  STATIC CONST CHAR8  Check[] = "123456789";
+
+  HOST_CHECK (ReferenceCrc32 ((CONST UINT8 *) Check, 9) == 0xcbf43926, "reference CRC-32 is wrong");
+  HOST_CHECK (Crc32Calculate (Check, 9) == 0xcbf43926,
+    "Crc32Calculate(\"123456789\") = %08x, expected cbf43926", Crc32Calculate (Check, 9));
+  HOST_CHECK (Crc32Calculate (Check, 0) == 0, "CRC32 of nothing isn't 0");
+}
+
+STATIC
+VOID
+TestUnaligned (
+  IN CONST UINT8  *Data
+  )
+{
+  UINTN   Offset;
+  UINTN   Size;
+  UINT32  Expected;
+  UINT32  Crc;
+
+  for (Offset = 0; Offset < 16; Offset++) {
+    for (Size = 0; Size + Offset <= TEST_BUFFER_SIZE; Size += (Size < 64) ? 1 : 61) {
+      Expected = ReferenceCrc32 (Data + Offset, Size);
+      Crc = Crc32Calculate (Data + Offset, Size);
+      HOST_CHECK (Crc == Expected, "offset %lu size %lu: %08x, expected %08x",
+        (unsigned long) Offset, (unsigned long) Size, Crc, Expected);
+    }
+  }
+}
+
+STATIC
+VOID
+TestSplit (
+  IN CONST UINT8  *Data
+  )
+{
+  UINTN   Size;
+  UINTN   Split;
+  UINTN   Split2;
+  UINT32  Expected;
+  UINT32  Crc;
+
+  Size = 301;
+  Expected = ReferenceCrc32 (Data + 3, Size);
+
+  for (Split = 0; Split <= Size; Split++) {
+    Crc = Crc32Update (0, Data + 3, Split);
+    Crc = Crc32Update (Crc, Data + 3 + Split, Size - Split);
+    HOST_CHECK (Crc == Expected, "split at %lu: %08x, expected %08x", (unsigned long) Split, Crc, Expected);
+  }
+
+  // three pieces, so the middle one starts and ends anywhere
+  for (Split = 0; Split <= 40; Split++) {
+    for (Split2 = Split; Split2 <= 40; Split2++) {
+      Crc = Crc32Update (0, Data + 3, Split);
+      Crc = Crc32Update (Crc, Data + 3 + Split, Split2 - Split);
+      Crc = Crc32Update (Crc, Data + 3 + Split2, Size - Split2);
+      HOST_CHECK (Crc == Expected, "split at %lu/%lu: %08x, expected %08x",
+        (unsigned long) Split, (unsigned long) Split2, Crc, Expected);
+    }
+  }
+}
+
+STATIC
+VOID
+Bench (
+  VOID
+  )
+{
+  UINT8   *Data;
+  UINT64  Start;
+  UINT64  Fast;
+  UINT64  Slow;
+  UINT32  Sink;
+  UINTN   Round;
+  UINTN   Index;
+  UINTN   Bit;
+  UINT32  Value;
+
+  for (Index = 0; Index < 256; Index++) {
+    Value = (UINT32) Index;
+    for (Bit = 0; Bit < 8; Bit++) {
+      Value = (Value & 1) ? (Value >> 1) ^ 0xedb88320 : (Value >> 1);
+    }
+    mByteTable[Index] = Value;
+  }
+
+  Data = AllocatePool (BENCH_SIZE + 1);
+  ASSERT (Data != NULL);
+  HostFillRandom (Data, BENCH_SIZE + 1, 0x1234);
+
+  Sink = 0;
+  Start = HostTimeNs ();
+  for (Round = 0; Round < BENCH_ROUNDS; Round++) {
+    Sink += Crc32Calculate (Data + (Round & 1), BENCH_SIZE);
+  }
+  Fast = HostTimeNs () - Start;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < BENCH_ROUNDS; Round++) {
+    Sink += ByteTableCrc32 (Data + (Round & 1), BENCH_SIZE);
+  }
+  Slow = HostTimeNs () - Start;
+
+  printf ("Crc32Lib   %8.1f MB/s\n", (double) BENCH_SIZE * BENCH_ROUNDS * 1e9 / Fast / SIZE_1MB);
+  printf ("byte table %8.1f MB/s\n", (double) BENCH_SIZE * BENCH_ROUNDS * 1e9 / Slow / SIZE_1MB);
+  printf ("speedup    %8.2fx (%08x)\n", (double) Slow / Fast, Sink);
+
+  FreePool (Data);
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  UINT8   Data[TEST_BUFFER_SIZE];
+
+  printf ("Crc32Lib using the %s path\n", InternalCrc32HwSupported () ? "CRC32 instruction" : "slicing-by-8");
+
+  HostFillRandom (Data, sizeof (Data), 0xc0ffee);
+
+  TestKnownValues ();
+  TestUnaligned (Data);
+  TestSplit (Data);
+
+  if (HostWantBench (Argc, Argv)) {
+    Bench ();
+  }
+
+  return HostDone (Argv[0]);
+}
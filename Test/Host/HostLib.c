@@ -0,0 +1,66 @@
+/** @file
+  Helpers shared by the host tests.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <HostBase.h>
+
+UINTN HostFailures;
+
+BOOLEAN
+HostWantBench (
+  IN int   Argc,
+  IN char  **Argv
+  )
+{
+  int   Index;
+
+  for (Index = 1; Index < Argc; Index++) {
+    if (strcmp (Argv[Index], "--bench") == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+int
+HostDone (
+  IN CONST char *Name
+  )
+{
+  if (HostFailures != 0) {
+    printf ("%s: %lu check(s) FAILED\n", Name, (unsigned long) HostFailures);
+    return 1;
+  }
+
+  printf ("%s: PASS\n", Name);
+  return 0;
+}
+
+VOID
+HostFillRandom (
+  OUT VOID    *Buffer,
+  IN  UINTN   Size,
+  IN  UINT32  Seed
+  )
+{
+  UINT8   *Out;
+
+  Out = Buffer;
+  while (Size-- != 0) {
+    // xorshift32, the tests only need reproducible noise
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    *Out++ = (UINT8) Seed;
+  }
+}
@@ -0,0 +1,364 @@
+/** @file
+  Host versions of the boot services, Print and device path functions
+  declared in Include/HostUefi.h.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <stdarg.h>
+
+#include <HostUefi.h>
+
+EFI_GUID gEfiBlockIoProtocolGuid     = { 0x964e5b21, 0x6459, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiDevicePathProtocolGuid  = { 0x09576e91, 0x6d3f, 0x11d2, { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiLoadedImageProtocolGuid = { 0x5b1b31a1, 0x9562, 0x11d2, { 0x8e, 0x3f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+
+#define HOST_MAX_HANDLES    32
+#define HOST_MAX_PROTOCOLS  8
+
+typedef struct {
+  EFI_GUID  *Protocol;
+  VOID      *Interface;
+} HOST_PROTOCOL;
+
+typedef struct {
+  HOST_PROTOCOL   Protocols[HOST_MAX_PROTOCOLS];
+  UINTN           ProtocolCount;
+} HOST_HANDLE;
+
+STATIC HOST_HANDLE  mHandles[HOST_MAX_HANDLES];
+STATIC UINTN        mHandleCount;
+
+STATIC
+VOID *
+HostFindProtocol (
+  IN HOST_HANDLE  *Handle,
+  IN EFI_GUID     *Protocol
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < Handle->ProtocolCount; Index++) {
+    if (CompareGuid (Handle->Protocols[Index].Protocol, Protocol)) {
+      return Handle->Protocols[Index].Interface;
+    }
+  }
+
+  return NULL;
+}
+
+EFI_STATUS
+HostInstallProtocol (
+  IN OUT EFI_HANDLE   *Handle,
+  IN     EFI_GUID     *Protocol,
+  IN     VOID         *Interface
+  )
+{
+  HOST_HANDLE   *Entry;
+
+  if (*Handle == NULL) {
+    if (mHandleCount == HOST_MAX_HANDLES) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    *Handle = &mHandles[mHandleCount++];
+  }
+
+  Entry = *Handle;
+  if (HostFindProtocol (Entry, Protocol) != NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Entry->ProtocolCount == HOST_MAX_PROTOCOLS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Entry->Protocols[Entry->ProtocolCount].Protocol  = Protocol;
+  Entry->Protocols[Entry->ProtocolCount].Interface = Interface;
+  Entry->ProtocolCount++;
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostHandleProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface
+  )
+{
+  if (Handle == NULL || Protocol == NULL || Interface == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  *Interface = HostFindProtocol (Handle, Protocol);
+  return (*Interface != NULL) ? EFI_SUCCESS : EFI_UNSUPPORTED;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostLocateHandleBuffer (
+  IN  EFI_LOCATE_SEARCH_TYPE  SearchType,
+  IN  EFI_GUID                *Protocol,
+  IN  VOID                    *SearchKey,
+  OUT UINTN                   *NoHandles,
+  OUT EFI_HANDLE              **Buffer
+  )
+{
+  UINTN   Index;
+
+  if (SearchType == ByRegisterNotify) {
+    return EFI_UNSUPPORTED;
+  }
+
+  *Buffer = AllocatePool ((mHandleCount + 1) * sizeof (EFI_HANDLE));
+  if (*Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  *NoHandles = 0;
+  for (Index = 0; Index < mHandleCount; Index++) {
+    if (SearchType == AllHandles || HostFindProtocol (&mHandles[Index], Protocol) != NULL) {
+      (*Buffer)[(*NoHandles)++] = &mHandles[Index];
+    }
+  }
+
+  if (*NoHandles == 0) {
+    FreePool (*Buffer);
+    *Buffer = NULL;
+    return EFI_NOT_FOUND;
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_TPL  gHostTpl = TPL_APPLICATION;
+
+STATIC
+EFI_TPL
+EFIAPI
+HostRaiseTpl (
+  IN EFI_TPL      NewTpl
+  )
+{
+  EFI_TPL   OldTpl;
+
+  ASSERT (NewTpl >= gHostTpl);
+  OldTpl   = gHostTpl;
+  gHostTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+HostRestoreTpl (
+  IN EFI_TPL      OldTpl
+  )
+{
+  ASSERT (OldTpl <= gHostTpl);
+  gHostTpl = OldTpl;
+}
+
+STATIC EFI_BOOT_SERVICES  mBootServices = {
+  HostRaiseTpl,
+  HostRestoreTpl,
+  HostHandleProtocol,
+  HostLocateHandleBuffer
+};
+
+EFI_BOOT_SERVICES  *gBS = &mBootServices;
+
+STATIC
+CONST CHAR8 *
+HostStatusText (
+  IN EFI_STATUS   Status
+  )
+{
+  STATIC CONST CHAR8  *Errors[] = {
+    "Success", "Load Error", "Invalid Parameter", "Unsupported", "Bad Buffer Size",
+    "Buffer Too Small", "Not Ready", "Device Error", "Write Protected", "Out of Resources",
+    "Volume Corrupt", "Volume Full", "No Media", "Media changed", "Not Found"
+  };
+  STATIC CHAR8        Unknown[32];
+
+  if (Status == EFI_SUCCESS) {
+    return Errors[0];
+  }
+  if (EFI_ERROR (Status) && (Status & ~MAX_BIT) < ARRAY_SIZE (Errors)) {
+    return Errors[Status & ~MAX_BIT];
+  }
+
+  snprintf (Unknown, sizeof (Unknown), "%lx", (unsigned long) Status);
+  return Unknown;
+}
+
+UINTN
+EFIAPI
+Print (
+  IN CONST CHAR16   *Format,
+  ...
+  )
+{
+  va_list       Marker;
+  CHAR8         Spec[16];
+  UINTN         SpecLength;
+  BOOLEAN       Long;
+  CONST CHAR16  *String;
+  CHAR8         Narrow[256];
+  UINTN         Index;
+  UINTN         Count;
+
+  Count = 0;
+  va_start (Marker, Format);
+
+  for (; *Format != 0; Format++) {
+    if (*Format != L'%') {
+      putchar ((int) *Format);
+      Count++;
+      continue;
+    }
+
+    // copy the flags and the width, they mean the same to printf
+    SpecLength = 0;
+    Spec[SpecLength++] = '%';
+    Format++;
+    while ((*Format == L'-' || *Format == L'0' || (*Format >= L'1' && *Format <= L'9')) && SpecLength < sizeof (Spec) - 4) {
+      Spec[SpecLength++] = (CHAR8) *Format++;
+    }
+    Long = FALSE;
+    while (*Format == L'L' || *Format == L'l') {
+      Long = TRUE;
+      Format++;
+    }
+
+    switch (*Format) {
+      case L'u':
+      case L'd':
+      case L'x':
+      case L'X':
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = 'l';
+        Spec[SpecLength++] = (CHAR8) *Format;
+        Spec[SpecLength] = 0;
+        if (*Format == L'd') {
+          Count += printf (Spec, Long ? (long long) va_arg (Marker, INT64) : (long long) va_arg (Marker, int));
+        } else {
+          Count += printf (Spec, Long ? (unsigned long long) va_arg (Marker, UINT64) : (unsigned long long) va_arg (Marker, unsigned int));
+        }
+        break;
+
+      case L's':
+        String = va_arg (Marker, CONST CHAR16 *);
+        for (Index = 0; String[Index] != 0 && Index < sizeof (Narrow) - 1; Index++) {
+          Narrow[Index] = (CHAR8) String[Index];
+        }
+        Narrow[Index] = 0;
+        Spec[SpecLength++] = 's';
+        Spec[SpecLength] = 0;
+        Count += printf (Spec, Narrow);
+        break;
+
+      case L'a':
+        Spec[SpecLength++] = 's';
+        Spec[SpecLength] = 0;
+        Count += printf (Spec, va_arg (Marker, CONST CHAR8 *));
+        break;
+
+      case L'r':
+        Spec[SpecLength++] = 's';
+        Spec[SpecLength] = 0;
+        Count += printf (Spec, HostStatusText (va_arg (Marker, EFI_STATUS)));
+        break;
+
+      case L'c':
+        putchar (va_arg (Marker, int));
+        Count++;
+        break;
+
+      case L'%':
+        putchar ('%');
+        Count++;
+        break;
+
+      default:
+        // not needed so far
+        ASSERT (FALSE);
+        break;
+    }
+
+    if (*Format == 0) {
+      break;
+    }
+  }
+
+  va_end (Marker);
+
+  return Count;
+}
+
+EFI_DEVICE_PATH_PROTOCOL *
+DevicePathFromHandle (
+  IN EFI_HANDLE     Handle
+  )
+{
+  VOID  *DevicePath;
+
+  if (EFI_ERROR (gBS->HandleProtocol (Handle, &gEfiDevicePathProtocolGuid, &DevicePath))) {
+    return NULL;
+  }
+
+  return DevicePath;
+}
+
+CHAR16 *
+ConvertDevicePathToText (
+  IN CONST EFI_DEVICE_PATH_PROTOCOL   *DevicePath,
+  IN BOOLEAN                          DisplayOnly,
+  IN BOOLEAN                          AllowShortcuts
+  )
+{
+  CHAR8               Text[256];
+  UINTN               Length;
+  CHAR16              *Result;
+  CONST EFI_GUID      *Guid;
+  UINTN               Index;
+
+  if (DevicePath == NULL) {
+    return NULL;
+  }
+
+  Length = 0;
+  Text[0] = 0;
+  for (; !IsDevicePathEnd (DevicePath) && Length < sizeof (Text) - 64; DevicePath = NextDevicePathNode (DevicePath)) {
+    if (Length != 0) {
+      Text[Length++] = '/';
+    }
+    if (DevicePathType (DevicePath) == HARDWARE_DEVICE_PATH && DevicePathSubType (DevicePath) == HW_VENDOR_DP) {
+      Guid = &((CONST VENDOR_DEVICE_PATH *) DevicePath)->Guid;
+      Length += snprintf (Text + Length, sizeof (Text) - Length,
+                  "VenHw(%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X)",
+                  Guid->Data1, Guid->Data2, Guid->Data3, Guid->Data4[0], Guid->Data4[1], Guid->Data4[2],
+                  Guid->Data4[3], Guid->Data4[4], Guid->Data4[5], Guid->Data4[6], Guid->Data4[7]);
+    } else {
+      Length += snprintf (Text + Length, sizeof (Text) - Length, "?");
+    }
+  }
+
+  Result = AllocatePool ((Length + 1) * sizeof (CHAR16));
+  if (Result != NULL) {
+    for (Index = 0; Index <= Length; Index++) {
+      Result[Index] = (CHAR16) Text[Index];
+    }
+  }
+
+  return Result;
+}
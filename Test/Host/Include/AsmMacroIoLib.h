@@ -0,0 +1,15 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_ASM_MACRO_IO_LIB_H__
+#define __HOST_ASM_MACRO_IO_LIB_H__
+
+#define ASM_PFX(name)         name
+#define GCC_ASM_EXPORT(name)  .global ASM_PFX(name)
+
+#define ASM_FUNC(Name)        \
+  .text                     ; \
+  .global   ASM_PFX(Name)   ; \
+  .type     ASM_PFX(Name), %function ; \
+  .p2align  2               ; \
+  ASM_PFX(Name):
+
+#endif
@@ -0,0 +1,7 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_BASE_H__
+#define __HOST_BASE_H__
+
+#include <HostBase.h>
+
+#endif
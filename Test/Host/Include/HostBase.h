@@ -0,0 +1,285 @@
+/** @file
+  Just enough of the EDK2 base types and libraries to build LittleKernelPkg
+  sources as ordinary host programs. The headers next to this one stand in
+  for the EDK2 ones of the same name and all come down to this file.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __HOSTBASE_H__
+#define __HOSTBASE_H__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t     UINT8;
+typedef int8_t      INT8;
+typedef uint16_t    UINT16;
+typedef int16_t     INT16;
+typedef uint32_t    UINT32;
+typedef int32_t     INT32;
+typedef uint64_t    UINT64;
+typedef int64_t     INT64;
+typedef uintptr_t   UINTN;
+typedef intptr_t    INTN;
+typedef uint8_t     BOOLEAN;
+typedef char        CHAR8;
+// L"" strings are 16 bits wide with -fshort-wchar
+typedef uint16_t    CHAR16;
+typedef void        VOID;
+
+#define TRUE        ((BOOLEAN)1)
+#define FALSE       ((BOOLEAN)0)
+
+#define CONST       const
+#define STATIC      static
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+
+#define MAX_UINT32  UINT32_MAX
+#define MAX_UINT64  UINT64_MAX
+#define MAX_UINTN   UINTPTR_MAX
+
+#define SIZE_512    0x00000200
+#define SIZE_1KB    0x00000400
+#define SIZE_4KB    0x00001000
+#define SIZE_1MB    0x00100000
+#define SIZE_4MB    0x00400000
+#define SIZE_16MB   0x01000000
+
+#define MIN(a, b)               (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)               (((a) > (b)) ? (a) : (b))
+#define ALIGN_VALUE(Value, Alignment) ((Value) + (((Alignment) - (Value)) & ((Alignment) - 1)))
+#define OFFSET_OF(TYPE, Field)  ((UINTN) offsetof (TYPE, Field))
+#define BASE_CR(Record, TYPE, Field) ((TYPE *) ((CHAR8 *) (Record) - OFFSET_OF (TYPE, Field)))
+#define ARRAY_SIZE(Array)       (sizeof (Array) / sizeof ((Array)[0]))
+
+//
+// DebugLib
+//
+#define DEBUG_INFO    0x00000040
+#define DEBUG_WARN    0x00000002
+#define DEBUG_ERROR   0x80000000
+#define EFI_D_INFO    DEBUG_INFO
+#define EFI_D_WARN    DEBUG_WARN
+#define EFI_D_ERROR   DEBUG_ERROR
+
+#define DEBUG(Expression)       do { } while (0)
+#define ASSERT(Expression)      assert (Expression)
+
+//
+// BaseMemoryLib and MemoryAllocationLib
+//
+static inline VOID *CopyMem (VOID *Destination, CONST VOID *Source, UINTN Length)
+{
+  return memmove (Destination, Source, Length);
+}
+
+static inline VOID *SetMem (VOID *Buffer, UINTN Length, UINT8 Value)
+{
+  return memset (Buffer, Value, Length);
+}
+
+static inline VOID *ZeroMem (VOID *Buffer, UINTN Length)
+{
+  return memset (Buffer, 0, Length);
+}
+
+static inline VOID *AllocatePool (UINTN Size)
+{
+  return malloc (Size);
+}
+
+static inline VOID *AllocateZeroPool (UINTN Size)
+{
+  return calloc (1, Size);
+}
+
+static inline VOID FreePool (VOID *Buffer)
+{
+  free (Buffer);
+}
+
+static inline VOID *AllocatePages (UINTN Pages)
+{
+  return aligned_alloc (SIZE_4KB, Pages * SIZE_4KB);
+}
+
+static inline VOID FreePages (VOID *Buffer, UINTN Pages)
+{
+  free (Buffer);
+}
+
+//
+// BaseLib
+//
+static inline UINT64 MultU64x32 (UINT64 Multiplicand, UINT32 Multiplier)
+{
+  return Multiplicand * Multiplier;
+}
+
+static inline UINT64 DivU64x32 (UINT64 Dividend, UINT32 Divisor)
+{
+  return Dividend / Divisor;
+}
+
+static inline UINT32 ModU64x32 (UINT64 Dividend, UINT32 Divisor)
+{
+  return (UINT32) (Dividend % Divisor);
+}
+
+static inline UINT64 DivU64x64Remainder (UINT64 Dividend, UINT64 Divisor, UINT64 *Remainder)
+{
+  if (Remainder != NULL) {
+    *Remainder = Dividend % Divisor;
+  }
+  return Dividend / Divisor;
+}
+
+static inline UINT64 LShiftU64 (UINT64 Operand, UINTN Count)
+{
+  return Operand << Count;
+}
+
+static inline UINT64 RShiftU64 (UINT64 Operand, UINTN Count)
+{
+  return Operand >> Count;
+}
+
+static inline UINTN StrLen (CONST CHAR16 *String)
+{
+  UINTN Length;
+
+  for (Length = 0; String[Length] != 0; Length++) {
+  }
+  return Length;
+}
+
+static inline CHAR16 *StrStr (CONST CHAR16 *String, CONST CHAR16 *SearchString)
+{
+  UINTN Length;
+
+  Length = StrLen (SearchString);
+  for (; *String != 0; String++) {
+    if (memcmp (String, SearchString, Length * sizeof (CHAR16)) == 0) {
+      return (CHAR16 *) String;
+    }
+  }
+  return (Length == 0) ? (CHAR16 *) String : NULL;
+}
+
+//
+// BaseLib linked lists
+//
+typedef struct _LIST_ENTRY  LIST_ENTRY;
+
+struct _LIST_ENTRY {
+  LIST_ENTRY  *ForwardLink;
+  LIST_ENTRY  *BackLink;
+};
+
+static inline LIST_ENTRY *InitializeListHead (LIST_ENTRY *ListHead)
+{
+  ListHead->ForwardLink = ListHead;
+  ListHead->BackLink    = ListHead;
+  return ListHead;
+}
+
+static inline LIST_ENTRY *InsertHeadList (LIST_ENTRY *ListHead, LIST_ENTRY *Entry)
+{
+  Entry->ForwardLink              = ListHead->ForwardLink;
+  Entry->BackLink                 = ListHead;
+  Entry->ForwardLink->BackLink    = Entry;
+  ListHead->ForwardLink           = Entry;
+  return ListHead;
+}
+
+static inline LIST_ENTRY *InsertTailList (LIST_ENTRY *ListHead, LIST_ENTRY *Entry)
+{
+  Entry->ForwardLink              = ListHead;
+  Entry->BackLink                 = ListHead->BackLink;
+  Entry->BackLink->ForwardLink    = Entry;
+  ListHead->BackLink              = Entry;
+  return ListHead;
+}
+
+static inline LIST_ENTRY *RemoveEntryList (CONST LIST_ENTRY *Entry)
+{
+  Entry->ForwardLink->BackLink = Entry->BackLink;
+  Entry->BackLink->ForwardLink = Entry->ForwardLink;
+  return Entry->ForwardLink;
+}
+
+static inline LIST_ENTRY *GetFirstNode (CONST LIST_ENTRY *List)
+{
+  return List->ForwardLink;
+}
+
+static inline LIST_ENTRY *GetNextNode (CONST LIST_ENTRY *List, CONST LIST_ENTRY *Node)
+{
+  return Node->ForwardLink;
+}
+
+static inline LIST_ENTRY *GetPreviousNode (CONST LIST_ENTRY *List, CONST LIST_ENTRY *Node)
+{
+  return Node->BackLink;
+}
+
+static inline BOOLEAN IsNull (CONST LIST_ENTRY *List, CONST LIST_ENTRY *Node)
+{
+  return (BOOLEAN) (Node == List);
+}
+
+static inline BOOLEAN IsListEmpty (CONST LIST_ENTRY *ListHead)
+{
+  return (BOOLEAN) (ListHead->ForwardLink == ListHead);
+}
+
+//
+// Monotonic time for the benchmarks
+//
+static inline UINT64 HostTimeNs (VOID)
+{
+  struct timespec Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return (UINT64) Now.tv_sec * 1000000000 + Now.tv_nsec;
+}
+
+//
+// Reports a failed check and counts it, tests exit with HostFailures != 0
+//
+extern UINTN HostFailures;
+
+#define HOST_CHECK(Expression, ...)                             \
+  do {                                                          \
+    if (!(Expression)) {                                        \
+      fprintf (stderr, "%s:%d: ", __FILE__, __LINE__);          \
+      fprintf (stderr, __VA_ARGS__);                            \
+      fputc ('\n', stderr);                                     \
+      HostFailures++;                                           \
+    }                                                           \
+  } while (0)
+
+//
+// HostLib.c
+//
+BOOLEAN HostWantBench (int Argc, char **Argv);
+int     HostDone (CONST char *Name);
+VOID    HostFillRandom (VOID *Buffer, UINTN Size, UINT32 Seed);
+
+#endif
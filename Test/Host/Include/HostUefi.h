@@ -0,0 +1,177 @@
+/** @file
+  The part of the UEFI spec the host builds need: the base types, status
+  codes, a handle database behind gBS->HandleProtocol and
+  gBS->LocateHandleBuffer, Print and device paths. See HostUefi.c.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __HOSTUEFI_H__
+#define __HOSTUEFI_H__
+
+#include <HostBase.h>
+
+typedef struct {
+  UINT32  Data1;
+  UINT16  Data2;
+  UINT16  Data3;
+  UINT8   Data4[8];
+} EFI_GUID;
+
+typedef UINTN   EFI_STATUS;
+typedef VOID    *EFI_HANDLE;
+typedef VOID    *EFI_EVENT;
+typedef UINTN   EFI_TPL;
+typedef UINT64  EFI_LBA;
+
+typedef struct _EFI_SYSTEM_TABLE  EFI_SYSTEM_TABLE;
+
+#define MAX_BIT                   ((UINTN) 1 << (sizeof (UINTN) * 8 - 1))
+#define ENCODE_ERROR(StatusCode)  ((EFI_STATUS) (MAX_BIT | (StatusCode)))
+#define EFI_ERROR(StatusCode)     (((INTN) (StatusCode)) < 0)
+
+#define EFI_SUCCESS               0
+#define EFI_LOAD_ERROR            ENCODE_ERROR (1)
+#define EFI_INVALID_PARAMETER     ENCODE_ERROR (2)
+#define EFI_UNSUPPORTED           ENCODE_ERROR (3)
+#define EFI_BAD_BUFFER_SIZE       ENCODE_ERROR (4)
+#define EFI_BUFFER_TOO_SMALL      ENCODE_ERROR (5)
+#define EFI_NOT_READY             ENCODE_ERROR (6)
+#define EFI_DEVICE_ERROR          ENCODE_ERROR (7)
+#define EFI_WRITE_PROTECTED       ENCODE_ERROR (8)
+#define EFI_OUT_OF_RESOURCES      ENCODE_ERROR (9)
+#define EFI_NO_MEDIA              ENCODE_ERROR (12)
+#define EFI_MEDIA_CHANGED         ENCODE_ERROR (13)
+#define EFI_NOT_FOUND             ENCODE_ERROR (14)
+
+#define EFI_PAGE_SIZE             SIZE_4KB
+#define EFI_SIZE_TO_PAGES(Size)   (((Size) / EFI_PAGE_SIZE) + (((Size) % EFI_PAGE_SIZE) ? 1 : 0))
+
+typedef enum {
+  AllHandles,
+  ByRegisterNotify,
+  ByProtocol
+} EFI_LOCATE_SEARCH_TYPE;
+
+#define TPL_APPLICATION   4
+#define TPL_CALLBACK      8
+#define TPL_NOTIFY        16
+#define TPL_HIGH_LEVEL    31
+
+typedef struct {
+  EFI_TPL     (EFIAPI *RaiseTPL) (EFI_TPL NewTpl);
+  VOID        (EFIAPI *RestoreTPL) (EFI_TPL OldTpl);
+  EFI_STATUS  (EFIAPI *HandleProtocol) (EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface);
+  EFI_STATUS  (EFIAPI *LocateHandleBuffer) (EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol,
+                                            VOID *SearchKey, UINTN *NoHandles, EFI_HANDLE **Buffer);
+} EFI_BOOT_SERVICES;
+
+extern EFI_BOOT_SERVICES  *gBS;
+
+// there are no events on the host, the TPL is only tracked and checked
+extern EFI_TPL            gHostTpl;
+
+static inline BOOLEAN CompareGuid (CONST EFI_GUID *Guid1, CONST EFI_GUID *Guid2)
+{
+  return memcmp (Guid1, Guid2, sizeof (EFI_GUID)) == 0;
+}
+
+//
+// Device paths
+//
+#define HARDWARE_DEVICE_PATH            0x01
+#define HW_VENDOR_DP                    0x04
+#define END_DEVICE_PATH_TYPE            0x7f
+#define END_ENTIRE_DEVICE_PATH_SUBTYPE  0xff
+
+typedef struct {
+  UINT8   Type;
+  UINT8   SubType;
+  UINT8   Length[2];
+} EFI_DEVICE_PATH_PROTOCOL;
+
+typedef struct {
+  EFI_DEVICE_PATH_PROTOCOL  Header;
+  EFI_GUID                  Guid;
+} VENDOR_DEVICE_PATH;
+
+static inline UINT8 DevicePathType (CONST VOID *Node)
+{
+  return ((CONST EFI_DEVICE_PATH_PROTOCOL *) Node)->Type;
+}
+
+static inline UINT8 DevicePathSubType (CONST VOID *Node)
+{
+  return ((CONST EFI_DEVICE_PATH_PROTOCOL *) Node)->SubType;
+}
+
+static inline UINTN DevicePathNodeLength (CONST VOID *Node)
+{
+  return ((CONST EFI_DEVICE_PATH_PROTOCOL *) Node)->Length[0] |
+         (((CONST EFI_DEVICE_PATH_PROTOCOL *) Node)->Length[1] << 8);
+}
+
+static inline EFI_DEVICE_PATH_PROTOCOL *NextDevicePathNode (CONST VOID *Node)
+{
+  return (EFI_DEVICE_PATH_PROTOCOL *) ((CONST UINT8 *) Node + DevicePathNodeLength (Node));
+}
+
+static inline BOOLEAN IsDevicePathEnd (CONST VOID *Node)
+{
+  return DevicePathType (Node) == END_DEVICE_PATH_TYPE && DevicePathSubType (Node) == END_ENTIRE_DEVICE_PATH_SUBTYPE;
+}
+
+//
+// HostUefi.c
+//
+extern EFI_GUID gEfiBlockIoProtocolGuid;
+extern EFI_GUID gEfiDevicePathProtocolGuid;
+extern EFI_GUID gEfiLoadedImageProtocolGuid;
+
+/**
+  Adds a protocol to a handle, creating the handle if *Handle is NULL.
+
+**/
+EFI_STATUS
+HostInstallProtocol (
+  IN OUT EFI_HANDLE   *Handle,
+  IN     EFI_GUID     *Protocol,
+  IN     VOID         *Interface
+  );
+
+/**
+  Prints a CHAR16 format string like UefiLib's Print does. Knows the flags,
+  widths and types the package uses, %s is a CHAR16 string.
+
+**/
+UINTN
+EFIAPI
+Print (
+  IN CONST CHAR16   *Format,
+  ...
+  );
+
+EFI_DEVICE_PATH_PROTOCOL *
+DevicePathFromHandle (
+  IN EFI_HANDLE     Handle
+  );
+
+/**
+  Only knows vendor hardware nodes, anything else comes out as "?".
+
+**/
+CHAR16 *
+ConvertDevicePathToText (
+  IN CONST EFI_DEVICE_PATH_PROTOCOL   *DevicePath,
+  IN BOOLEAN                          DisplayOnly,
+  IN BOOLEAN                          AllowShortcuts
+  );
+
+#endif
@@ -0,0 +1,7 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_LIBRARY_MEMORYALLOCATIONLIB_H__
+#define __HOST_LIBRARY_MEMORYALLOCATIONLIB_H__
+
+#include <HostBase.h>
+
+#endif
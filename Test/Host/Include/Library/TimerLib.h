@@ -0,0 +1,18 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_LIBRARY_TIMERLIB_H__
+#define __HOST_LIBRARY_TIMERLIB_H__
+
+#include <HostBase.h>
+
+// the counter runs in ns
+static inline UINT64 GetPerformanceCounter (VOID)
+{
+  return HostTimeNs ();
+}
+
+static inline UINT64 GetTimeInNanoSecond (UINT64 Ticks)
+{
+  return Ticks;
+}
+
+#endif
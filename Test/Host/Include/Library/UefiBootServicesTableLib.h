@@ -0,0 +1,7 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_LIBRARY_UEFIBOOTSERVICESTABLELIB_H__
+#define __HOST_LIBRARY_UEFIBOOTSERVICESTABLELIB_H__
+
+#include <HostUefi.h>
+
+#endif
@@ -0,0 +1,33 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_PROTOCOL_BLOCKIO_H__
+#define __HOST_PROTOCOL_BLOCKIO_H__
+
+#include <HostUefi.h>
+
+typedef struct _EFI_BLOCK_IO_PROTOCOL  EFI_BLOCK_IO_PROTOCOL;
+
+typedef struct {
+  UINT32    MediaId;
+  BOOLEAN   RemovableMedia;
+  BOOLEAN   MediaPresent;
+  BOOLEAN   LogicalPartition;
+  BOOLEAN   ReadOnly;
+  BOOLEAN   WriteCaching;
+  UINT32    BlockSize;
+  UINT32    IoAlign;
+  EFI_LBA   LastBlock;
+  EFI_LBA   LowestAlignedLba;
+  UINT32    LogicalBlocksPerPhysicalBlock;
+  UINT32    OptimalTransferLengthGranularity;
+} EFI_BLOCK_IO_MEDIA;
+
+struct _EFI_BLOCK_IO_PROTOCOL {
+  UINT64                Revision;
+  EFI_BLOCK_IO_MEDIA    *Media;
+  EFI_STATUS  (EFIAPI *Reset) (EFI_BLOCK_IO_PROTOCOL *This, BOOLEAN ExtendedVerification);
+  EFI_STATUS  (EFIAPI *ReadBlocks) (EFI_BLOCK_IO_PROTOCOL *This, UINT32 MediaId, EFI_LBA Lba, UINTN BufferSize, VOID *Buffer);
+  EFI_STATUS  (EFIAPI *WriteBlocks) (EFI_BLOCK_IO_PROTOCOL *This, UINT32 MediaId, EFI_LBA Lba, UINTN BufferSize, VOID *Buffer);
+  EFI_STATUS  (EFIAPI *FlushBlocks) (EFI_BLOCK_IO_PROTOCOL *This);
+};
+
+#endif
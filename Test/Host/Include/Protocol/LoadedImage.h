@@ -0,0 +1,18 @@
+// stands in for the EDK2 header of the same name
+#ifndef __HOST_PROTOCOL_LOADEDIMAGE_H__
+#define __HOST_PROTOCOL_LOADEDIMAGE_H__
+
+#include <HostUefi.h>
+
+typedef struct {
+  UINT32                    Revision;
+  EFI_HANDLE                ParentHandle;
+  EFI_SYSTEM_TABLE          *SystemTable;
+  EFI_HANDLE                DeviceHandle;
+  EFI_DEVICE_PATH_PROTOCOL  *FilePath;
+  VOID                      *Reserved;
+  UINT32                    LoadOptionsSize;
+  VOID                      *LoadOptions;
+} EFI_LOADED_IMAGE_PROTOCOL;
+
+#endif
@@ -0,0 +1,449 @@
+/** @file
+  Runs Application/LKBlockIoBench on the host, against mock devices.
+
+  Every image file becomes a device published the way MMCHSDxe does it:
+  BlockIo on a handle with a single vendor hardware device path node. The
+  BlockIo calls go to the mock's lkapi_biodev_t read/write, so the numbers
+  show the mock's latency and transfer rate plus the cost of BlockIo. With
+  -T every device also gets the trace protocol, with the requests of a
+  trace file, which the application then replays.
+
+  Usage: LKBlockIoBenchHost [-w] [-t] [-l LatencyUs] [-r MBps] [-b BlockSize]
+                            [-T TraceFile] [Image...]
+
+    -w, -t  passed on to LKBlockIoBench
+    -l      latency of every request, 50us by default
+    -r      transfer rate, 100MB/s by default, 0 for no transfer time
+    -b      block size, 512 by default
+    -T      trace to replay, one request per line: R|W Lba NumBlocks
+
+  Without images a 64MB device in memory gets used. Writes never reach the
+  image files.
+
+  Exits with 1 if a BlockIo request failed.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <unistd.h>
+
+#include <HostUefi.h>
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/LoadedImage.h>
+#include <Protocol/LKBlockIoTrace.h>
+
+#include "MockBioDev.h"
+
+// from LittleKernelPkg.dec
+EFI_GUID gEfiLKBlockIoTraceProtocolGuid = { 0x8f2d64b1, 0x3a7e, 0x4c05, { 0x9e, 0x18, 0x6b, 0xf0, 0x2d, 0x93, 0x5a, 0xc7 } };
+
+// MMCHSDxe's FILE_GUID, which its device paths use
+STATIC EFI_GUID mMMCHSGuid = { 0x8ba9db79, 0xd124, 0x4b6f, { 0x9e, 0xdf, 0x15, 0xb6, 0xe4, 0x1a, 0x7c, 0x00 } };
+
+#define HOST_MAX_DEVICES      8
+#define HOST_MEMORY_DEVICE    (64 * SIZE_1MB)
+#define HOST_MEDIA_ID         0x42
+
+EFI_STATUS
+EFIAPI
+LKBlockIoBenchMain (
+  IN EFI_HANDLE         ImageHandle,
+  IN EFI_SYSTEM_TABLE   *SystemTable
+  );
+
+typedef struct {
+  VENDOR_DEVICE_PATH          Vendor;
+  EFI_DEVICE_PATH_PROTOCOL    End;
+} HOST_DEVICE_PATH;
+
+typedef struct {
+  MOCK_BIODEV                     *Mock;
+  EFI_HANDLE                      Handle;
+  EFI_BLOCK_IO_PROTOCOL           BlockIo;
+  EFI_BLOCK_IO_MEDIA              Media;
+  HOST_DEVICE_PATH                DevicePath;
+  EFI_LK_BLOCK_IO_TRACE_PROTOCOL  Trace;
+  BOOLEAN                         Tracing;
+} HOST_BLOCK_DEVICE;
+
+#define HOST_BLOCK_DEVICE_FROM_BLOCK_IO(a)  BASE_CR (a, HOST_BLOCK_DEVICE, BlockIo)
+#define HOST_BLOCK_DEVICE_FROM_TRACE(a)     BASE_CR (a, HOST_BLOCK_DEVICE, Trace)
+
+STATIC lkapi_t                  mApi;
+STATIC HOST_BLOCK_DEVICE        mDevices[HOST_MAX_DEVICES];
+STATIC UINTN                    mDeviceCount;
+STATIC LK_BLOCK_IO_TRACE_ENTRY  *mTraceEntries;
+STATIC UINTN                    mTraceCount;
+STATIC UINTN                    mErrors;
+
+STATIC
+EFI_STATUS
+HostValidateRequest (
+  IN HOST_BLOCK_DEVICE  *Device,
+  IN UINT32             MediaId,
+  IN EFI_LBA            Lba,
+  IN UINTN              BufferSize,
+  IN VOID               *Buffer
+  )
+{
+  EFI_BLOCK_IO_MEDIA  *Media;
+
+  Media = &Device->Media;
+
+  if (MediaId != Media->MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+  if (Lba > Media->LastBlock || Lba + BufferSize / Media->BlockSize - 1 > Media->LastBlock) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (BufferSize % Media->BlockSize != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+  if (Buffer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostReset (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN BOOLEAN                ExtendedVerification
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+HostTransfer (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN BOOLEAN                Write,
+  IN UINT32                 MediaId,
+  IN EFI_LBA                Lba,
+  IN UINTN                  BufferSize,
+  IN VOID                   *Buffer
+  )
+{
+  HOST_BLOCK_DEVICE   *Device;
+  lkapi_biodev_t      *Dev;
+  EFI_STATUS          Status;
+  int                 Result;
+
+  Device = HOST_BLOCK_DEVICE_FROM_BLOCK_IO (This);
+  Dev = &Device->Mock->Dev;
+
+  if (BufferSize == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Status = HostValidateRequest (Device, MediaId, Lba, BufferSize, Buffer);
+  if (!EFI_ERROR (Status)) {
+    Result = Write ? Dev->write (Dev, Lba, BufferSize, Buffer) : Dev->read (Dev, Lba, BufferSize, Buffer);
+    Status = (Result == 0) ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+  }
+
+  if (EFI_ERROR (Status)) {
+    mErrors++;
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostReadBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN UINT32                 MediaId,
+  IN EFI_LBA                Lba,
+  IN UINTN                  BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  return HostTransfer (This, FALSE, MediaId, Lba, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostWriteBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN UINT32                 MediaId,
+  IN EFI_LBA                Lba,
+  IN UINTN                  BufferSize,
+  IN VOID                   *Buffer
+  )
+{
+  return HostTransfer (This, TRUE, MediaId, Lba, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostFlushBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+UINTN
+HostGetTrace (
+  IN  EFI_LK_BLOCK_IO_TRACE_PROTOCOL  *This,
+  OUT LK_BLOCK_IO_TRACE_ENTRY         **Entries
+  )
+{
+  *Entries = mTraceEntries;
+  return mTraceCount;
+}
+
+STATIC
+VOID
+HostClearTrace (
+  IN EFI_LK_BLOCK_IO_TRACE_PROTOCOL   *This
+  )
+{
+  // the trace is shared by all devices, and only read from a file anyway
+}
+
+STATIC
+BOOLEAN
+HostSetTracing (
+  IN EFI_LK_BLOCK_IO_TRACE_PROTOCOL   *This,
+  IN BOOLEAN                          Enable
+  )
+{
+  HOST_BLOCK_DEVICE   *Device;
+  BOOLEAN             Previous;
+
+  Device = HOST_BLOCK_DEVICE_FROM_TRACE (This);
+  Previous = Device->Tracing;
+  Device->Tracing = Enable;
+
+  return Previous;
+}
+
+/**
+  Reads a trace file, lines of "R|W Lba NumBlocks", # starts a comment.
+
+**/
+STATIC
+BOOLEAN
+HostLoadTrace (
+  IN CONST CHAR8  *Path
+  )
+{
+  FILE                *File;
+  CHAR8               Line[128];
+  CHAR8               Type;
+  unsigned long long  Lba;
+  unsigned long       NumBlocks;
+  UINTN               Capacity;
+  VOID                *Grown;
+
+  File = fopen (Path, "r");
+  if (File == NULL) {
+    return FALSE;
+  }
+
+  Capacity = 0;
+  while (fgets (Line, sizeof (Line), File) != NULL) {
+    if (sscanf (Line, " %c %llu %lu", &Type, &Lba, &NumBlocks) != 3 || (Type != 'R' && Type != 'W')) {
+      continue;
+    }
+
+    if (mTraceCount == Capacity) {
+      Capacity = MAX (Capacity * 2, 64);
+      Grown = realloc (mTraceEntries, Capacity * sizeof (LK_BLOCK_IO_TRACE_ENTRY));
+      if (Grown == NULL) {
+        fclose (File);
+        return FALSE;
+      }
+      mTraceEntries = Grown;
+    }
+
+    mTraceEntries[mTraceCount].Lba       = Lba;
+    mTraceEntries[mTraceCount].NumBlocks = (UINT32) NumBlocks;
+    mTraceEntries[mTraceCount].Type      = (Type == 'W') ? LK_BLOCK_IO_TRACE_WRITE : LK_BLOCK_IO_TRACE_READ;
+    mTraceCount++;
+  }
+
+  fclose (File);
+  return TRUE;
+}
+
+STATIC
+BOOLEAN
+HostAddDevice (
+  IN MOCK_BIODEV  *Mock,
+  IN BOOLEAN      Trace
+  )
+{
+  HOST_BLOCK_DEVICE   *Device;
+
+  if (Mock == NULL || mDeviceCount == HOST_MAX_DEVICES) {
+    return FALSE;
+  }
+
+  Device = &mDevices[mDeviceCount++];
+  Device->Mock = Mock;
+
+  Device->Media.MediaId      = HOST_MEDIA_ID;
+  Device->Media.MediaPresent = TRUE;
+  Device->Media.BlockSize    = Mock->Dev.block_size;
+  Device->Media.IoAlign      = 4;
+  Device->Media.LastBlock    = Mock->Dev.num_blocks - 1;
+
+  Device->BlockIo.Media       = &Device->Media;
+  Device->BlockIo.Reset       = HostReset;
+  Device->BlockIo.ReadBlocks  = HostReadBlocks;
+  Device->BlockIo.WriteBlocks = HostWriteBlocks;
+  Device->BlockIo.FlushBlocks = HostFlushBlocks;
+
+  Device->DevicePath.Vendor.Header.Type      = HARDWARE_DEVICE_PATH;
+  Device->DevicePath.Vendor.Header.SubType   = HW_VENDOR_DP;
+  Device->DevicePath.Vendor.Header.Length[0] = sizeof (VENDOR_DEVICE_PATH);
+  Device->DevicePath.Vendor.Guid             = mMMCHSGuid;
+  // like MMCHSDxe's, which tells its devices apart by the last byte
+  Device->DevicePath.Vendor.Guid.Data4[7]    = (UINT8) (mDeviceCount - 1);
+  Device->DevicePath.End.Type                = END_DEVICE_PATH_TYPE;
+  Device->DevicePath.End.SubType             = END_ENTIRE_DEVICE_PATH_SUBTYPE;
+  Device->DevicePath.End.Length[0]           = sizeof (EFI_DEVICE_PATH_PROTOCOL);
+
+  HostInstallProtocol (&Device->Handle, &gEfiBlockIoProtocolGuid, &Device->BlockIo);
+  HostInstallProtocol (&Device->Handle, &gEfiDevicePathProtocolGuid, &Device->DevicePath);
+
+  if (Trace) {
+    Device->Trace.GetTrace   = HostGetTrace;
+    Device->Trace.ClearTrace = HostClearTrace;
+    Device->Trace.SetTracing = HostSetTracing;
+    Device->Tracing          = TRUE;
+    HostInstallProtocol (&Device->Handle, &gEfiLKBlockIoTraceProtocolGuid, &Device->Trace);
+  }
+
+  return TRUE;
+}
+
+STATIC
+VOID
+HostUsage (
+  VOID
+  )
+{
+  fprintf (stderr, "usage: LKBlockIoBenchHost [-w] [-t] [-l LatencyUs] [-r MBps] [-b BlockSize] [-T TraceFile] [Image...]\n");
+  exit (2);
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  STATIC CHAR16               Options[32];
+  EFI_LOADED_IMAGE_PROTOCOL   LoadedImage;
+  EFI_HANDLE                  ImageHandle;
+  EFI_STATUS                  Status;
+  UINT64                      LatencyNs;
+  UINT64                      BytesPerSecond;
+  UINT32                      BlockSize;
+  CONST CHAR8                 *TracePath;
+  CONST CHAR8                 *Name;
+  UINTN                       Length;
+  UINTN                       Index;
+  int                         Option;
+
+  LatencyNs      = 50000;
+  BytesPerSecond = 100 * SIZE_1MB;
+  BlockSize      = 512;
+  TracePath      = NULL;
+
+  // the command line the shell would pass, the application only looks
+  // for " -w" and " -t" in it
+  Length = 0;
+  for (Name = "LKBlockIoBench"; *Name != 0; Name++) {
+    Options[Length++] = *Name;
+  }
+
+  while ((Option = getopt (Argc, Argv, "wtl:r:b:T:")) != -1) {
+    switch (Option) {
+      case 'w':
+      case 't':
+        Options[Length++] = L' ';
+        Options[Length++] = L'-';
+        Options[Length++] = (CHAR16) Option;
+        break;
+      case 'l':
+        LatencyNs = strtoull (optarg, NULL, 0) * 1000;
+        break;
+      case 'r':
+        BytesPerSecond = strtoull (optarg, NULL, 0) * SIZE_1MB;
+        break;
+      case 'b':
+        BlockSize = (UINT32) strtoul (optarg, NULL, 0);
+        break;
+      case 'T':
+        TracePath = optarg;
+        break;
+      default:
+        HostUsage ();
+    }
+  }
+  Options[Length++] = 0;
+
+  if (BlockSize == 0 || (BlockSize & (BlockSize - 1)) != 0) {
+    HostUsage ();
+  }
+
+  if (TracePath != NULL && !HostLoadTrace (TracePath)) {
+    fprintf (stderr, "can't read the trace %s\n", TracePath);
+    return 2;
+  }
+
+  if (optind == Argc) {
+    if (!HostAddDevice (MockBioDevCreate (&mApi, BlockSize, HOST_MEMORY_DEVICE / BlockSize, LatencyNs, BytesPerSecond), TracePath != NULL)) {
+      fprintf (stderr, "can't create the device\n");
+      return 2;
+    }
+  }
+  for (; optind < Argc; optind++) {
+    if (!HostAddDevice (MockBioDevOpenFile (&mApi, Argv[optind], BlockSize, LatencyNs, BytesPerSecond), TracePath != NULL)) {
+      fprintf (stderr, "can't use %s\n", Argv[optind]);
+      return 2;
+    }
+    printf ("%s is device %lu\n", Argv[optind], (unsigned long) mDeviceCount - 1);
+  }
+
+  ZeroMem (&LoadedImage, sizeof (LoadedImage));
+  LoadedImage.LoadOptions     = Options;
+  LoadedImage.LoadOptionsSize = (UINT32) (Length * sizeof (CHAR16));
+  ImageHandle = NULL;
+  HostInstallProtocol (&ImageHandle, &gEfiLoadedImageProtocolGuid, &LoadedImage);
+
+  Status = LKBlockIoBenchMain (ImageHandle, NULL);
+
+  for (Index = 0; Index < mDeviceCount; Index++) {
+    MockBioDevDestroy (mDevices[Index].Mock);
+  }
+  free (mTraceEntries);
+
+  if (EFI_ERROR (Status) || mErrors != 0) {
+    fprintf (stderr, "LKBlockIoBench: %lx, %lu failed requests\n", (unsigned long) Status, (unsigned long) mErrors);
+    return 1;
+  }
+
+  return 0;
+}
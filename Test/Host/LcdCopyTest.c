@@ -0,0 +1,426 @@
+/** @file
+  Checks LcdCopy of Drivers/LcdGraphicsOutputDxe against per-pixel
+  conversions to RGB888, RGB565 and XRGB8888, both unrotated and rotated,
+  for rectangles of all kinds of sizes and positions. With --bench it
+  times full frames against the per-pixel loop LcdCopy used to be.
+
+  LcdCopy.c gets included with the driver's header kept out, since that
+  pulls in the whole of GOP. The few driver types LcdCopy uses are
+  declared here instead and have to be kept in sync with
+  LcdGraphicsOutputDxe.h.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <HostBase.h>
+#include <LittleKernelApi.h>
+
+#define __ARM_VE_GRAPHICS_DXE_H__
+
+typedef UINT64  EFI_PHYSICAL_ADDRESS;
+
+typedef struct {
+  UINT32                                Left;
+  UINT32                                Top;
+  UINT32                                Right;
+  UINT32                                Bottom;
+} LCD_RECT;
+
+typedef
+VOID
+(EFIAPI *LCD_COPY_ROW) (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  );
+
+typedef struct {
+  UINT32                                HorizontalResolution;
+  UINT32                                VerticalResolution;
+} HOST_MODE_INFORMATION;
+
+typedef struct {
+  UINT32                                Mode;
+  EFI_PHYSICAL_ADDRESS                  FrameBufferBase;
+} HOST_GOP_MODE;
+
+typedef struct {
+  HOST_GOP_MODE                         *Mode;
+} HOST_GOP;
+
+typedef struct {
+  HOST_MODE_INFORMATION                 ModeInfo;
+  HOST_GOP                              Gop;
+  EFI_PHYSICAL_ADDRESS                  FrameBufferBase;
+  LCD_COPY_ROW                          CopyRow;
+} LCD_INSTANCE;
+
+STATIC INTN   mPixelFormat;
+
+INTN
+LcdGetPixelFormat (
+  VOID
+  )
+{
+  return mPixelFormat;
+}
+
+UINTN
+GetBytesPerPixel (
+  VOID
+  )
+{
+  switch (LcdGetPixelFormat ()) {
+    case LKAPI_LCD_PIXELFORMAT_RGB888:
+      return 3;
+    case LKAPI_LCD_PIXELFORMAT_RGB565:
+      return 2;
+    case LKAPI_LCD_PIXELFORMAT_XRGB8888:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// NEON is only there in HW=1 builds, where the stub isn't linked
+#define FixedPcdGet32(TokenName)  HOST_##TokenName
+#define HOST_PcdVFPEnabled        1
+
+#include "../../Drivers/LcdGraphicsOutputDxe/LcdCopy.c"
+
+#define PATTERN   0xa5
+
+STATIC CONST INTN   mFormats[] = {
+  LKAPI_LCD_PIXELFORMAT_RGB888,
+  LKAPI_LCD_PIXELFORMAT_RGB565,
+  LKAPI_LCD_PIXELFORMAT_XRGB8888
+};
+
+STATIC CONST CHAR8  *mFormatNames[] = { "RGB888", "RGB565", "XRGB8888" };
+
+typedef struct {
+  LCD_INSTANCE    Instance;
+  HOST_GOP_MODE   GopMode;
+  UINT32          *Shadow;
+  UINT8           *Vram;
+  UINT8           *Expected;
+  UINTN           VramSize;
+} HOST_LCD;
+
+STATIC
+VOID
+HostLcdInit (
+  OUT HOST_LCD  *Lcd,
+  IN  INTN      PixelFormat,
+  IN  UINT32    Mode,
+  IN  UINT32    Width,
+  IN  UINT32    Height
+  )
+{
+  ZeroMem (Lcd, sizeof (*Lcd));
+  mPixelFormat = PixelFormat;
+
+  Lcd->VramSize = (UINTN) Width * Height * GetBytesPerPixel ();
+  Lcd->Shadow   = AllocatePool ((UINTN) Width * Height * sizeof (UINT32));
+  Lcd->Vram     = AllocatePool (Lcd->VramSize);
+  Lcd->Expected = AllocatePool (Lcd->VramSize);
+  ASSERT (Lcd->Shadow != NULL && Lcd->Vram != NULL && Lcd->Expected != NULL);
+
+  HostFillRandom (Lcd->Shadow, (UINTN) Width * Height * sizeof (UINT32), Width * 31 + Height);
+
+  Lcd->GopMode.Mode                           = Mode;
+  Lcd->GopMode.FrameBufferBase                = (UINTN) Lcd->Shadow;
+  Lcd->Instance.Gop.Mode                      = &Lcd->GopMode;
+  Lcd->Instance.ModeInfo.HorizontalResolution = Width;
+  Lcd->Instance.ModeInfo.VerticalResolution   = Height;
+  Lcd->Instance.FrameBufferBase               = (UINTN) Lcd->Vram;
+
+  LcdSelectCopyRow (&Lcd->Instance);
+}
+
+STATIC
+VOID
+HostLcdFree (
+  IN HOST_LCD   *Lcd
+  )
+{
+  FreePool (Lcd->Shadow);
+  FreePool (Lcd->Vram);
+  FreePool (Lcd->Expected);
+}
+
+/**
+  Converts a pixel the obvious way.
+
+**/
+STATIC
+VOID
+ReferencePixel (
+  OUT UINT8     *Out,
+  IN  UINT32    Pixel
+  )
+{
+  UINT16  Rgb565;
+
+  switch (LcdGetPixelFormat ()) {
+    case LKAPI_LCD_PIXELFORMAT_RGB888:
+      Out[0] = Pixel & 0xff;
+      Out[1] = (Pixel >> 8) & 0xff;
+      Out[2] = (Pixel >> 16) & 0xff;
+      break;
+    case LKAPI_LCD_PIXELFORMAT_RGB565:
+      Rgb565 = (UINT16) ((((Pixel >> 16) & 0xff) >> 3) << 11 | (((Pixel >> 8) & 0xff) >> 2) << 5 | ((Pixel & 0xff) >> 3));
+      Out[0] = Rgb565 & 0xff;
+      Out[1] = Rgb565 >> 8;
+      break;
+    case LKAPI_LCD_PIXELFORMAT_XRGB8888:
+      CopyMem (Out, &Pixel, 4);
+      break;
+  }
+}
+
+STATIC
+VOID
+CheckRect (
+  IN HOST_LCD         *Lcd,
+  IN CONST LCD_RECT   *Rect
+  )
+{
+  UINT32  Width;
+  UINT32  Height;
+  UINT32  X;
+  UINT32  Y;
+  UINTN   Offset;
+  UINTN   BytesPerPixel;
+
+  Width = Lcd->Instance.ModeInfo.HorizontalResolution;
+  Height = Lcd->Instance.ModeInfo.VerticalResolution;
+  BytesPerPixel = GetBytesPerPixel ();
+
+  SetMem (Lcd->Vram, Lcd->VramSize, PATTERN);
+  SetMem (Lcd->Expected, Lcd->VramSize, PATTERN);
+
+  for (Y = Rect->Top; Y < Rect->Bottom; Y++) {
+    for (X = Rect->Left; X < Rect->Right; X++) {
+      if (Lcd->GopMode.Mode == 0) {
+        Offset = (UINTN) Y * Width + X;
+      } else {
+        // LEFT: source column x is panel line x, line y panel column Height-1-y
+        Offset = (UINTN) X * Height + (Height - 1 - Y);
+      }
+      ReferencePixel (Lcd->Expected + Offset * BytesPerPixel, Lcd->Shadow[(UINTN) Y * Width + X]);
+    }
+  }
+
+  LcdCopy (&Lcd->Instance, Rect);
+
+  if (memcmp (Lcd->Vram, Lcd->Expected, Lcd->VramSize) != 0) {
+    for (Offset = 0; Offset < Lcd->VramSize && Lcd->Vram[Offset] == Lcd->Expected[Offset]; Offset++) {
+    }
+    HOST_CHECK (FALSE, "%s mode %u %ux%u rect (%u,%u)-(%u,%u): byte %lu is %02x, expected %02x",
+      mFormatNames[LcdGetPixelFormat ()], Lcd->GopMode.Mode, Width, Height,
+      Rect->Left, Rect->Top, Rect->Right, Rect->Bottom,
+      (unsigned long) Offset, Lcd->Vram[Offset], Lcd->Expected[Offset]);
+  }
+}
+
+STATIC
+VOID
+TestCopy (
+  VOID
+  )
+{
+  // odd sizes, so rows and tiles don't come out even
+  STATIC CONST UINT32   Width = 101;
+  STATIC CONST UINT32   Height = 67;
+  HOST_LCD              Lcd;
+  LCD_RECT              Rect;
+  UINTN                 Format;
+  UINT32                Mode;
+  UINT32                Left;
+  UINT32                Size;
+
+  for (Format = 0; Format < ARRAY_SIZE (mFormats); Format++) {
+    for (Mode = 0; Mode < 2; Mode++) {
+      HostLcdInit (&Lcd, mFormats[Format], Mode, Width, Height);
+      HOST_CHECK (Lcd.Instance.CopyRow != NULL, "no kernel for %s", mFormatNames[Format]);
+
+      Rect.Left = 0;
+      Rect.Top = 0;
+      Rect.Right = Width;
+      Rect.Bottom = Height;
+      CheckRect (&Lcd, &Rect);
+
+      // every start within two NEON steps and widths around them
+      for (Left = 0; Left < 17; Left++) {
+        for (Size = 1; Size < 40 && Left + Size <= Width; Size += (Size < 18) ? 1 : 7) {
+          Rect.Left = Left;
+          Rect.Right = Left + Size;
+          Rect.Top = (Left * 3) % 20;
+          Rect.Bottom = MIN (Height, Rect.Top + Size);
+          CheckRect (&Lcd, &Rect);
+        }
+      }
+
+      // single pixels in the corners
+      Rect.Left = Width - 1;
+      Rect.Top = Height - 1;
+      Rect.Right = Width;
+      Rect.Bottom = Height;
+      CheckRect (&Lcd, &Rect);
+      Rect.Left = 0;
+      Rect.Right = 1;
+      CheckRect (&Lcd, &Rect);
+
+      HostLcdFree (&Lcd);
+    }
+  }
+
+  // without a kernel nothing gets copied
+  HostLcdInit (&Lcd, LKAPI_LCD_PIXELFORMAT_INVALID, 0, 8, 8);
+  HOST_CHECK (Lcd.Instance.CopyRow == NULL, "got a kernel for an invalid format");
+  Rect.Left = 0;
+  Rect.Top = 0;
+  Rect.Right = 8;
+  Rect.Bottom = 8;
+  LcdCopy (&Lcd.Instance, &Rect);
+  HostLcdFree (&Lcd);
+}
+
+/**
+  LcdCopy before it converted rows, which copied the first bytes of every
+  pixel one at a time.
+
+**/
+STATIC
+VOID
+BaselineCopy (
+  IN LCD_INSTANCE   *Instance,
+  IN CONST LCD_RECT *Rect
+  )
+{
+  UINT32          SourcePixelX;
+  UINT32          DestinationPixelX;
+  UINT32          SourceLine;
+  UINT32          DestinationLine;
+  UINT8           *SourcePixel;
+  UINT8           *DestinationPixel;
+  UINTN           BytesPerPixel;
+  UINT32          HorizontalResolution;
+  UINT32          VerticalResolution;
+  UINT32          DestinationStride;
+  UINT32          Index;
+
+  UINT8* HWBuffer = (VOID*)(UINTN)Instance->FrameBufferBase;
+  UINT8* SWBuffer = (VOID*)(UINTN)Instance->Gop.Mode->FrameBufferBase;
+
+  BytesPerPixel = GetBytesPerPixel();
+  HorizontalResolution = Instance->ModeInfo.HorizontalResolution;
+  VerticalResolution = Instance->ModeInfo.VerticalResolution;
+
+  if (Instance->Gop.Mode->Mode == 0)
+    DestinationStride = HorizontalResolution;
+  else
+    DestinationStride = VerticalResolution;
+
+  for (SourceLine = Rect->Top; SourceLine < Rect->Bottom; SourceLine++)
+  {
+    for (SourcePixelX = Rect->Left; SourcePixelX < Rect->Right; SourcePixelX++)
+    {
+      if (Instance->Gop.Mode->Mode == 0) {
+        DestinationLine = SourceLine;
+        DestinationPixelX = SourcePixelX;
+      }
+      else {
+        DestinationLine = SourcePixelX;
+        DestinationPixelX = VerticalResolution-1-SourceLine;
+      }
+
+      SourcePixel      = SWBuffer + SourceLine      * HorizontalResolution * 4             + SourcePixelX      * 4;
+      DestinationPixel = HWBuffer + DestinationLine * DestinationStride    * BytesPerPixel + DestinationPixelX * BytesPerPixel;
+
+      for(Index = 0; Index<BytesPerPixel; Index++)
+        DestinationPixel[Index] = SourcePixel[Index];
+    }
+  }
+}
+
+STATIC
+UINT64
+TimeFrames (
+  IN HOST_LCD   *Lcd,
+  IN BOOLEAN    Baseline,
+  IN UINTN      Frames
+  )
+{
+  LCD_RECT  Rect;
+  UINT64    Start;
+  UINTN     Index;
+
+  Rect.Left = 0;
+  Rect.Top = 0;
+  Rect.Right = Lcd->Instance.ModeInfo.HorizontalResolution;
+  Rect.Bottom = Lcd->Instance.ModeInfo.VerticalResolution;
+
+  Start = HostTimeNs ();
+  for (Index = 0; Index < Frames; Index++) {
+    if (Baseline) {
+      BaselineCopy (&Lcd->Instance, &Rect);
+    } else {
+      LcdCopy (&Lcd->Instance, &Rect);
+    }
+  }
+
+  return (HostTimeNs () - Start) / Frames;
+}
+
+STATIC
+VOID
+Bench (
+  VOID
+  )
+{
+  HOST_LCD  Lcd;
+  UINTN     Format;
+  UINT32    Mode;
+  UINT64    Old;
+  UINT64    New;
+
+  printf ("1080x1920 frames  per-pixel    LcdCopy  speedup\n");
+  for (Format = 0; Format < ARRAY_SIZE (mFormats); Format++) {
+    for (Mode = 0; Mode < 2; Mode++) {
+      HostLcdInit (&Lcd, mFormats[Format], Mode, 1080, 1920);
+      // warm up the caches and the page tables
+      TimeFrames (&Lcd, FALSE, 1);
+      Old = TimeFrames (&Lcd, TRUE, 20);
+      New = TimeFrames (&Lcd, FALSE, 20);
+      printf ("%-8s %-8s %8.2f ms %8.2f ms %7.2fx\n", mFormatNames[Format], Mode ? "rotated" : "",
+        Old / 1e6, New / 1e6, (double) Old / New);
+      HostLcdFree (&Lcd);
+    }
+  }
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  printf ("LcdCopy using the %s kernels\n", InternalLcdNeonSupported () ? "NEON" : "C");
+
+  TestCopy ();
+
+  if (HostWantBench (Argc, Argv)) {
+    Bench ();
+  }
+
+  return HostDone (Argv[0]);
+}
@@ -0,0 +1,428 @@
+/** @file
+  Checks that reads through the read-ahead window and the write-back block
+  cache of Drivers/MMCHSDxe always return the last data written, whether it
+  still sits in the cache, got flushed or got evicted, and whether the
+  window was filled before the write, after it or while an asynchronous
+  write finished.
+
+  MMCHSReadAhead.c and MMCHSBlockCache.c get included with the driver's
+  header kept out, since that pulls in the whole of the BlockIo stack. The
+  parts of BIO_INSTANCE they use are declared here instead and have to be
+  kept in sync with MMCHS.h. The device is plain memory, HostReadBlocks and
+  HostWriteBlocks do what MMCHSReadBlocks and MMCHSWriteBlocks do.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <HostUefi.h>
+#include <Protocol/BlockIo.h>
+#include <LittleKernelApi.h>
+
+#define _MMCHS_H_
+
+typedef struct {
+  UINT8                                 *Buffer;
+  UINTN                                 MaxBlocks;
+  EFI_LBA                               StartLba;
+  UINTN                                 NumBlocks;
+  EFI_LBA                               NextLba;
+  UINTN                                 WindowBlocks;
+  UINTN                                 Generation;
+  UINT64                                Hits;
+  UINT64                                Misses;
+} BIO_READ_AHEAD;
+
+typedef struct {
+  LIST_ENTRY                            LruLink;
+  LIST_ENTRY                            HashLink;
+  EFI_LBA                               Lba;
+  BOOLEAN                               Valid;
+  BOOLEAN                               Dirty;
+  BOOLEAN                               Queued;
+  UINT8                                 *Data;
+} BIO_CACHE_BLOCK;
+
+typedef struct {
+  UINTN                                 NumBlocks;
+  BIO_CACHE_BLOCK                       *Blocks;
+  LIST_ENTRY                            *HashTable;
+  LIST_ENTRY                            LruList;
+  UINTN                                 DirtyBlocks;
+  UINT8                                 *Data;
+  UINT8                                 *WriteBuffer;
+  lkapi_biodev_segment_t                *Segments;
+} BIO_BLOCK_CACHE;
+
+typedef struct {
+  EFI_BLOCK_IO_MEDIA                    BlockMedia;
+  lkapi_biodev_t                        LKDev;
+  BIO_READ_AHEAD                        ReadAhead;
+  BIO_BLOCK_CACHE                       Cache;
+} BIO_INSTANCE;
+
+#define BLOCK_SIZE      512
+#define DISK_BLOCKS     256
+#define CACHE_BLOCKS    8
+
+#define PcdGet32(TokenName)               HOST_##TokenName
+#define HOST_PcdMMCHSReadAheadMaxSize     (32 * BLOCK_SIZE)
+#define HOST_PcdMMCHSBlockCacheSize       (CACHE_BLOCKS * BLOCK_SIZE)
+
+STATIC UINT8    mDisk[DISK_BLOCKS * BLOCK_SIZE];
+
+//
+// Runs once MMCHSDeviceRead has read the data, stands in for the completion
+// notification of an asynchronous write which finishes meanwhile
+//
+STATIC VOID     (*mDuringRead) (BIO_INSTANCE *Instance);
+
+EFI_STATUS
+MMCHSDeviceRead (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  OUT VOID                          *Buffer
+  )
+{
+  ASSERT (Lba * BLOCK_SIZE + BufferSize <= sizeof (mDisk));
+  VOID    (*Notify) (BIO_INSTANCE *Instance);
+
+  CopyMem (Buffer, mDisk + Lba * BLOCK_SIZE, BufferSize);
+
+  Notify      = mDuringRead;
+  mDuringRead = NULL;
+  if (Notify != NULL) {
+    Notify (Instance);
+  }
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+MMCHSDeviceWrite (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          BufferSize,
+  IN VOID                           *Buffer
+  )
+{
+  ASSERT (Lba * BLOCK_SIZE + BufferSize <= sizeof (mDisk));
+  CopyMem (mDisk + Lba * BLOCK_SIZE, Buffer, BufferSize);
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+MMCHSDeviceWriteV (
+  IN BIO_INSTANCE                   *Instance,
+  IN lkapi_biodev_segment_t         *Segments,
+  IN UINTN                          Count
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < Count; Index++) {
+    MMCHSDeviceWrite (Instance, Segments[Index].lba, Segments[Index].num_blocks * BLOCK_SIZE, Segments[Index].buffer);
+  }
+  return EFI_SUCCESS;
+}
+
+VOID *
+MMCHSDmaAllocateBuffer (
+  IN BIO_INSTANCE                   *Instance,
+  IN UINTN                          Size
+  )
+{
+  return AllocatePool (Size);
+}
+
+VOID
+MMCHSDmaFreeBuffer (
+  IN VOID                           *Buffer,
+  IN UINTN                          Size
+  )
+{
+  FreePool (Buffer);
+}
+
+VOID
+MMCHSReadAheadInvalidate (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  );
+
+VOID
+MMCHSBlockCacheDiscard (
+  IN BIO_INSTANCE                   *Instance,
+  IN EFI_LBA                        Lba,
+  IN UINTN                          NumBlocks
+  );
+
+#include "../../Drivers/MMCHSDxe/MMCHSReadAhead.c"
+#include "../../Drivers/MMCHSDxe/MMCHSBlockCache.c"
+
+//
+// What the disk holds from the point of view of BlockIo
+//
+STATIC UINT8    mExpected[DISK_BLOCKS * BLOCK_SIZE];
+STATIC UINT32   mSeed = 1;
+
+STATIC
+VOID
+HostInstanceInit (
+  OUT BIO_INSTANCE  *Instance
+  )
+{
+  ZeroMem (Instance, sizeof (*Instance));
+  Instance->BlockMedia.BlockSize = BLOCK_SIZE;
+  Instance->BlockMedia.LastBlock = DISK_BLOCKS - 1;
+
+  HostFillRandom (mDisk, sizeof (mDisk), mSeed++);
+  CopyMem (mExpected, mDisk, sizeof (mDisk));
+
+  MMCHSReadAheadInit (Instance);
+  MMCHSBlockCacheInit (Instance);
+  ASSERT (Instance->Cache.NumBlocks == CACHE_BLOCKS);
+}
+
+STATIC
+VOID
+HostInstanceFree (
+  IN BIO_INSTANCE   *Instance
+  )
+{
+  FreePool (Instance->ReadAhead.Buffer);
+  FreePool (Instance->Cache.Blocks);
+  FreePool (Instance->Cache.HashTable);
+  FreePool (Instance->Cache.Data);
+  FreePool (Instance->Cache.WriteBuffer);
+  FreePool (Instance->Cache.Segments);
+}
+
+STATIC
+VOID
+HostReadBlocks (
+  IN BIO_INSTANCE   *Instance,
+  IN EFI_LBA        Lba,
+  IN UINTN          NumBlocks,
+  IN CONST CHAR8    *What
+  )
+{
+  UINT8       Buffer[32 * BLOCK_SIZE];
+  EFI_STATUS  Status;
+
+  ASSERT (NumBlocks <= ARRAY_SIZE (Buffer) / BLOCK_SIZE);
+
+  Status = MMCHSReadAheadRead (Instance, Lba, NumBlocks * BLOCK_SIZE, Buffer);
+  if (!EFI_ERROR (Status)) {
+    MMCHSBlockCachePatchRead (Instance, Lba, NumBlocks * BLOCK_SIZE, Buffer);
+  }
+
+  HOST_CHECK (Status == EFI_SUCCESS, "%s: read of %lu+%lu failed", What,
+    (unsigned long) Lba, (unsigned long) NumBlocks);
+  HOST_CHECK (memcmp (Buffer, mExpected + Lba * BLOCK_SIZE, NumBlocks * BLOCK_SIZE) == 0,
+    "%s: read of %lu+%lu returned stale data", What, (unsigned long) Lba, (unsigned long) NumBlocks);
+}
+
+STATIC
+VOID
+HostWriteBlocks (
+  IN BIO_INSTANCE   *Instance,
+  IN EFI_LBA        Lba,
+  IN UINTN          NumBlocks
+  )
+{
+  UINT8       Buffer[32 * BLOCK_SIZE];
+  EFI_STATUS  Status;
+
+  ASSERT (NumBlocks <= ARRAY_SIZE (Buffer) / BLOCK_SIZE);
+
+  HostFillRandom (Buffer, NumBlocks * BLOCK_SIZE, mSeed++);
+  CopyMem (mExpected + Lba * BLOCK_SIZE, Buffer, NumBlocks * BLOCK_SIZE);
+
+  MMCHSReadAheadInvalidate (Instance, Lba, NumBlocks);
+  Status = MMCHSBlockCacheWrite (Instance, Lba, NumBlocks * BLOCK_SIZE, Buffer);
+  HOST_CHECK (Status == EFI_SUCCESS, "write of %lu+%lu failed", (unsigned long) Lba, (unsigned long) NumBlocks);
+}
+
+//
+// Fills the window with blocks 2 to 5 by reading 0 and 1, then 2 and 3
+//
+STATIC
+VOID
+HostStreamStart (
+  IN BIO_INSTANCE   *Instance,
+  IN CONST CHAR8    *What
+  )
+{
+  Instance->ReadAhead.NextLba = MAX_UINT64;
+  HostReadBlocks (Instance, 0, 2, What);
+  HostReadBlocks (Instance, 2, 2, What);
+  HOST_CHECK (Instance->ReadAhead.StartLba == 2 && Instance->ReadAhead.NumBlocks == 4,
+    "%s: no read-ahead window", What);
+}
+
+//
+// A window filled while a block was dirty must not outlive the block's
+// write-back, reads only get patched while it's still in the cache
+//
+STATIC
+VOID
+TestFlush (
+  VOID
+  )
+{
+  BIO_INSTANCE  Instance;
+
+  HostInstanceInit (&Instance);
+
+  HostStreamStart (&Instance, "flush");
+  HostWriteBlocks (&Instance, 3, 1);
+  HostStreamStart (&Instance, "flush");
+  HostReadBlocks (&Instance, 3, 1, "flush, dirty");
+
+  HOST_CHECK (MMCHSBlockCacheFlush (&Instance, 0, MAX_UINTN) == EFI_SUCCESS, "flush failed");
+  HOST_CHECK (Instance.Cache.DirtyBlocks == 0, "flush left dirty blocks");
+  HostReadBlocks (&Instance, 3, 1, "flush, written back");
+
+  HOST_CHECK (memcmp (mDisk, mExpected, sizeof (mDisk)) == 0, "flush: device doesn't match");
+  HostInstanceFree (&Instance);
+}
+
+STATIC
+VOID
+TestEvict (
+  VOID
+  )
+{
+  BIO_INSTANCE  Instance;
+  UINTN         Index;
+
+  HostInstanceInit (&Instance);
+
+  HostWriteBlocks (&Instance, 3, 1);
+  HostStreamStart (&Instance, "evict");
+
+  // push block 3 out of the cache with writes far away from the window
+  for (Index = 0; Index < CACHE_BLOCKS; Index++) {
+    HostWriteBlocks (&Instance, 200 + Index, 1);
+  }
+  HOST_CHECK (MMCHSBlockCacheLookup (&Instance.Cache, 3) == NULL, "block 3 wasn't evicted");
+  HostReadBlocks (&Instance, 3, 1, "evict, written back");
+
+  HostInstanceFree (&Instance);
+}
+
+//
+// Streams, writes and flushes all over a small range, checking every read
+//
+STATIC
+VOID
+TestMixed (
+  VOID
+  )
+{
+  BIO_INSTANCE  Instance;
+  UINT32        Random[3];
+  UINTN         Step;
+  EFI_LBA       Lba;
+  UINTN         NumBlocks;
+  UINTN         Failures;
+
+  HostInstanceInit (&Instance);
+  Failures = HostFailures;
+
+  Lba = 0;
+  for (Step = 0; Step < 20000; Step++) {
+    HostFillRandom (Random, sizeof (Random), mSeed++);
+    NumBlocks = 1 + Random[1] % 8;
+
+    switch (Random[0] % 8) {
+      case 0:
+      case 1:
+        HostWriteBlocks (&Instance, Random[2] % (64 - NumBlocks), NumBlocks);
+        break;
+      case 2:
+        MMCHSBlockCacheFlush (&Instance, 0, MAX_UINTN);
+        break;
+      case 3:
+        Lba = Random[2] % (64 - NumBlocks);
+        HostReadBlocks (&Instance, Lba, NumBlocks, "mixed");
+        Lba += NumBlocks;
+        break;
+      default:
+        // keep streaming, mostly from the window
+        if (Lba + NumBlocks >= 64) {
+          Lba = 0;
+        }
+        HostReadBlocks (&Instance, Lba, NumBlocks, "mixed");
+        Lba += NumBlocks;
+        break;
+    }
+
+    if (HostFailures != Failures) {
+      fprintf (stderr, "mixed: failed in step %lu\n", (unsigned long) Step);
+      break;
+    }
+  }
+
+  MMCHSBlockCacheFlush (&Instance, 0, MAX_UINTN);
+  HOST_CHECK (memcmp (mDisk, mExpected, sizeof (mDisk)) == 0, "mixed: device doesn't match");
+  HostInstanceFree (&Instance);
+}
+
+STATIC
+VOID
+HostAsyncWriteDone (
+  IN BIO_INSTANCE   *Instance
+  )
+{
+  HostFillRandom (mDisk + 4 * BLOCK_SIZE, BLOCK_SIZE, mSeed++);
+  CopyMem (mExpected + 4 * BLOCK_SIZE, mDisk + 4 * BLOCK_SIZE, BLOCK_SIZE);
+
+  MMCHSReadAheadInvalidate (Instance, 4, 1);
+}
+
+//
+// A window which got filled while an asynchronous write to it finished may
+// hold the old data and must not be used
+//
+STATIC
+VOID
+TestAsyncWrite (
+  VOID
+  )
+{
+  BIO_INSTANCE  Instance;
+
+  HostInstanceInit (&Instance);
+
+  HostReadBlocks (&Instance, 0, 2, "async write");
+  mDuringRead = HostAsyncWriteDone;
+  HostReadBlocks (&Instance, 2, 2, "async write");
+  HOST_CHECK (mDuringRead == NULL, "async write: window wasn't filled");
+  HOST_CHECK (gHostTpl == TPL_APPLICATION, "async write: TPL wasn't restored");
+  HostReadBlocks (&Instance, 4, 2, "async write, finished");
+
+  HostInstanceFree (&Instance);
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  TestFlush ();
+  TestEvict ();
+  TestAsyncWrite ();
+  TestMixed ();
+
+  return HostDone (Argv[0]);
+}
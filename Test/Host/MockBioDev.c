@@ -0,0 +1,401 @@
+/** @file
+  A lkapi_biodev_t for host tests, see MockBioDev.h.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MockBioDev.h"
+
+//
+// What the mock keeps in lkapi_biodev_request_t.pdata, which belongs to LK
+//
+struct _MOCK_REQUEST {
+  lkapi_biodev_request_t  *Request;
+  MOCK_REQUEST            *Next;
+  BOOLEAN                 Done;
+  int                     Result;
+};
+
+VOID
+HostSpinNs (
+  IN UINT64   Ns
+  )
+{
+  UINT64  End;
+
+  End = HostTimeNs () + Ns;
+  while (HostTimeNs () < End) {
+  }
+}
+
+STATIC
+VOID
+MockSleepNs (
+  IN UINT64   Ns
+  )
+{
+  struct timespec Time;
+
+  Time.tv_sec  = Ns / 1000000000;
+  Time.tv_nsec = Ns % 1000000000;
+  while (nanosleep (&Time, &Time) != 0) {
+  }
+}
+
+STATIC
+BOOLEAN
+MockRangeOk (
+  IN MOCK_BIODEV  *Mock,
+  IN UINT64       Lba,
+  IN UINT64       Size
+  )
+{
+  if (Size % Mock->Dev.block_size != 0) {
+    return FALSE;
+  }
+
+  return Lba <= Mock->Dev.num_blocks && Size / Mock->Dev.block_size <= Mock->Dev.num_blocks - Lba;
+}
+
+/**
+  Carries out a transfer, taking as long as the device would.
+
+**/
+STATIC
+int
+MockTransfer (
+  IN MOCK_BIODEV  *Mock,
+  IN BOOLEAN      Write,
+  IN UINT64       Lba,
+  IN UINT64       Size,
+  IN VOID         *Buffer
+  )
+{
+  UINT64  Ns;
+
+  if (!MockRangeOk (Mock, Lba, Size)) {
+    return -1;
+  }
+
+  Ns = Mock->LatencyNs;
+  if (Mock->BytesPerSecond != 0) {
+    Ns += Size * 1000000000 / Mock->BytesPerSecond;
+  }
+
+  pthread_mutex_lock (&Mock->DeviceLock);
+  // even a zero sleep takes tens of us
+  if (Ns != 0) {
+    MockSleepNs (Ns);
+  }
+  if (Write) {
+    CopyMem (Mock->Data + Lba * Mock->Dev.block_size, Buffer, Size);
+    Mock->Writes++;
+  } else {
+    CopyMem (Buffer, Mock->Data + Lba * Mock->Dev.block_size, Size);
+    Mock->Reads++;
+  }
+  pthread_mutex_unlock (&Mock->DeviceLock);
+
+  return 0;
+}
+
+STATIC
+int
+MockInit (
+  lkapi_biodev_t  *Dev
+  )
+{
+  return 0;
+}
+
+STATIC
+int
+MockRead (
+  lkapi_biodev_t      *Dev,
+  unsigned long long  Lba,
+  unsigned long       BufferSize,
+  void                *Buffer
+  )
+{
+  return MockTransfer (MOCK_BIODEV_FROM_DEV (Dev), FALSE, Lba, BufferSize, Buffer);
+}
+
+STATIC
+int
+MockWrite (
+  lkapi_biodev_t      *Dev,
+  unsigned long long  Lba,
+  unsigned long       BufferSize,
+  void                *Buffer
+  )
+{
+  return MockTransfer (MOCK_BIODEV_FROM_DEV (Dev), TRUE, Lba, BufferSize, Buffer);
+}
+
+STATIC
+int
+MockSubmit (
+  lkapi_biodev_t          *Dev,
+  lkapi_biodev_request_t  *Request
+  )
+{
+  MOCK_BIODEV   *Mock;
+  MOCK_REQUEST  *Entry;
+
+  Mock = MOCK_BIODEV_FROM_DEV (Dev);
+
+  // LK checks the request before queueing it, so only completes get errors
+  // from the transfer itself
+  if (!MockRangeOk (Mock, Request->lba, Request->buffersize)) {
+    return -1;
+  }
+
+  Entry = AllocateZeroPool (sizeof (MOCK_REQUEST));
+  if (Entry == NULL) {
+    return -1;
+  }
+  Entry->Request = Request;
+  Request->pdata = Entry;
+
+  pthread_mutex_lock (&Mock->QueueLock);
+  if (Mock->QueueTail != NULL) {
+    Mock->QueueTail->Next = Entry;
+  } else {
+    Mock->QueueHead = Entry;
+  }
+  Mock->QueueTail = Entry;
+  Mock->Submits++;
+  pthread_cond_broadcast (&Mock->QueueCond);
+  pthread_mutex_unlock (&Mock->QueueLock);
+
+  return 0;
+}
+
+STATIC
+int
+MockComplete (
+  lkapi_biodev_t          *Dev,
+  lkapi_biodev_request_t  *Request
+  )
+{
+  MOCK_BIODEV   *Mock;
+  MOCK_REQUEST  *Entry;
+  int           Result;
+
+  Mock = MOCK_BIODEV_FROM_DEV (Dev);
+  Entry = Request->pdata;
+
+  pthread_mutex_lock (&Mock->QueueLock);
+  while (!Entry->Done) {
+    pthread_cond_wait (&Mock->QueueCond, &Mock->QueueLock);
+  }
+  pthread_mutex_unlock (&Mock->QueueLock);
+
+  Result = Entry->Result;
+  Request->pdata = NULL;
+  FreePool (Entry);
+
+  return Result;
+}
+
+STATIC
+VOID *
+MockWorker (
+  VOID  *Context
+  )
+{
+  MOCK_BIODEV             *Mock;
+  MOCK_REQUEST            *Entry;
+  lkapi_biodev_request_t  *Request;
+  VOID                    *Event;
+
+  Mock = Context;
+
+  pthread_mutex_lock (&Mock->QueueLock);
+  for (;;) {
+    while (Mock->QueueHead == NULL && !Mock->Stop) {
+      pthread_cond_wait (&Mock->QueueCond, &Mock->QueueLock);
+    }
+    if (Mock->QueueHead == NULL) {
+      break;
+    }
+
+    Entry = Mock->QueueHead;
+    Mock->QueueHead = Entry->Next;
+    if (Mock->QueueHead == NULL) {
+      Mock->QueueTail = NULL;
+    }
+    pthread_mutex_unlock (&Mock->QueueLock);
+
+    Request = Entry->Request;
+    Entry->Result = MockTransfer (
+                      Mock,
+                      Request->type == LKAPI_BIODEV_REQUEST_WRITE,
+                      Request->lba,
+                      Request->buffersize,
+                      Request->buffer
+                      );
+
+    // once it's done the caller may complete and free the request
+    Event = Request->event;
+
+    pthread_mutex_lock (&Mock->QueueLock);
+    Entry->Done = TRUE;
+    pthread_cond_broadcast (&Mock->QueueCond);
+
+    if (Event != NULL && Mock->Api->event_signal != NULL) {
+      pthread_mutex_unlock (&Mock->QueueLock);
+      Mock->Api->event_signal (Event);
+      pthread_mutex_lock (&Mock->QueueLock);
+    }
+  }
+  pthread_mutex_unlock (&Mock->QueueLock);
+
+  return NULL;
+}
+
+/**
+  Sets up a device around its data and starts the worker.
+
+**/
+STATIC
+MOCK_BIODEV *
+MockBioDevStart (
+  IN lkapi_t  *Api,
+  IN UINT8    *Data,
+  IN UINT64   MapSize,
+  IN UINT32   BlockSize,
+  IN UINT64   NumBlocks,
+  IN UINT64   LatencyNs,
+  IN UINT64   BytesPerSecond
+  )
+{
+  MOCK_BIODEV   *Mock;
+
+  Mock = AllocateZeroPool (sizeof (MOCK_BIODEV));
+  if (Mock == NULL) {
+    return NULL;
+  }
+
+  Mock->Data           = Data;
+  Mock->MapSize        = MapSize;
+
+  Mock->Dev.type       = LKAPI_BIODEV_TYPE_MMC;
+  Mock->Dev.block_size = BlockSize;
+  Mock->Dev.num_blocks = NumBlocks;
+  Mock->Dev.init       = MockInit;
+  Mock->Dev.read       = MockRead;
+  Mock->Dev.write      = MockWrite;
+  Mock->Dev.submit     = MockSubmit;
+  Mock->Dev.complete   = MockComplete;
+
+  Mock->Api            = Api;
+  Mock->LatencyNs      = LatencyNs;
+  Mock->BytesPerSecond = BytesPerSecond;
+
+  pthread_mutex_init (&Mock->DeviceLock, NULL);
+  pthread_mutex_init (&Mock->QueueLock, NULL);
+  pthread_cond_init (&Mock->QueueCond, NULL);
+  pthread_create (&Mock->Worker, NULL, MockWorker, Mock);
+
+  return Mock;
+}
+
+MOCK_BIODEV *
+MockBioDevCreate (
+  IN lkapi_t  *Api,
+  IN UINT32   BlockSize,
+  IN UINT64   NumBlocks,
+  IN UINT64   LatencyNs,
+  IN UINT64   BytesPerSecond
+  )
+{
+  MOCK_BIODEV   *Mock;
+  UINT8         *Data;
+
+  Data = AllocateZeroPool (BlockSize * NumBlocks);
+  if (Data == NULL) {
+    return NULL;
+  }
+
+  Mock = MockBioDevStart (Api, Data, 0, BlockSize, NumBlocks, LatencyNs, BytesPerSecond);
+  if (Mock == NULL) {
+    FreePool (Data);
+  }
+
+  return Mock;
+}
+
+MOCK_BIODEV *
+MockBioDevOpenFile (
+  IN lkapi_t      *Api,
+  IN CONST CHAR8  *Path,
+  IN UINT32       BlockSize,
+  IN UINT64       LatencyNs,
+  IN UINT64       BytesPerSecond
+  )
+{
+  MOCK_BIODEV   *Mock;
+  struct stat   Stat;
+  VOID          *Data;
+  int           Fd;
+
+  Fd = open (Path, O_RDONLY);
+  if (Fd < 0) {
+    return NULL;
+  }
+
+  if (fstat (Fd, &Stat) != 0 || Stat.st_size < BlockSize) {
+    close (Fd);
+    return NULL;
+  }
+
+  // private, so the writes of the benchmarks never reach the file
+  Data = mmap (NULL, Stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, Fd, 0);
+  close (Fd);
+  if (Data == MAP_FAILED) {
+    return NULL;
+  }
+
+  Mock = MockBioDevStart (Api, Data, Stat.st_size, BlockSize, Stat.st_size / BlockSize, LatencyNs, BytesPerSecond);
+  if (Mock == NULL) {
+    munmap (Data, Stat.st_size);
+  }
+
+  return Mock;
+}
+
+VOID
+MockBioDevDestroy (
+  IN MOCK_BIODEV  *Mock
+  )
+{
+  pthread_mutex_lock (&Mock->QueueLock);
+  Mock->Stop = TRUE;
+  pthread_cond_broadcast (&Mock->QueueCond);
+  pthread_mutex_unlock (&Mock->QueueLock);
+  pthread_join (Mock->Worker, NULL);
+
+  pthread_cond_destroy (&Mock->QueueCond);
+  pthread_mutex_destroy (&Mock->QueueLock);
+  pthread_mutex_destroy (&Mock->DeviceLock);
+
+  if (Mock->MapSize != 0) {
+    munmap (Mock->Data, Mock->MapSize);
+  } else {
+    FreePool (Mock->Data);
+  }
+  FreePool (Mock);
+}
@@ -0,0 +1,121 @@
+/** @file
+  A lkapi_biodev_t for host tests, backed by memory or an image file, which
+  takes as long as a real device would.
+
+  Requests cost a fixed latency plus their size at a fixed transfer rate.
+  Like a single eMMC they're carried out one at a time, by a worker thread
+  for submit/complete and by the caller for read/write. Finished submitted
+  requests get signaled through Api->event_signal, as LK does.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __MOCK_BIODEV_H__
+#define __MOCK_BIODEV_H__
+
+#include <pthread.h>
+
+#include <HostBase.h>
+#include <LittleKernelApi.h>
+
+typedef struct _MOCK_REQUEST MOCK_REQUEST;
+
+typedef struct {
+  // first, the callbacks only get this
+  lkapi_biodev_t    Dev;
+
+  lkapi_t           *Api;
+  UINT8             *Data;
+  // size of the mapping if Data is a mapped file
+  UINT64            MapSize;
+  UINT64            LatencyNs;
+  UINT64            BytesPerSecond;
+
+  // held while a transfer is in progress
+  pthread_mutex_t   DeviceLock;
+
+  pthread_mutex_t   QueueLock;
+  pthread_cond_t    QueueCond;
+  MOCK_REQUEST      *QueueHead;
+  MOCK_REQUEST      *QueueTail;
+  BOOLEAN           Stop;
+  pthread_t         Worker;
+
+  UINTN             Reads;
+  UINTN             Writes;
+  UINTN             Submits;
+} MOCK_BIODEV;
+
+#define MOCK_BIODEV_FROM_DEV(a)  BASE_CR (a, MOCK_BIODEV, Dev)
+
+/**
+  Creates a zero filled device.
+
+  @param[in]  Api             event_signal of it gets called when submitted
+                              requests finish
+  @param[in]  BlockSize       Size of a block in bytes
+  @param[in]  NumBlocks       Size of the device in blocks
+  @param[in]  LatencyNs       Time each request takes before any data moves
+  @param[in]  BytesPerSecond  Transfer rate, 0 for no transfer time
+
+  @return     The device, or NULL if it couldn't be allocated
+
+**/
+MOCK_BIODEV *
+MockBioDevCreate (
+  IN lkapi_t  *Api,
+  IN UINT32   BlockSize,
+  IN UINT64   NumBlocks,
+  IN UINT64   LatencyNs,
+  IN UINT64   BytesPerSecond
+  );
+
+/**
+  Creates a device with the contents of an image file. Writes only change
+  the copy in memory, the file stays as it is.
+
+  @param[in]  Api             event_signal of it gets called when submitted
+                              requests finish
+  @param[in]  Path            The image, its size is rounded down to blocks
+  @param[in]  BlockSize       Size of a block in bytes
+  @param[in]  LatencyNs       Time each request takes before any data moves
+  @param[in]  BytesPerSecond  Transfer rate, 0 for no transfer time
+
+  @return     The device, or NULL if the file couldn't be mapped
+
+**/
+MOCK_BIODEV *
+MockBioDevOpenFile (
+  IN lkapi_t      *Api,
+  IN CONST CHAR8  *Path,
+  IN UINT32       BlockSize,
+  IN UINT64       LatencyNs,
+  IN UINT64       BytesPerSecond
+  );
+
+/**
+  Waits for the outstanding requests and frees the device.
+
+**/
+VOID
+MockBioDevDestroy (
+  IN MOCK_BIODEV  *Mock
+  );
+
+/**
+  Busy waits, standing in for the CPU work done between requests.
+
+**/
+VOID
+HostSpinNs (
+  IN UINT64   Ns
+  );
+
+#endif
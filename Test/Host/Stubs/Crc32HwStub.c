@@ -0,0 +1,35 @@
+/** @file
+  Replaces Library/Crc32Lib/<Arch>/Crc32Hw.S when the tests aren't built
+  with HW=1, so Crc32Lib takes its slicing-by-8 path.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <HostBase.h>
+
+BOOLEAN
+EFIAPI
+InternalCrc32HwSupported (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+UINT32
+EFIAPI
+InternalCrc32HwUpdate (
+  IN  UINT32                           Crc,
+  IN  CONST VOID                       *Buffer,
+  IN  UINTN                            Size
+  )
+{
+  abort ();
+}
@@ -0,0 +1,46 @@
+/** @file
+  Replaces Drivers/LcdGraphicsOutputDxe/<Arch>/LcdCopyNeon.S when the tests
+  aren't built with HW=1, so LcdCopy uses its C kernels.
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <HostBase.h>
+
+BOOLEAN
+EFIAPI
+InternalLcdNeonSupported (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+VOID
+EFIAPI
+InternalLcdCopyRowRgb888Neon (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  abort ();
+}
+
+VOID
+EFIAPI
+InternalLcdCopyRowRgb565Neon (
+  OUT VOID          *Destination,
+  IN  CONST UINT32  *Source,
+  IN  UINTN         Pixels
+  )
+{
+  abort ();
+}